@@ -0,0 +1,123 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+#include "bench.hpp"
+
+using namespace std;
+
+namespace bench {
+
+struct entry
+{
+    const char *usage;
+    command run;
+};
+
+static map<string, entry> &commands()
+{
+    static map<string, entry> all;
+    return all;
+}
+
+registrar::registrar(const char *name, const char *usage, command run)
+{
+    commands()[name] = {usage, run};
+}
+
+double micros_since(clock::time_point start)
+{
+    return chrono::duration<double, micro>(clock::now() - start).count();
+}
+
+double samples::total() const
+{
+    return accumulate(values.begin(), values.end(), 0.0);
+}
+
+double samples::mean() const
+{
+    return values.empty() ? 0 : total() / values.size();
+}
+
+double samples::percentile(double p)
+{
+    if (values.empty()) return 0;
+    if (!sorted) sort(values.begin(), values.end());
+    sorted = true;
+    size_t rank = static_cast<size_t>(p / 100 * (values.size() - 1) + 0.5);
+    return values[min(rank, values.size() - 1)];
+}
+
+vector<long> numbers(int argc, char **argv, int i, vector<long> fallback)
+{
+    if (i >= argc) return fallback;
+    vector<long> values;
+    stringstream list(argv[i]);
+    string item;
+    while (getline(list, item, ',')) values.push_back(stol(item));
+    return values;
+}
+
+long number(int argc, char **argv, int i, long fallback)
+{
+    return i < argc ? stol(argv[i]) : fallback;
+}
+
+temp_dir::temp_dir()
+{
+    char name[] = "/tmp/taskmaster_bench.XXXXXX";
+    if (!mkdtemp(name)) throw runtime_error(string("mkdtemp: ") + strerror(errno));
+    path = name;
+}
+
+temp_dir::~temp_dir()
+{
+    error_code ignored;
+    filesystem::remove_all(path, ignored);
+}
+
+string temp_dir::write(const string &name, const string &content) const
+{
+    string file = path + "/" + name;
+    ofstream out(file, ios::trunc);
+    out << content;
+    if (!out.flush()) throw runtime_error("cannot write " + file);
+    return file;
+}
+
+heap::heap(size_t bytes) : data(bytes)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < bytes; i += page) data[i] = 1;
+}
+
+} // namespace bench
+
+int main(int argc, char **argv)
+{
+    auto &all = bench::commands();
+    auto it = argc > 1 ? all.find(argv[1]) : all.end();
+    if (it == all.end()) {
+        cerr << "usage: taskmaster_bench NAME [ARGS...]" << endl;
+        for (auto &c : all) cerr << "    " << c.first << " " << c.second.usage << endl;
+        return 1;
+    }
+    // The daemon logs to clog, the tables go to cout
+    clog.rdbuf(nullptr);
+    try {
+        return it->second.run(argc - 1, argv + 1);
+    } catch (const exception &e) {
+        cerr << argv[1] << ": " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/*
+ * Benchmarks of the daemon. Each one is a command of taskmaster_bench:
+ *   taskmaster_bench NAME [ARGS...]
+ * and prints a table, one row per configuration, times in microseconds.
+ */
+namespace bench {
+
+using clock = std::chrono::steady_clock;
+using command = int (*)(int argc, char **argv);
+
+// Adds a command, see BENCH()
+struct registrar
+{
+    registrar(const char *name, const char *usage, command run);
+};
+
+#define BENCH(name, usage)                                                   \
+    static int bench_##name(int argc, char **argv);                          \
+    static bench::registrar register_##name(#name, usage, bench_##name);     \
+    static int bench_##name(int argc, char **argv)
+
+double micros_since(clock::time_point start);
+
+// Latencies of one configuration
+class samples
+{
+public:
+    void add(double micros) {values.push_back(micros);}
+    std::size_t size() const {return values.size();}
+    double total() const;
+    double mean() const;
+    // p is in [0, 100]
+    double percentile(double p);
+private:
+    std::vector<double> values;
+    bool sorted = false;
+};
+
+// argv[i] as a list of numbers, fallback if it is not given
+std::vector<long> numbers(int argc, char **argv, int i, std::vector<long> fallback);
+long number(int argc, char **argv, int i, long fallback);
+
+// A directory under /tmp, removed with its files
+class temp_dir
+{
+public:
+    temp_dir();
+    ~temp_dir();
+    temp_dir(const temp_dir &) = delete;
+    temp_dir& operator=(const temp_dir &) = delete;
+
+    const std::string &get_path() const {return path;}
+    // Creates or replaces a file of the directory, returns its path
+    std::string write(const std::string &name, const std::string &content) const;
+private:
+    std::string path;
+};
+
+// Allocates and touches bytes of heap, so forking the process copies them
+// into page tables like a daemon of that size
+class heap
+{
+public:
+    explicit heap(std::size_t bytes);
+private:
+    std::vector<char> data;
+};
+
+} // namespace bench
+
+#endif // BENCH_HPP
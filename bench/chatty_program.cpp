@@ -0,0 +1,20 @@
+// Program started by the log_writer benchmark:
+//   taskmaster_chatty_program LINES LINE_BYTES
+// It writes LINES lines of LINE_BYTES bytes to stdout, one write() per
+// line like an unbuffered logger
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+int main(int argc, char **argv)
+{
+    long lines = argc > 1 ? atol(argv[1]) : 0;
+    long line_bytes = argc > 2 ? atol(argv[2]) : 64;
+    std::string line(line_bytes > 0 ? line_bytes - 1 : 0, 'x');
+    line += '\n';
+    for (long i = 0; i < lines; ++i)
+        if (write(STDOUT_FILENO, line.data(), line.size()) != static_cast<ssize_t>(line.size()))
+            return 1;
+    return 0;
+}
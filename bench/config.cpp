@@ -0,0 +1,82 @@
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "task.hpp"
+
+using namespace std;
+
+// A program with the keys a real config sets
+static string _program(long i)
+{
+    string name = "worker-" + to_string(i);
+    return name + ":\n"
+           "    prog: /usr/bin/worker\n"
+           "    args: [\"--id\", \"" + to_string(i) + "\", \"--verbose\"]\n"
+           "    numprocs: 2\n"
+           "    autostart: true\n"
+           "    autorestart: unexpected\n"
+           "    exitcodes: [0, 2]\n"
+           "    starttime: 5\n"
+           "    stoptime: 10\n"
+           "    stdout: /var/log/" + name + ".out\n"
+           "    stderr: /var/log/" + name + ".err\n"
+           "    env: {ROLE: worker, SHARD: " + to_string(i % 16) + "}\n";
+}
+
+static void _print(long tasks, long files, bench::samples &rounds)
+{
+    cout << setw(7) << tasks << setw(7) << files << fixed << setprecision(1) <<
+            setw(10) << rounds.mean() / 1000 << setw(10) << rounds.percentile(50) / 1000 <<
+            setw(10) << rounds.percentile(99) / 1000 << endl;
+}
+
+// tconfs_from_yaml() on TASKS programs in one file, then split over FILES
+// files of an include directory, which are parsed on several threads
+BENCH(config, "[TASKS,...] [FILES,...] [ROUNDS]")
+{
+    auto task_counts = bench::numbers(argc, argv, 1, {1000, 10000});
+    auto file_counts = bench::numbers(argc, argv, 2, {8, 64});
+    long rounds = bench::number(argc, argv, 3, 10);
+
+    cout << "  tasks  files   mean ms    p50 ms    p99 ms" << endl;
+    for (long tasks : task_counts) {
+        bench::temp_dir dir;
+        string all;
+        for (long i = 0; i < tasks; ++i) all += _program(i);
+        string single = dir.write("single.yaml", all);
+        bench::samples parse;
+        for (long r = 0; r < rounds; ++r) {
+            auto start = bench::clock::now();
+            size_t parsed = tconfs_from_yaml(single).size();
+            parse.add(bench::micros_since(start));
+            if (parsed != static_cast<size_t>(tasks)) throw runtime_error("lost tasks");
+        }
+        _print(tasks, 1, parse);
+
+        for (long files : file_counts) {
+            string subdir = "split-" + to_string(files);
+            string main = dir.write(subdir + ".yaml", "taskmaster:\n"
+                                    "    include: " + subdir + "\n");
+            filesystem::create_directory(dir.get_path() + "/" + subdir);
+            vector<string> parts(files);
+            for (long i = 0; i < tasks; ++i) parts[i % files] += _program(i);
+            for (long f = 0; f < files; ++f)
+                dir.write(subdir + "/" + to_string(f) + ".yaml", parts[f]);
+            bench::samples split;
+            for (long r = 0; r < rounds; ++r) {
+                master_config mconf;
+                auto start = bench::clock::now();
+                size_t parsed = tconfs_from_yaml(main, &mconf).size();
+                split.add(bench::micros_since(start));
+                if (parsed != static_cast<size_t>(tasks)) throw runtime_error("lost tasks");
+            }
+            _print(tasks, files, split);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "bench.hpp"
+#include "process.hpp"
+#include "process_table.hpp"
+
+using namespace std;
+
+// Above any pid_max, a replica killed by mistake gets ESRCH
+static constexpr pid_t FAKE_PID = 1 << 22;
+
+static void _print(size_t tasks, const char *layout, const char *op, size_t bytes,
+                   bench::samples &rounds)
+{
+    cout << setw(7) << tasks << "  " << left << setw(8) << layout << setw(7) << op <<
+            right << setw(9) << bytes / 1024 << fixed << setprecision(1) <<
+            setw(10) << rounds.mean() << setw(10) << rounds.percentile(50) <<
+            setw(10) << rounds.percentile(99) << endl;
+}
+
+// Liveness scan of every replica and lookups of random replicas, in the
+// process_table columns against one vector of proc::process per task,
+// the layout the table replaced. Every other replica is running
+BENCH(layout, "[REPLICAS] [TASKS,...] [ROUNDS]")
+{
+    long replicas = bench::number(argc, argv, 1, 100000);
+    auto task_counts = bench::numbers(argc, argv, 2, {1000, 100000});
+    long rounds = bench::number(argc, argv, 3, 50);
+    proc::launch_spec::params params;
+    params.bin = "/bin/true";
+    auto spec = proc::launch_spec::create(params);
+
+    cout << "  tasks  layout  op        mem KB   mean us    p50 us    p99 us" << endl;
+    for (long tasks : task_counts) {
+        uint32_t per_task = replicas / tasks;
+        vector<vector<proc::process>> objects(tasks);
+        process_table table;
+        vector<process_table::slice> slices;
+        for (long t = 0; t < tasks; ++t) {
+            objects[t].reserve(per_task);
+            slices.push_back(table.allocate(per_task));
+            for (uint32_t r = 0; r < per_task; ++r) {
+                objects[t].emplace_back(spec);
+                if (r % 2) continue;
+                objects[t].back().set_started(FAKE_PID + r);
+                table.set_started(slices.back().first + r, FAKE_PID + r);
+            }
+        }
+        size_t live = tasks * ((per_task + 1) / 2);
+        mt19937 rng(42);
+        vector<pair<uint32_t, uint32_t>> keys(replicas);
+        for (auto &k : keys) k = {rng() % tasks, rng() % per_task};
+
+        bench::samples object_scan, table_scan, object_lookup, table_lookup;
+        long long expected = -1;
+        for (long i = 0; i < rounds; ++i) {
+            size_t found = 0;
+            auto start = bench::clock::now();
+            for (auto &t : objects)
+                for (auto &p : t) found += p.is_exist();
+            object_scan.add(bench::micros_since(start));
+            start = bench::clock::now();
+            for (auto &s : slices)
+                for (uint32_t row = s.first; row < s.first + s.count; ++row)
+                    found += table.is_exist(row);
+            table_scan.add(bench::micros_since(start));
+            if (found != 2 * live) throw runtime_error("scans disagree");
+
+            long long pids = 0, rows = 0;
+            start = bench::clock::now();
+            for (auto &k : keys) pids += objects[k.first][k.second].get_pid();
+            object_lookup.add(bench::micros_since(start));
+            start = bench::clock::now();
+            for (auto &k : keys) rows += table.get_pid(slices[k.first].first + k.second);
+            table_lookup.add(bench::micros_since(start));
+            if (pids != rows || (expected != -1 && pids != expected))
+                throw runtime_error("lookups disagree");
+            expected = pids;
+        }
+
+        size_t object_bytes = tasks * sizeof(vector<proc::process>) +
+                              tasks * per_task * sizeof(proc::process);
+        size_t table_bytes = table.memory_usage() +
+                             slices.size() * sizeof(process_table::slice);
+        _print(tasks, "objects", "scan", object_bytes, object_scan);
+        _print(tasks, "table", "scan", table_bytes, table_scan);
+        _print(tasks, "objects", "lookup", object_bytes, object_lookup);
+        _print(tasks, "table", "lookup", table_bytes, table_lookup);
+        // The fake processes must not be killed by ~process
+        for (auto &t : objects)
+            for (auto &p : t) p.set_status(0);
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "log_writer.hpp"
+#include "process.hpp"
+
+using namespace std;
+
+static constexpr auto DRAIN_TIMEOUT = chrono::seconds(60);
+
+static off_t _file_size(const string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) ? 0 : st.st_size;
+}
+
+// Starts the replicas and returns once their output is in the file, in
+// seconds. Without a log_writer the replicas append to the file themselves
+static double _run(const proc::launch_spec &spec, long replicas, log_writer *logs,
+                   const log_writer::capture *c, const string &path, off_t expected)
+{
+    vector<pid_t> pids;
+    auto start = bench::clock::now();
+    for (long i = 0; i < replicas; ++i) {
+        int err = 0;
+        proc::output_fds output;
+        if (logs && !logs->open_pipes(*c, i, output, err))
+            throw runtime_error("open_pipes failed");
+        pid_t pid = proc::process::launch(spec, err, -1, output);
+        if (output.err != output.out) close(output.err);
+        if (output.out != -1) close(output.out);
+        if (pid == -1) throw runtime_error("spawn failed");
+        pids.push_back(pid);
+    }
+    for (pid_t pid : pids) waitpid(pid, nullptr, 0);
+    // The writer thread may still be draining the pipes
+    auto deadline = bench::clock::now() + DRAIN_TIMEOUT;
+    while (_file_size(path) < expected) {
+        if (bench::clock::now() > deadline) throw runtime_error("lost output");
+        this_thread::sleep_for(chrono::microseconds(100));
+    }
+    return bench::micros_since(start) / 1e6;
+}
+
+// Output of REPLICAS chatty replicas written straight to the file by the
+// children (O_APPEND) against captured through pipes by the log_writer
+// thread, with splice() or with a prefix on every line
+BENCH(log_writer, "[REPLICAS] [LINES] [LINE_BYTES] [ROUNDS]")
+{
+    long replicas = bench::number(argc, argv, 1, 100);
+    long lines = bench::number(argc, argv, 2, 20000);
+    long line_bytes = bench::number(argc, argv, 3, 100);
+    long rounds = bench::number(argc, argv, 4, 3);
+    bench::temp_dir dir;
+    off_t payload = static_cast<off_t>(replicas) * lines * line_bytes;
+
+    cout << "replicas  mode          MB   mean s  MB/s" << endl;
+    for (const char *mode : {"direct", "splice", "prefix"}) {
+        bench::samples seconds;
+        string mode_name = mode;
+        for (long r = 0; r < rounds; ++r) {
+            string path = dir.get_path() + "/" + mode_name + "-" + to_string(r) + ".log";
+            proc::launch_spec::params params;
+            params.bin = TCHATTY_BENCH_PROGRAM;
+            params.args = {to_string(lines), to_string(line_bytes)};
+            off_t expected = payload;
+            if (mode_name == "direct") {
+                params.stdout_file = path;
+                seconds.add(_run(*proc::launch_spec::create(params), replicas, nullptr,
+                                 nullptr, path, expected));
+                continue;
+            }
+            log_writer logs;
+            log_writer::capture c;
+            c.out = c.err = logs.open(path, 0, 0);
+            if (mode_name == "prefix") {
+                c.prefix = "bench";
+                // "bench:INDEX " before every line
+                for (long i = 0; i < replicas; ++i)
+                    expected += lines * static_cast<off_t>(7 + to_string(i).size());
+            }
+            seconds.add(_run(*proc::launch_spec::create(params), replicas, &logs, &c,
+                             path, expected));
+            if (_file_size(path) != expected) throw runtime_error("wrong output size");
+        }
+        double mb = payload / 1e6;
+        cout << setw(8) << replicas << "  " << left << setw(8) << mode << right <<
+                fixed << setprecision(1) << setw(8) << mb << setprecision(3) <<
+                setw(9) << seconds.mean() << setprecision(0) <<
+                setw(6) << mb / seconds.mean() << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "bench.hpp"
+#include "defaults.hpp"
+#include "protocol.hpp"
+#include "status_report.hpp"
+#include "task.hpp"
+
+using namespace std;
+
+// A status reply of the daemon for tasks of two running replicas, split in
+// parts of TSTATUS_CHUNK tasks like rep_status() sends it
+static vector<status_report> _status_reply(size_t tasks)
+{
+    vector<status_report> parts;
+    status_report summary;
+    summary.all = true;
+    summary.now = time(nullptr);
+    summary.total = summary.count = tasks;
+    parts.push_back(summary);
+    for (size_t i = 0; i < tasks; ++i) {
+        if (i % TSTATUS_CHUNK == 0) parts.emplace_back();
+        task_report t;
+        t.name = "worker-" + to_string(i);
+        t.state = task_status::RUNNING;
+        t.memory = 4096;
+        t.starttime = summary.now - 60;
+        t.starttries = 1;
+        for (pid_t pid : {1000, 1001}) {
+            proc_report p;
+            p.running = true;
+            p.pid = pid + 2 * i;
+            p.use.valid = true;
+            p.use.cpu = 1.5;
+            p.use.rss = 8 << 20;
+            p.use.fds = 12;
+            t.procs.push_back(p);
+        }
+        parts.back().tasks.push_back(move(t));
+    }
+    return parts;
+}
+
+// Encoding of a status reply into zmq messages, decoding and rendering on
+// the client side
+BENCH(protocol, "[TASKS,...] [ROUNDS]")
+{
+    auto task_counts = bench::numbers(argc, argv, 1, {2, 10000});
+    long rounds = bench::number(argc, argv, 2, 200);
+
+    cout << "  tasks     bytes  encode us  decode us  render us  total p50  total p99" << endl;
+    for (long tasks : task_counts) {
+        auto reply = _status_reply(tasks);
+        bench::samples encode, decode, render, total;
+        size_t bytes = 0;
+        for (long i = 0; i < rounds; ++i) {
+            auto start = bench::clock::now();
+            vector<zmq::message_t> frames;
+            for (auto &part : reply) {
+                wire::writer msg(wire::msg_type::REP_STATUS);
+                wire::write_status(msg, part);
+                frames.push_back(msg.finish());
+            }
+            double encoded = bench::micros_since(start);
+
+            auto decoding = bench::clock::now();
+            vector<status_report> parts(frames.size());
+            bytes = 0;
+            for (size_t f = 0; f < frames.size(); ++f) {
+                wire::reader msg(frames[f].data(), frames[f].size());
+                wire::read_status(msg, parts[f]);
+                bytes += frames[f].size();
+            }
+            double decoded = bench::micros_since(decoding);
+
+            auto rendering = bench::clock::now();
+            status_renderer renderer(false);
+            size_t text = 0;
+            for (auto &part : parts) text += renderer.render(part).size();
+            text += renderer.finish().size();
+            double rendered = bench::micros_since(rendering);
+            if (!text) throw runtime_error("empty status");
+
+            encode.add(encoded);
+            decode.add(decoded);
+            render.add(rendered);
+            total.add(bench::micros_since(start));
+        }
+        cout << setw(7) << tasks << setw(10) << bytes << fixed << setprecision(1) <<
+                setw(11) << encode.mean() << setw(11) << decode.mean() <<
+                setw(11) << render.mean() << setw(11) << total.percentile(50) <<
+                setw(11) << total.percentile(99) << endl;
+    }
+    return 0;
+}
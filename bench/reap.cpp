@@ -0,0 +1,81 @@
+#include <csignal>
+#include <sys/wait.h>
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include "bench.hpp"
+#include "process.hpp"
+#include "runtime.hpp"
+
+using namespace std;
+
+// Waits for pid to exit without reaping it
+static void _wait_zombie(pid_t pid)
+{
+    siginfo_t info;
+    while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) && errno == EINTR) {}
+}
+
+// Cost of one child exit with many supervised processes: the first version
+// polled waitpid(pid, WNOHANG) for every process, runtime::reap() only
+// visits the children that changed state
+BENCH(reap, "[PROCESSES,...] [EXITS]")
+{
+    auto counts = bench::numbers(argc, argv, 1, {10, 1000, 10000});
+    long exits = bench::number(argc, argv, 2, 100);
+    proc::launch_spec::params params;
+    params.bin = "/bin/sleep";
+    params.args = {"1000"};
+    auto spec = proc::launch_spec::create(params);
+
+    cout << "processes  path            mean us    p50 us    p99 us" << endl;
+    for (long count : counts) {
+        runtime rt;
+        vector<pid_t> pids;
+        size_t notified = 0;
+        for (long i = 0; i < count + 2 * exits; ++i) {
+            int err = 0;
+            pid_t pid = proc::process::launch(*spec, err);
+            if (pid == -1) throw runtime_error(string("launch: ") + strerror(err));
+            pids.push_back(pid);
+            rt.watch(pid, [&notified](int) {++notified;});
+        }
+        bench::samples polled, reaped;
+        for (long i = 0; i < 2 * exits; ++i) {
+            pid_t pid = pids.back();
+            pids.pop_back();
+            kill(pid, SIGKILL);
+            _wait_zombie(pid);
+            auto start = bench::clock::now();
+            if (i < exits) {
+                // Every process is checked, the exited one is the last
+                int status;
+                for (pid_t p : pids) waitpid(p, &status, WNOHANG | WUNTRACED);
+                waitpid(pid, &status, WNOHANG | WUNTRACED);
+                polled.add(bench::micros_since(start));
+                rt.unwatch(pid);
+            } else {
+                rt.reap();
+                reaped.add(bench::micros_since(start));
+            }
+        }
+        if (notified != static_cast<size_t>(exits))
+            throw runtime_error("reap missed an exit");
+        for (auto path : {make_pair("waitpid(pid)", &polled),
+                          make_pair("reap()", &reaped)})
+            cout << setw(9) << count << "  " << left << setw(12) << path.first <<
+                    right << fixed << setprecision(1) <<
+                    setw(10) << path.second->mean() <<
+                    setw(10) << path.second->percentile(50) <<
+                    setw(10) << path.second->percentile(99) << endl;
+        for (pid_t pid : pids) {
+            rt.unwatch(pid);
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+    return 0;
+}
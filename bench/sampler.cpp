@@ -0,0 +1,88 @@
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "defaults.hpp"
+#include "proc_sampler.hpp"
+#include "process.hpp"
+
+using namespace std;
+
+// The daemon should spend less than this share of a core on sampling
+static constexpr double SAMPLER_TARGET = 1;  // % at TSAMPLE_INTERVAL
+
+static double _cpu_seconds()
+{
+    rusage use;
+    getrusage(RUSAGE_SELF, &use);
+    return use.ru_utime.tv_sec + use.ru_stime.tv_sec +
+           (use.ru_utime.tv_usec + use.ru_stime.tv_usec) / 1e6;
+}
+
+// CPU time of a proc_sampler sweep over PROCESSES sleeping children. The
+// benchmark sleeps meanwhile, the CPU time of the process is the sampler's.
+// Fails if a sweep every TSAMPLE_INTERVAL takes more than SAMPLER_TARGET
+BENCH(sampler, "[PROCESSES,...] [INTERVAL_MS] [SWEEPS]")
+{
+    auto counts = bench::numbers(argc, argv, 1, {1000, 10000});
+    long interval_ms = bench::number(argc, argv, 2, 500);
+    long sweeps = bench::number(argc, argv, 3, 10);
+    proc::launch_spec::params params;
+    params.bin = "/bin/sleep";
+    params.args = {"1000"};
+    auto spec = proc::launch_spec::create(params);
+    auto interval = chrono::milliseconds(interval_ms);
+    bool over = false;
+
+    cout << "processes  sampled  cpu ms/sweep  % core  % core at " << TSAMPLE_INTERVAL << "s" << endl;
+    for (long count : counts) {
+        vector<pid_t> pids;
+        for (long i = 0; i < count; ++i) {
+            int err = 0;
+            pid_t pid = proc::process::launch(*spec, err);
+            if (pid == -1) throw runtime_error(string("launch: ") + strerror(err));
+            pids.push_back(pid);
+        }
+        {
+            proc_sampler sampler;
+            sampler.configure(interval);
+            for (pid_t pid : pids) sampler.add(pid);
+            // The first sweep opens the /proc files, the second takes the
+            // CPU baseline
+            this_thread::sleep_for(interval * 2 + interval / 2);
+            double cpu = _cpu_seconds();
+            auto start = bench::clock::now();
+            this_thread::sleep_for(interval * sweeps);
+            cpu = _cpu_seconds() - cpu;
+            double wall = bench::micros_since(start) / 1e6;
+            // A process is not sampled once the descriptors run out, three
+            // are kept per process
+            long sampled = 0;
+            for (pid_t pid : pids) {
+                proc_sampler::sample s;
+                sampled += sampler.get(pid, s) && s.valid;
+            }
+            if (!sampled) throw runtime_error("no valid sample");
+            double per_sweep = cpu / sweeps;
+            double share = per_sweep / TSAMPLE_INTERVAL * 100;
+            over |= share > SAMPLER_TARGET;
+            cout << setw(9) << count << setw(9) << sampled << fixed << setprecision(2) <<
+                    setw(14) << per_sweep * 1000 << setw(8) << cpu / wall * 100 <<
+                    setw(13) << share << endl;
+        }
+        for (pid_t pid : pids) {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+    if (over) cout << "over the target of " << SAMPLER_TARGET << "% of a core" << endl;
+    return over ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include "bench.hpp"
+#include "process.hpp"
+
+using namespace std;
+
+// The launch of the first version: fork() of the whole daemon, then
+// setpgrp(), freopen() and chdir() in the child
+static pid_t _fork_start(const proc::launch_spec &spec)
+{
+    pid_t pid = fork();
+    if (pid) return pid;
+    setpgrp();
+    if (!freopen(spec.stdin_file().c_str(), "r", stdin)) freopen("/dev/null", "r", stdin);
+    if (!freopen(spec.stdout_file().c_str(), "a", stdout)) freopen("/dev/null", "w", stdout);
+    if (!freopen(spec.stderr_file().c_str(), "a", stderr)) freopen("/dev/null", "w", stderr);
+    umask(spec.mask());
+    if (chdir(spec.workdir().c_str())) _exit(1);
+    execve(spec.bin().c_str(), spec.argv(), spec.envp());
+    _exit(1);
+}
+
+// Spawn latency of fork() against vfork() with fds opened by the parent
+BENCH(spawn, "[HEAP_MB,...] [SPAWNS]")
+{
+    auto heaps = bench::numbers(argc, argv, 1, {0, 256, 1024});
+    long spawns = bench::number(argc, argv, 2, 500);
+    proc::launch_spec::params params;
+    params.bin = "/bin/true";
+    auto spec = proc::launch_spec::create(params);
+
+    cout << "heap MB  path   mean us  p50 us  p99 us  spawns/s" << endl;
+    for (long mb : heaps) {
+        bench::heap ballast(mb << 20);
+        for (bool forked : {true, false}) {
+            bench::samples latency;
+            for (long i = 0; i < spawns; ++i) {
+                int err = 0;
+                auto start = bench::clock::now();
+                pid_t pid = forked ? _fork_start(*spec) : proc::process::launch(*spec, err);
+                latency.add(bench::micros_since(start));
+                if (pid == -1) throw runtime_error("spawn failed");
+                waitpid(pid, nullptr, 0);
+            }
+            cout << setw(7) << mb << "  " << (forked ? "fork " : "vfork") <<
+                    fixed << setprecision(1) << setw(9) << latency.mean() <<
+                    setw(8) << latency.percentile(50) <<
+                    setw(8) << latency.percentile(99) <<
+                    setprecision(0) << setw(10) << spawns / (latency.total() / 1e6) <<
+                    endl;
+        }
+    }
+    return 0;
+}
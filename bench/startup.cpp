@@ -0,0 +1,80 @@
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "config_cache.hpp"
+#include "task.hpp"
+#include "taskmaster.hpp"
+
+using namespace std;
+
+static void _print(long tasks, const char *path, bench::samples &load, bench::samples &startup)
+{
+    cout << setw(7) << tasks << "  " << left << setw(7) << path << right << fixed <<
+            setprecision(1) << setw(10) << load.mean() / 1000 <<
+            setw(12) << startup.mean() / 1000 << setw(10) << startup.percentile(50) / 1000 <<
+            setw(10) << startup.percentile(99) / 1000 << endl;
+}
+
+// Startup of a daemon of TASKS stopped tasks from the YAML files and from
+// the config cache. Load is reading the configs only, startup also
+// creates the tasks, as the constructor of taskmaster does
+BENCH(startup, "[TASKS,...] [ROUNDS]")
+{
+    auto task_counts = bench::numbers(argc, argv, 1, {1000, 10000});
+    long rounds = bench::number(argc, argv, 2, 10);
+
+    cout << "  tasks  path     load ms  startup ms    p50 ms    p99 ms" << endl;
+    for (long tasks : task_counts) {
+        bench::temp_dir dir;
+        string config;
+        for (long i = 0; i < tasks; ++i)
+            config += "worker-" + to_string(i) + ":\n"
+                      "    prog: /usr/bin/worker\n"
+                      "    args: [\"--id\", \"" + to_string(i) + "\"]\n"
+                      "    numprocs: 2\n"
+                      "    autorestart: unexpected\n"
+                      "    stdout: /var/log/worker-" + to_string(i) + ".out\n"
+                      "    env: {ROLE: worker}\n";
+        string file = dir.write("taskmaster.yaml", config);
+        string cache_file = dir.get_path() + "/taskmaster.cache";
+        config_cache cache(cache_file);
+        {
+            // Writes the cache
+            taskmaster master(file, cache_file);
+        }
+
+        bench::samples yaml_load, cache_load, yaml_startup, cache_startup;
+        for (long r = 0; r < rounds; ++r) {
+            vector<task_config> tconfs;
+            master_config mconf;
+            auto start = bench::clock::now();
+            tconfs = tconfs_from_yaml(file, &mconf);
+            yaml_load.add(bench::micros_since(start));
+            if (tconfs.size() != static_cast<size_t>(tasks)) throw runtime_error("lost tasks");
+
+            tconfs.clear();
+            start = bench::clock::now();
+            if (!cache.load(file, tconfs, mconf)) throw runtime_error("stale cache");
+            cache_load.add(bench::micros_since(start));
+            if (tconfs.size() != static_cast<size_t>(tasks)) throw runtime_error("lost tasks");
+
+            start = bench::clock::now();
+            {
+                taskmaster master(file, "");
+                yaml_startup.add(bench::micros_since(start));
+            }
+            start = bench::clock::now();
+            {
+                taskmaster master(file, cache_file);
+                cache_startup.add(bench::micros_since(start));
+            }
+        }
+        _print(tasks, "yaml", yaml_load, yaml_startup);
+        _print(tasks, "cache", cache_load, cache_startup);
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "communication.hpp"
+#include "protocol.hpp"
+#include "reactor.hpp"
+#include "taskmaster.hpp"
+
+using namespace std;
+
+static constexpr int LOAD_RCVTIMEO = 5000;
+
+// Reads the status of all tasks requests times on a REQ socket of its own,
+// like a CLI. Returns the latencies, a reply that never comes stops the
+// client
+static vector<double> _status_client(zmq::context_t &context, const string &address,
+                                     long requests, atomic<long> &lost)
+{
+    zmq::socket_t socket(context, ZMQ_REQ);
+    socket.setsockopt(ZMQ_RCVTIMEO, LOAD_RCVTIMEO);
+    socket.setsockopt(ZMQ_LINGER, 0);
+    socket.connect(address);
+    vector<double> latencies;
+    // The first request waits for the connection, it is not counted
+    for (long i = 0; i <= requests; ++i) {
+        auto start = bench::clock::now();
+        uint64_t cursor = 0, count = 0;
+        do {
+            wire::writer req(wire::msg_type::REQ_STATUS);
+            wire::write_query(req, status_query());
+            req.u64(cursor);
+            socket.send(req.finish());
+            zmq::message_t reply;
+            if (!socket.recv(&reply)) {
+                lost += requests + 1 - i;
+                return latencies;
+            }
+            wire::reader msg(reply.data(), reply.size());
+            status_report part;
+            wire::read_status(msg, part);
+            if (!cursor) count = part.count;
+            if (part.tasks.empty()) break;
+            cursor += part.tasks.size();
+        } while (cursor < count);
+        if (i) latencies.push_back(bench::micros_since(start));
+    }
+    return latencies;
+}
+
+// Latency of status while CLIENTS clients ask for it at once, the daemon
+// of TASKS stopped tasks runs in the benchmark
+BENCH(status_load, "[CLIENTS] [REQUESTS] [TASKS] [PORT]")
+{
+    long clients = bench::number(argc, argv, 1, 100);
+    long requests = bench::number(argc, argv, 2, 100);
+    long tasks = bench::number(argc, argv, 3, 100);
+    long port = bench::number(argc, argv, 4, 4300);
+    bench::temp_dir dir;
+    string config;
+    for (long i = 0; i < tasks; ++i)
+        config += "task-" + to_string(i) + ":\n"
+                  "    prog: /bin/sleep\n"
+                  "    args: [\"1000\"]\n"
+                  "    autostart: false\n";
+
+    reactor loop;
+    taskmaster master(dir.write("taskmaster.yaml", config), "");
+    communication daemon(&master, port);
+    // The last client stops the event loop
+    int done = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (done == -1) throw runtime_error("eventfd failed");
+    loop.add(done, EPOLLIN, [&loop](uint32_t) {loop.stop();});
+
+    zmq::context_t context(1);
+    string address = "tcp://127.0.0.1:" + to_string(port);
+    vector<vector<double>> results(clients);
+    atomic<long> lost{0}, running{clients};
+    vector<thread> threads;
+    auto begin = bench::clock::now();
+    for (long c = 0; c < clients; ++c)
+        threads.emplace_back([&, c]() {
+            results[c] = _status_client(context, address, requests, lost);
+            uint64_t one = 1;
+            if (--running == 0 && write(done, &one, sizeof(one))) {}
+        });
+    daemon.run_master(loop);
+    double seconds = bench::micros_since(begin) / 1e6;
+    for (auto &t : threads) t.join();
+    loop.remove(done);
+    close(done);
+
+    bench::samples latency;
+    for (auto &r : results)
+        for (double micros : r) latency.add(micros);
+    cout << "clients  tasks  requests  lost   mean us    p50 us    p99 us  requests/s" << endl;
+    cout << setw(7) << clients << setw(7) << tasks << setw(10) << latency.size() <<
+            setw(6) << lost.load() << fixed << setprecision(1) <<
+            setw(10) << latency.mean() << setw(10) << latency.percentile(50) <<
+            setw(10) << latency.percentile(99) << setprecision(0) <<
+            setw(12) << latency.size() / seconds << endl;
+    return lost ? 1 : 0;
+}
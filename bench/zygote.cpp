@@ -0,0 +1,87 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#include "bench.hpp"
+#include "process.hpp"
+#include "zygote.hpp"
+#include "taskmaster_zygote.h"
+
+using namespace std;
+
+using start_func = function<pid_t(const proc::output_fds &output, int &err)>;
+
+// Microseconds from the start of a replica until it writes to stdout
+static double _until_ready(const start_func &start)
+{
+    int ready[2];
+    if (pipe2(ready, O_CLOEXEC)) throw runtime_error(strerror(errno));
+    proc::output_fds output;
+    output.out = ready[1];
+    int err = 0;
+    auto begin = bench::clock::now();
+    pid_t pid = start(output, err);
+    close(ready[1]);
+    char byte;
+    bool started = pid > 0 && read(ready[0], &byte, 1) == 1;
+    double micros = bench::micros_since(begin);
+    close(ready[0]);
+    if (pid > 0) waitpid(pid, nullptr, 0);
+    if (!started) throw runtime_error(string("replica did not start: ") + strerror(err));
+    return micros;
+}
+
+// Start latency of a program that initializes for INIT_MS, started with
+// execve() or forked from its zygote template
+BENCH(zygote, "[INIT_MS,...] [STARTS] [HEAP_MB]")
+{
+    auto inits = bench::numbers(argc, argv, 1, {0, 50, 200});
+    long starts = bench::number(argc, argv, 2, 50);
+    long heap_mb = bench::number(argc, argv, 3, 64);
+    // Replicas are forked twice, the benchmark reaps them like the daemon
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+
+    cout << "init ms  path            mean us    p50 us    p99 us" << endl;
+    for (long ms : inits) {
+        proc::launch_spec::params params;
+        params.bin = TZYGOTE_BENCH_PROGRAM;
+        params.args = {to_string(ms), to_string(heap_mb)};
+        auto spec = proc::launch_spec::create(params);
+        params.envs.push_back(string(TASKMASTER_ZYGOTE_ENV) + "=" +
+                              to_string(TASKMASTER_ZYGOTE_FD));
+        bench::samples execs, first, forks;
+        pid_t template_pid;
+        {
+            zygote z(proc::launch_spec::create(params));
+            auto fork_replica = [&z, &spec](const proc::output_fds &output, int &err) {
+                return z.fork_replica(*spec, 0, err, output);
+            };
+            // The first replica waits for the template to initialize
+            first.add(_until_ready(fork_replica));
+            template_pid = z.get_pid();
+            for (long i = 0; i < starts; ++i) {
+                execs.add(_until_ready([&spec](const proc::output_fds &output, int &err) {
+                    return proc::process::launch(*spec, err, -1, output);
+                }));
+                forks.add(_until_ready(fork_replica));
+            }
+        }
+        waitpid(template_pid, nullptr, 0);
+        for (auto path : {make_pair("execve", &execs),
+                          make_pair("zygote first", &first),
+                          make_pair("zygote", &forks)})
+            cout << setw(7) << ms << "  " << left << setw(12) << path.first <<
+                    right << fixed << setprecision(1) <<
+                    setw(11) << path.second->mean() <<
+                    setw(10) << path.second->percentile(50) <<
+                    setw(10) << path.second->percentile(99) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,24 @@
+// Program started by the zygote benchmark:
+//   taskmaster_zygote_program INIT_MS HEAP_MB
+// It initializes for INIT_MS and touches HEAP_MB of heap, like a runtime
+// that loads its modules. Then it writes one byte to stdout once it is
+// ready, either as a plain process or as a replica of the template
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+#include "taskmaster_zygote.h"
+
+int main(int argc, char **argv)
+{
+    long init_ms = argc > 1 ? atol(argv[1]) : 0;
+    long heap_mb = argc > 2 ? atol(argv[2]) : 0;
+    std::vector<char> heap(heap_mb << 20);
+    for (size_t i = 0; i < heap.size(); i += 4096) heap[i] = 1;
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(init_ms);
+    while (std::chrono::steady_clock::now() < end) {}
+    taskmaster_zygote_serve();
+    return write(STDOUT_FILENO, "r", 1) == 1 ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cgroup.hpp"
+#include "defaults.hpp"
+
+using namespace std;
+
+cgroup::~cgroup()
+{
+    if (owned) remove();
+}
+
+shared_ptr<cgroup> cgroup::delegated(string &error)
+{
+    // The cgroup v2 mount point, it is not /sys/fs/cgroup on hybrid systems
+    string mount, line;
+    ifstream mountinfo("/proc/self/mountinfo");
+    while (mount.empty() && getline(mountinfo, line)) {
+        istringstream fields(line);
+        string field, point;
+        for (int i = 0; i < 5; ++i) fields >> field;
+        point = field;
+        while (fields >> field && field != "-");
+        if (fields >> field && field == "cgroup2") mount = point;
+    }
+    string self;
+    ifstream cgroups("/proc/self/cgroup");
+    while (getline(cgroups, line))
+        if (line.compare(0, 3, "0::") == 0) self = line.substr(3);
+    if (mount.empty() || self.empty()) {
+        error = "no cgroup v2 hierarchy";
+        return nullptr;
+    }
+    if (self == "/") self.clear();
+    shared_ptr<cgroup> base(new cgroup(mount + self, false));
+    // Processes may only live in the leaves of a group with controllers,
+    // the root group is the exception
+    if (!self.empty()) {
+        string leaf_error;
+        auto leaf = base->child(TCGROUP_DAEMON_LEAF, false, leaf_error);
+        if (!leaf) {
+            error = leaf_error;
+            return nullptr;
+        }
+        leaf->owned = false;
+        if (!leaf->attach(getpid())) {
+            error = "cannot move the daemon to " + leaf->path + ": " +
+                    strerror(errno);
+            return nullptr;
+        }
+    }
+    base->enable_controllers();
+    return base;
+}
+
+shared_ptr<cgroup> cgroup::child(const string &name, bool parent,
+                                 string &error) const
+{
+    string child_path = path + "/" + name;
+    if (mkdir(child_path.c_str(), 0755) && errno != EEXIST) {
+        error = "cannot create " + child_path + ": " + strerror(errno);
+        return nullptr;
+    }
+    shared_ptr<cgroup> group(new cgroup(child_path, true));
+    if (parent) group->enable_controllers();
+    return group;
+}
+
+bool cgroup::set(const string &file, const string &value) const
+{
+    int fd = open((path + "/" + file).c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    bool ok = write(fd, value.data(), value.size()) ==
+              static_cast<ssize_t>(value.size());
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return ok;
+}
+
+int cgroup::open_procs() const
+{
+    return open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+}
+
+bool cgroup::attach(pid_t pid) const
+{
+    return set("cgroup.procs", to_string(pid));
+}
+
+void cgroup::kill() const
+{
+    if (set("cgroup.kill", "1")) return;
+    // Kernels before 5.14, processes forked meanwhile are caught by the
+    // next pass
+    for (int pass = 0; pass < 3; ++pass) {
+        istringstream procs(read("cgroup.procs"));
+        bool any = false;
+        for (pid_t pid; procs >> pid; any = true) ::kill(pid, SIGKILL);
+        if (!any) break;
+    }
+}
+
+bool cgroup::remove()
+{
+    return !rmdir(path.c_str()) || errno == ENOENT;
+}
+
+cgroup::stats cgroup::get_stats() const
+{
+    stats s;
+    istringstream cpu(read("cpu.stat"));
+    string key;
+    for (uint64_t value; cpu >> key >> value;)
+        if (key == "usage_usec") s.usage_usec = value;
+    auto number = [this](const string &file) {
+        string value = read(file);
+        return value.empty() ? 0 : strtoull(value.c_str(), nullptr, 10);
+    };
+    s.memory = number("memory.current");
+    s.memory_peak = number("memory.peak");
+    s.pids = number("pids.current");
+    return s;
+}
+
+/*
+ * Private
+ */
+
+void cgroup::enable_controllers() const
+{
+    // Controllers that the parent does not delegate are skipped
+    istringstream available(read("cgroup.controllers"));
+    for (string name; available >> name;)
+        if (name == "cpu" || name == "memory" || name == "pids" || name == "io")
+            set("cgroup.subtree_control", "+" + name);
+}
+
+string cgroup::read(const string &file) const
+{
+    ifstream in(path + "/" + file);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
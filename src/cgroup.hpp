@@ -0,0 +1,56 @@
+#ifndef CGROUP_HPP
+#define CGROUP_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+ * A directory of the cgroup v2 hierarchy. Groups created by the daemon are
+ * removed when they are destroyed if they are empty. Methods that only read
+ * or write interface files may be called from any thread.
+ */
+class cgroup
+{
+public:
+    struct stats
+    {
+        std::uint64_t usage_usec = 0;        // cpu.stat
+        std::uint64_t memory = 0;            // memory.current
+        std::uint64_t memory_peak = 0;       // memory.peak
+        std::uint64_t pids = 0;              // pids.current
+    };
+
+    ~cgroup();
+    cgroup(const cgroup &) = delete;
+    cgroup& operator=(const cgroup &) = delete;
+
+    // Moves the daemon into a leaf of its own cgroup so that controllers can
+    // be enabled for the tasks. Returns nullptr and sets error if no
+    // delegated cgroup v2 hierarchy is available
+    static std::shared_ptr<cgroup> delegated(std::string &error);
+
+    // Creates a sub-group, controllers are enabled for its own children
+    // if 'parent' is set. Returns nullptr and sets error on failure
+    std::shared_ptr<cgroup> child(const std::string &name, bool parent,
+                                  std::string &error) const;
+    bool set(const std::string &file, const std::string &value) const;
+    // Opens cgroup.procs for a child that moves itself, -1 on failure
+    int open_procs() const;
+    bool attach(pid_t pid) const;
+    // Kills every process of the group, grandchildren included
+    void kill() const;
+    // Removes the empty group, returns true if it is gone
+    bool remove();
+    stats get_stats() const;
+    const std::string &get_path() const {return path;}
+private:
+    cgroup(std::string path, bool owned) : path(move(path)), owned(owned) {}
+    void enable_controllers() const;
+    std::string read(const std::string &file) const;
+
+    std::string path;
+    bool owned;                              // Created by the daemon
+};
+
+#endif // CGROUP_HPP
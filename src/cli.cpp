@@ -1,4 +1,10 @@
+#include <poll.h>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "cli.hpp"
+#include "defaults.hpp"
 
 using namespace std;
 
@@ -8,113 +14,216 @@ static unordered_map<string, cmd_types> _cmd_map = {
         {"restart",       CMD_RESTART},
         {"status",        CMD_STATUS},
         {"reload-config", CMD_RELOAD_CONFIG},
-        {"exit",          CMD_EXIT}
+        {"exit",          CMD_EXIT},
+        {"tail",          CMD_TAIL},
+        {"attach",        CMD_ATTACH},
+        {"job",           CMD_JOB},
+        {"events",        CMD_EVENTS}
 };
 
+// Reads TARGET... [--no-wait]
+static bool _read_job_args(istringstream &args, vector<string> &targets, bool &wait)
+{
+    wait = true;
+    for (string arg; args >> arg;) {
+        if (arg == "--no-wait") wait = false;
+        else if (arg[0] != '-') targets.push_back(arg);
+        else return false;
+    }
+    return !targets.empty();
+}
+
 int cli::run()
 {
-    for (string line; (cout << CLI_PROMPT, getline(cin, line));) {
-        istringstream cmd_stream(line);
-        string cmd;
-        if (!(cmd_stream >> cmd)) continue;
+    for (string line; (cout << CLI_PROMPT, getline(cin, line));)
+        exec(line);
+    return 0;
+}
 
-        auto cmd_type = _cmd_map.find(cmd);
-        if (cmd_type == _cmd_map.end()) {
-            cerr << "Unknown command: " << cmd << endl << CLI_USAGE
-                   << flush;
-            continue;
+// Reads commands when stdin is readable, so the loop keeps supervising
+// the tasks while the console waits for input
+int cli::run(reactor &loop)
+{
+    // Regular files cannot be polled, they are read without the loop
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) || S_ISREG(st.st_mode)) return run();
+    this->loop = &loop;
+    // stdin is read without cin, its buffer would hide lines from epoll
+    loop.add(STDIN_FILENO, EPOLLIN, [this, &loop](uint32_t) {
+        char buf[4096];
+        ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+        if (n == -1 && errno == EINTR) return;
+        if (n <= 0) {
+            following = false;
+            loop.remove(STDIN_FILENO);
+            loop.stop();
+            if (!input.empty()) exec(input);
+            return;
         }
-
-        switch (cmd_type->second) {
-        case CMD_START:
-            cmd_start(cmd_stream);
-            break;
-        case CMD_STOP:
-            cmd_stop(cmd_stream);
-            break;
-        case CMD_RESTART:
-            cmd_restart(cmd_stream);
-            break;
-        case CMD_STATUS:
-            cmd_status(cmd_stream);
-            break;
-        case CMD_RELOAD_CONFIG:
-            cmd_reload_config(cmd_stream);
-            break;
-        case CMD_EXIT:
-            cmd_exit(cmd_stream);
-            break;
-        default:
-            cerr << "Unknown error while parsing command." << endl;
+        input.append(buf, n);
+        for (size_t nl; (nl = input.find('\n')) != string::npos;) {
+            string line = input.substr(0, nl);
+            input.erase(0, nl + 1);
+            // The line that ends follow mode is not a command, the
+            // lines after it are
+            if (following) {
+                following = false;
+                continue;
+            }
+            exec(line);
         }
-    }
+        cout << CLI_PROMPT << flush;
+    });
+    cout << CLI_PROMPT << flush;
+    loop.run();
     return 0;
 }
 
-void cli::cmd_start(istringstream &args)
+void cli::exec(const string &line)
 {
-    string name;
-    if (!(args >> name)) {
-        cerr << "Usage: start NAME" << endl;
+    istringstream cmd_stream(line);
+    string cmd;
+    if (!(cmd_stream >> cmd)) return;
+
+    auto cmd_type = _cmd_map.find(cmd);
+    if (cmd_type == _cmd_map.end()) {
+        cerr << "Unknown command: " << cmd << endl << CLI_USAGE
+               << flush;
         return;
     }
-    try {
-        auto res = worker.start(name);
-        if(!res.empty()) cout << res << endl;
-    } catch (const exception &e) {
-        cerr << name << ": error: " << e.what() << endl;
+
+    switch (cmd_type->second) {
+    case CMD_START:
+        cmd_start(cmd_stream);
+        break;
+    case CMD_STOP:
+        cmd_stop(cmd_stream);
+        break;
+    case CMD_RESTART:
+        cmd_restart(cmd_stream);
+        break;
+    case CMD_STATUS:
+        cmd_status(cmd_stream);
+        break;
+    case CMD_RELOAD_CONFIG:
+        cmd_reload_config(cmd_stream);
+        break;
+    case CMD_EXIT:
+        cmd_exit(cmd_stream);
+        break;
+    case CMD_TAIL:
+        cmd_tail(cmd_stream);
+        break;
+    case CMD_ATTACH:
+        cmd_attach(cmd_stream);
+        break;
+    case CMD_JOB:
+        cmd_job(cmd_stream);
+        break;
+    case CMD_EVENTS:
+        cmd_events(cmd_stream);
+        break;
+    default:
+        cerr << "Unknown error while parsing command." << endl;
     }
 }
 
-void cli::cmd_stop(istringstream &args)
+void cli::cmd_start(istringstream &args)
 {
-    string name;
-    if (!(args >> name)) {
-        cerr << "Usage: stop NAME" << endl;
+    vector<string> targets;
+    bool wait;
+    if (!_read_job_args(args, targets, wait)) {
+        cerr << "Usage: start NAME|GROUP|GLOB|all... [--no-wait]" << endl;
         return;
     }
-    try {
-        auto res = worker.stop(name);
-        if(!res.empty()) cout << res << endl;
-    } catch (const exception &e) {
-        cerr << name << ": error: " << e.what() << endl;
+    run_job(job_kind::START, targets, wait);
+}
+
+void cli::cmd_stop(istringstream &args)
+{
+    vector<string> targets;
+    bool wait;
+    if (!_read_job_args(args, targets, wait)) {
+        cerr << "Usage: stop NAME|GROUP|GLOB|all... [--no-wait]" << endl;
+        return;
     }
+    run_job(job_kind::STOP, targets, wait);
 }
 
 void cli::cmd_restart(istringstream &args)
 {
-    string name;
-    if (!(args >> name)) {
-        cerr << "Usage: restart NAME" << endl;
+    vector<string> targets;
+    bool wait;
+    if (!_read_job_args(args, targets, wait)) {
+        cerr << "Usage: restart NAME|GROUP|GLOB|all... [--no-wait]" << endl;
         return;
     }
-    try {
-        auto res = worker.restart(name);
-        if(!res.empty()) cout << res << endl;
-    } catch (const exception &e) {
-        cerr << name << ": error: " << e.what() << endl;
-    }
+    run_job(job_kind::RESTART, targets, wait);
 }
 
 void cli::cmd_status(istringstream &args)
 {
-    string name;
-    args >> name; // empty -> all
+    status_query query;
+    for (string arg; args >> arg;) {
+        string value;
+        bool valid = true;
+        if (arg == "--failed") {
+            query.failed = true;
+        } else if (arg == "--json") {
+            query.json = true;
+        } else if (arg == "--state" && args >> value) {
+            istringstream states(value);
+            for (string state; getline(states, state, ',');) {
+                int bit = parse_state_name(state);
+                if (bit < 0) valid = false;
+                else query.states |= 1u << bit;
+            }
+        } else if (arg == "--offset" && args >> value) {
+            query.offset = strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--limit" && args >> value) {
+            query.limit = strtoul(value.c_str(), nullptr, 10);
+        } else if (arg[0] != '-' && query.pattern.empty()) {
+            query.pattern = arg; // empty -> all
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            cerr << "Usage: status [PATTERN] [--state S[,S...]] [--failed] "
+                    "[--offset N] [--limit N] [--json]" << endl;
+            return;
+        }
+    }
     try {
-        auto res = worker.status(name);
-        if(!res.empty()) cout << res;
+        // Parts are printed as they arrive
+        worker.status(query, [](const string &part) {
+            cout << part << flush;
+            return bool(cout);
+        });
     } catch (const exception &e) {
-        cerr << name << ": error: " << e.what() << endl;
+        cerr << query.pattern << ": error: " << e.what() << endl;
     }
 }
 
 void cli::cmd_reload_config(istringstream &args)
 {
-    string file;
-    args >> file; // empty -> old config
-    auto res = worker.reload_config(file);
+    vector<string> file; // empty -> old config
+    bool wait = true, dry_run = false, valid = true;
+    for (string arg; valid && args >> arg;) {
+        if (arg == "--dry-run") dry_run = true;
+        else if (arg == "--no-wait") wait = false;
+        else if (arg[0] != '-' && file.empty()) file.push_back(arg);
+        else valid = false;
+    }
+    if (!valid) {
+        cerr << "Usage: reload-config [FILE] [--dry-run] [--no-wait]" << endl;
+        return;
+    }
+    if (!dry_run) {
+        run_job(job_kind::RELOAD_CONFIG, file, wait);
+        return;
+    }
     try {
-        if(!res.empty()) cout << res << endl;
+        cout << worker.plan_reload(file.empty() ? "" : file[0]) << flush;
     } catch (const exception &e) {
         cerr << "error: " << e.what() << endl;
     }
@@ -138,3 +247,147 @@ void cli::cmd_exit(istringstream &args)
         cerr << endl << "Usage: exit [cli|daemon]" << endl;
     }
 }
+
+void cli::cmd_tail(istringstream &args)
+{
+    string name, flag;
+    if (!(args >> name) || ((args >> flag) && flag != "-f")) {
+        cerr << "Usage: tail NAME [-f]" << endl;
+        return;
+    }
+    try {
+        vector<uint64_t> cursors;
+        string res = worker.tail(name, cursors, TTAIL_BACKLOG);
+        // The first reply may stop early, the rest of the backlog follows
+        while (!res.empty()) {
+            cout << res;
+            res = worker.tail(name, cursors, 0);
+        }
+        cout << flush;
+        if (!flag.empty()) follow(name, cursors);
+    } catch (const exception &e) {
+        cerr << name << ": error: " << e.what() << endl;
+    }
+}
+
+void cli::cmd_attach(istringstream &args)
+{
+    string name;
+    if (!(args >> name)) {
+        cerr << "Usage: attach NAME" << endl;
+        return;
+    }
+    try {
+        vector<uint64_t> cursors;
+        worker.tail(name, cursors, 0);
+        follow(name, cursors);
+    } catch (const exception &e) {
+        cerr << name << ": error: " << e.what() << endl;
+    }
+}
+
+void cli::follow(const string &name, vector<uint64_t> &cursors)
+{
+    cout << "Press Enter to detach from " << name << endl;
+    following = true;
+    while (following) {
+        string res = worker.tail(name, cursors, 0);
+        cout << res << flush;
+        // A full reply means more output is waiting
+        int timeout = res.empty() ? TTAIL_POLL_MS : 0;
+        if (loop) {
+            // The local loop keeps supervising and stops following on Enter
+            loop->run_once(timeout);
+            continue;
+        }
+        pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+        if (poll(&pfd, 1, timeout) > 0) {
+            string line;
+            getline(cin, line);
+            following = false;
+        }
+    }
+}
+
+void cli::check_detach()
+{
+    // The local loop reads stdin itself
+    if (loop) return;
+    pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    if (poll(&pfd, 1, 0) > 0) {
+        string line;
+        getline(cin, line);
+        following = false;
+    }
+}
+
+void cli::cmd_job(istringstream &args)
+{
+    uint64_t id;
+    string flag;
+    if (!(args >> id) || ((args >> flag) && flag != "--wait")) {
+        cerr << "Usage: job ID [--wait]" << endl;
+        return;
+    }
+    try {
+        print_job(worker.job(id, !flag.empty()));
+    } catch (const exception &e) {
+        cerr << "job " << id << ": error: " << e.what() << endl;
+    }
+}
+
+void cli::run_job(job_kind kind, const vector<string> &targets, bool wait)
+{
+    try {
+        uint64_t id = worker.submit(kind, targets);
+        if (!id) return;
+        if (wait) print_job(worker.job(id, true));
+        else cout << "job " << id << " submitted" << endl;
+    } catch (const exception &e) {
+        cerr << "error: " << e.what() << endl;
+    }
+}
+
+void cli::print_job(const job_info &info)
+{
+    if (!info.id) return;
+    if (info.state == job_info::RUNNING) cout << "job " << info.id << ": running" << endl;
+    else if (info.state == job_info::DONE) cout << info.result << endl;
+    else cerr << info.result << endl;
+}
+
+void cli::cmd_events(istringstream &args)
+{
+    string name;
+    bool json = false;
+    for (string arg; args >> arg;) {
+        if (arg == "--json") {
+            json = true;
+        } else if (arg[0] != '-' && name.empty()) {
+            name = arg; // empty -> all
+        } else {
+            cerr << "Usage: events [NAME] [--json]" << endl;
+            return;
+        }
+    }
+    cout << "Press Enter to stop" << endl;
+    following = true;
+    uint64_t last = 0;
+    try {
+        worker.events(name, [this, &name, json, &last](const task_event *event) {
+            if (event) {
+                // The sequence of one task is used when only it is followed
+                uint64_t seq = name.empty() ? event->seq : event->task_seq;
+                if (last && seq > last + 1)
+                    cerr << "warning: " << seq - last - 1 << " events lost" << endl;
+                last = seq;
+                cout << render_event(*event, json) << flush;
+            }
+            check_detach();
+            return following && bool(cout);
+        });
+    } catch (const exception &e) {
+        cerr << "error: " << e.what() << endl;
+    }
+    following = false;
+}
@@ -4,17 +4,26 @@
 #include <iostream>
 #include <sstream>
 #include <unordered_map>
+#include <vector>
+#include <cstdint>
 
 #include "master.hpp"
+#include "reactor.hpp"
 
 static constexpr auto CLI_PROMPT = "taskmaster> ";
 static constexpr auto CLI_USAGE = "Available commands:\n"
-                                  "    start NAME\n"
-                                  "    stop NAME\n"
-                                  "    restart NAME\n"
-                                  "    status [NAME]\n"
-                                  "    reload-config [FILE]\n"
-                                  "    exit [cli|daemon]\n";
+                                  "    start TARGET... [--no-wait]\n"
+                                  "    stop TARGET... [--no-wait]\n"
+                                  "    restart TARGET... [--no-wait]\n"
+                                  "    status [PATTERN] [--state S[,S...]] [--failed]\n"
+                                  "           [--offset N] [--limit N] [--json]\n"
+                                  "    reload-config [FILE] [--dry-run] [--no-wait]\n"
+                                  "    job ID [--wait]\n"
+                                  "    exit [cli|daemon]\n"
+                                  "    tail NAME [-f]\n"
+                                  "    attach NAME\n"
+                                  "    events [NAME] [--json]\n"
+                                  "A TARGET is a task, a group, a glob or all\n";
 
 namespace  {
 enum cmd_types {
@@ -23,7 +32,11 @@ enum cmd_types {
     CMD_RESTART,
     CMD_STATUS,
     CMD_RELOAD_CONFIG,
-    CMD_EXIT
+    CMD_EXIT,
+    CMD_TAIL,
+    CMD_ATTACH,
+    CMD_JOB,
+    CMD_EVENTS
 };
 }
 
@@ -32,14 +45,31 @@ class cli
 public:
     cli(master &worker) : worker(worker) {}
     int run();
+    int run(reactor &loop);
 private:
     master &worker;
+    reactor *loop = nullptr;                 // Set in local mode
+    bool following = false;                  // Enter stops tail -f and attach
+    std::string input;                       // Unfinished line read in local mode
+    void exec(const std::string &line);
+    // Prints new output until Enter is pressed
+    void follow(const std::string &name, std::vector<std::uint64_t> &cursors);
+    // Checks for Enter without the local loop, clears following on it
+    void check_detach();
     void cmd_start(std::istringstream &args);
     void cmd_stop(std::istringstream &args);
     void cmd_restart(std::istringstream &args);
     void cmd_status(std::istringstream &args);
     void cmd_reload_config(std::istringstream &args);
     void cmd_exit(std::istringstream &args);
+    void cmd_tail(std::istringstream &args);
+    void cmd_attach(std::istringstream &args);
+    void cmd_job(std::istringstream &args);
+    void cmd_events(std::istringstream &args);
+    // Waits for the job unless wait is false
+    void run_job(job_kind kind, const std::vector<std::string> &targets,
+                 bool wait);
+    static void print_job(const job_info &info);
 };
 
 #endif // CLI_HPP
@@ -1,7 +1,11 @@
+#include <unistd.h>
+#include <sys/eventfd.h>
+
 #include <iostream>
 #include <memory>
-#include <cstring>
 #include <cstdlib>
+#include <cstring>
+#include <utility>
 
 #include "communication.hpp"
 
@@ -10,7 +14,7 @@ using namespace std;
 communication::communication(taskmaster *master_p, unsigned int port,
                              const std::string address) :
     context_t(1),
-    socket_t(*this, (master_p ? ZMQ_REP : ZMQ_REQ)),
+    socket_t(*this, (master_p ? ZMQ_ROUTER : ZMQ_REQ)),
     master(master_p)
 {
     if (master_p) {
@@ -22,7 +26,18 @@ communication::communication(taskmaster *master_p, unsigned int port,
             clog << "Connection initialization error: " << e.what() << endl <<
                     "The program will run in uncontrolled mode." << endl;
         }
+        try {
+            publisher.reset(new zmq::socket_t(*this, ZMQ_PUB));
+            publisher->bind("tcp://*:" + to_string(port + TEVENTS_PORT_OFFSET));
+            events_listener = master->get_events().subscribe(
+                [this](const task_event &event) {publish(event);});
+        } catch (const exception &e) {
+            publisher.reset();
+            clog << "Warning: events are not published: " << e.what() << endl;
+        }
     } else {
+        events_address = "tcp://" + address + ":" +
+                         to_string(port + TEVENTS_PORT_OFFSET);
         try {
             monitor_init();
             connect("tcp://" + address + ":" + to_string(port));
@@ -35,115 +50,308 @@ communication::communication(taskmaster *master_p, unsigned int port,
 
 communication::~communication()
 {
+    if (events_listener) master->get_events().unsubscribe(events_listener);
+    if (loop && requests_fd != -1) loop->remove(requests_fd);
+    if (loop && wakeup_fd != -1) loop->remove(wakeup_fd);
+    if (wakeup_fd != -1) ::close(wakeup_fd);
+    // Only the client runs a monitor
+    if (!monitor_thread.joinable()) return;
     zmq::monitor_t::abort();
     monitor_thread.join();
 }
 
-void communication::run_master()
+void communication::run_master(reactor &event_loop)
 {
+    loop = &event_loop;
+    master->attach(*loop);
+    if (connected) {
+        requests_fd = getsockopt<int>(ZMQ_FD);
+        loop->add(requests_fd, EPOLLIN | EPOLLET,
+                  [this](uint32_t) {on_requests();});
+        wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeup_fd == -1)
+            clog << "Warning: eventfd: " << strerror(errno) << endl;
+        else
+            loop->add(wakeup_fd, EPOLLIN, [this](uint32_t) {
+                uint64_t count;
+                while (read(wakeup_fd, &count, sizeof(count)) > 0);
+                on_requests();
+            });
+        on_requests();
+    }
+    loop->run();
+}
+
+// ZMQ_FD is edge-triggered, every queued request is read on wakeup.
+// A send may consume the edge of a request that arrived meanwhile, so
+// ZMQ_EVENTS is checked again once the commands are answered.
+// Read-only requests are answered first, so they never wait for commands
+void communication::on_requests()
+{
+    vector<client_request> commands;
+    do {
+        while (getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN) {
+            client_request req;
+            if (!recv_request(req)) break;
+            auto data = static_cast<const uint8_t *>(req.request.data());
+            if (req.request.size() >= wire::HEADER_SIZE &&
+                !wire::is_read_only(static_cast<msg_type>(data[2])))
+                commands.push_back(move(req));
+            else
+                handle_request(req);
+        }
+        for (auto &req : commands) handle_request(req);
+        commands.clear();
+    } while (getsockopt<int>(ZMQ_EVENTS) & ZMQ_POLLIN);
+}
+
+// A reply sent outside on_requests() has the same effect on ZMQ_FD, the
+// requests are read again from the event loop
+void communication::wake_up()
+{
+    uint64_t one = 1;
+    if (wakeup_fd != -1 && write(wakeup_fd, &one, sizeof(one))) {}
+}
+
+// A REQ client puts an empty delimiter between the identity the ROUTER
+// socket prefixes and the request
+bool communication::recv_request(client_request &req)
+{
+    zmq::message_t identity;
     while (true) {
-        zmq::message_t request;
-        recv(&request);
-        msg_hdr *msg = static_cast<msg_hdr *>(request.data());
-        clog << "Recived message: type " << static_cast<int>(msg->type) << endl;
-        switch (msg->type) {
+        if (!recv(&identity, ZMQ_DONTWAIT)) return false;
+        vector<zmq::message_t> frames;
+        for (bool more = identity.more(); more;) {
+            frames.emplace_back();
+            recv(&frames.back());
+            more = frames.back().more();
+        }
+        if (frames.size() == 2 && !frames[0].size()) {
+            req.client.assign(static_cast<const char *>(identity.data()),
+                              identity.size());
+            req.request = move(frames[1]);
+            return true;
+        }
+        clog << "Warning: dropped a message without a request envelope" << endl;
+    }
+}
+
+void communication::handle_request(client_request &req)
+{
+    reply_to = req.client;
+    routed = false;
+    try {
+        wire::reader msg(req.request.data(), req.request.size());
+        clog << "Recived message: type " << static_cast<int>(msg.type()) << endl;
+        switch (msg.type()) {
         case msg_type::REQ_START:
-            rep_start(msg->data);
+            rep_submit(job_kind::START, msg);
             break;
         case msg_type::REQ_STOP:
-            rep_stop(msg->data);
+            rep_submit(job_kind::STOP, msg);
             break;
         case msg_type::REQ_RESTART:
-            rep_restart(msg->data);
+            rep_submit(job_kind::RESTART, msg);
             break;
         case msg_type::REQ_STATUS:
-            rep_status(msg->data);
+            rep_status(msg);
             break;
         case msg_type::REQ_RELOAD_CONFIG:
-            rep_reload_config(msg->data);
+            rep_submit(job_kind::RELOAD_CONFIG, msg);
             break;
         case msg_type::REQ_EXIT:
             rep_exit();
             break;
-        default:;
-            send_str("error: invalid message type", msg_type::REP_ERR);
+        case msg_type::REQ_TAIL:
+            rep_tail(msg);
+            break;
+        case msg_type::REQ_JOB:
+            rep_job(msg);
+            break;
+        case msg_type::REQ_PLAN_RELOAD:
+            rep_plan_reload(msg.str());
+            break;
+        default:
+            send_rep("error: invalid message type", msg_type::REP_ERR);
         }
+    } catch (const exception &e) {
+        // Fields are read before any reply is sent
+        send_rep(string("error: invalid message: ") + e.what(), msg_type::REP_ERR);
     }
 }
 
-string communication::start(const std::string &name)
+// The page is requested TSTATUS_CHUNK tasks at a time, the cursor being
+// the number of tasks received. A client that stops early does not ask for
+// the rest
+void communication::status(const status_query &query, const status_sink &out)
 {
-    if (send_req(name, msg_type::REQ_START))
-        return get_reply();
-    return "";
+    status_renderer renderer(query.json);
+    uint64_t cursor = 0, count = 0;
+    do {
+        wire::writer req(msg_type::REQ_STATUS);
+        wire::write_query(req, query);
+        req.u64(cursor);
+        if (!send_msg(req.finish())) return;
+        zmq::message_t reply;
+        recv(&reply);
+        wire::reader msg(reply.data(), reply.size());
+        if (msg.type() == msg_type::REP_ERR) throw runtime_error("daemon: " + msg.str());
+        if (msg.type() != msg_type::REP_STATUS)
+            throw runtime_error("recived incorrect message");
+        status_report part;
+        wire::read_status(msg, part);
+        // The first reply holds the summary of the whole page
+        if (!cursor) count = part.count;
+        cursor += part.tasks.size();
+        if (!out(renderer.render(part))) return;
+        // Tasks removed meanwhile end the page early
+        if (part.tasks.empty()) break;
+    } while (cursor < count);
+    out(renderer.finish());
 }
 
-string communication::stop(const std::string &name)
+string communication::reload_config(const std::string &file)
 {
-    if (send_req(name, msg_type::REQ_STOP))
-        return get_reply();
-    return "";
+    return run_job(job_kind::RELOAD_CONFIG, file);
 }
 
-string communication::restart(const std::string &name)
+string communication::plan_reload(const std::string &file)
 {
-    if (send_req(name, msg_type::REQ_RESTART))
+    if (send_req(file, msg_type::REQ_PLAN_RELOAD))
         return get_reply();
     return "";
 }
 
-string communication::status(const std::string &name)
+string communication::exit()
 {
-    if (send_req(name, msg_type::REQ_STATUS))
+    if (send_req("", msg_type::REQ_EXIT))
         return get_reply();
     return "";
 }
 
-string communication::reload_config(const std::string &file)
+string communication::tail(const string &name, vector<uint64_t> &cursors,
+                           size_t backlog)
 {
-    if (send_req(file, msg_type::REQ_RELOAD_CONFIG))
-        return get_reply();
-    return "";
+    wire::writer req(msg_type::REQ_TAIL);
+    req.str(name).u64(backlog).u32(cursors.size());
+    for (auto cursor : cursors) req.u64(cursor);
+    if (!send_msg(req.finish())) return "";
+    zmq::message_t reply;
+    recv(&reply);
+    wire::reader msg(reply.data(), reply.size());
+    if (msg.type() == msg_type::REP_ERR) throw runtime_error("daemon: " + msg.str());
+    if (msg.type() != msg_type::REP_TAIL)
+        throw runtime_error("recived incorrect message");
+    cursors.resize(msg.count(8));
+    for (auto &cursor : cursors) cursor = msg.u64();
+    return msg.str();
 }
 
-string communication::exit()
+uint64_t communication::submit(job_kind kind, const vector<string> &targets)
 {
-    if (send_req("", msg_type::REQ_EXIT))
-        return get_reply();
-    return "";
+    static const msg_type requests[] = {
+        msg_type::REQ_START, msg_type::REQ_STOP,
+        msg_type::REQ_RESTART, msg_type::REQ_RELOAD_CONFIG
+    };
+    wire::writer req(requests[static_cast<int>(kind)]);
+    req.u32(targets.size());
+    for (auto &target : targets) req.str(target);
+    if (!send_msg(req.finish())) return 0;
+    zmq::message_t reply;
+    recv(&reply);
+    wire::reader msg(reply.data(), reply.size());
+    if (msg.type() == msg_type::REP_ERR) throw runtime_error("daemon: " + msg.str());
+    if (msg.type() != msg_type::REP_JOB)
+        throw runtime_error("recived incorrect message");
+    return msg.u64();
 }
 
-string communication::get_reply()
+job_info communication::job(uint64_t id, bool wait)
 {
+    job_info info;
+    wire::writer req(msg_type::REQ_JOB);
+    req.u64(id).u8(wait);
+    if (!send_msg(req.finish())) return info;
     zmq::message_t reply;
     recv(&reply);
-    if (reply.size() < sizeof (msg_hdr)) {
-        return "error: recived incorrect message";
-    }
+    wire::reader msg(reply.data(), reply.size());
+    if (msg.type() == msg_type::REP_ERR) throw runtime_error("daemon: " + msg.str());
+    if (msg.type() != msg_type::REP_JOB_STATE)
+        throw runtime_error("recived incorrect message");
+    info.id = msg.u64();
+    uint8_t state = msg.u8();
+    if (state > job_info::FAILED) throw runtime_error("recived incorrect message");
+    info.state = static_cast<decltype(info.state)>(state);
+    info.result = msg.str();
+    return info;
+}
+
+string communication::run_job(job_kind kind, const string &name)
+{
+    uint64_t id = submit(kind, {name});
+    if (!id) return "";
+    return "daemon: " + job(id, true).result;
+}
 
-    msg_hdr *msg = static_cast<msg_hdr *>(reply.data());
-    if (msg->type == msg_type::REP_REP || msg->type == msg_type::REP_ERR)
-        return string("daemon: ") + msg->data;
-    else
-        return "error: recived incorrect message";
+// The topic ends with a zero byte, so a subscription to one task does not
+// match the tasks its name is a prefix of
+void communication::publish(const task_event &event)
+{
+    string topic = event.task + '\0';
+    wire::writer msg(msg_type::EVENT);
+    wire::write_event(msg, event);
+    // A slow subscriber loses events instead of blocking the daemon
+    publisher->send(topic.data(), topic.size(), ZMQ_SNDMORE | ZMQ_DONTWAIT);
+    publisher->send(msg.finish(), ZMQ_DONTWAIT);
 }
 
-std::unique_ptr<communication::msg_hdr, void(*)(communication::msg_hdr*)>
-communication::get_raw_msg(size_t content_size)
+void communication::events(const string &name, const event_sink &out)
 {
-    size_t msg_len = sizeof(msg_hdr) + content_size;
-    auto deleter = [](msg_hdr *p) {delete [] reinterpret_cast<char *>(p);};
-    unique_ptr<msg_hdr, decltype (deleter)>
-            raw_msg(reinterpret_cast<msg_hdr *>(new char[msg_len]), deleter);
-    msg_hdr *msg = reinterpret_cast<msg_hdr *>(raw_msg.get());
-    msg->total_len = msg_len;
-    return raw_msg;
+    zmq::socket_t subscriber(*this, ZMQ_SUB);
+    subscriber.setsockopt(ZMQ_RCVTIMEO, TEVENTS_POLL_MS);
+    subscriber.setsockopt(ZMQ_LINGER, 0);
+    string topic = name.empty() ? "" : name + '\0';
+    subscriber.setsockopt(ZMQ_SUBSCRIBE, topic.data(), topic.size());
+    subscriber.connect(events_address);
+    for (bool reading = true; reading;) {
+        zmq::message_t frame;
+        if (!subscriber.recv(&frame)) {
+            reading = out(nullptr);
+            continue;
+        }
+        // The event follows its topic
+        if (!frame.more() || !subscriber.recv(&frame)) continue;
+        try {
+            wire::reader msg(frame.data(), frame.size());
+            if (msg.type() != msg_type::EVENT) continue;
+            task_event event;
+            wire::read_event(msg, event);
+            reading = out(&event);
+        } catch (const exception &e) {
+            cerr << "error: recived incorrect event: " << e.what() << endl;
+        }
+    }
+}
+
+string communication::get_reply()
+{
+    zmq::message_t reply;
+    recv(&reply);
+    try {
+        wire::reader msg(reply.data(), reply.size());
+        if (msg.type() == msg_type::REP_TEXT || msg.type() == msg_type::REP_ERR)
+            return "daemon: " + msg.str();
+    } catch (const exception &e) {
+        return string("error: recived incorrect message: ") + e.what();
+    }
+    return "error: recived incorrect message";
 }
 
-size_t communication::send_msg(msg_hdr *msg)
+size_t communication::send_msg(zmq::message_t &&msg)
 {
     if (connected) {
-        return send(msg, msg->total_len, ZMQ_DONTWAIT);
+        size_t size = msg.size();
+        return send(msg, ZMQ_DONTWAIT) ? size : 0;
     } else {
         cout << "No connection to the daemon." << endl <<
                 "Run 'taskmaster --daemon' in the terminal "
@@ -154,26 +362,37 @@ size_t communication::send_msg(msg_hdr *msg)
 
 size_t communication::send_str(const string &str, msg_type type)
 {
-    auto raw_msg = get_raw_msg(str.size() + 1);
-    msg_hdr *msg = raw_msg.get();
-
-    msg->type = type;
-    strcpy(msg->data, str.c_str());
-    return send_msg(msg);
+    wire::writer msg(type);
+    msg.str(str);
+    return send_msg(msg.finish());
 }
 
 size_t communication::send_req(const string &name, msg_type req)
 {
-    if (req < msg_type::MIN_REQ || req > msg_type::MAX_REQ)
-        throw runtime_error("fatal error");
+    if (!wire::is_request(req)) throw runtime_error("fatal error");
     return send_str(name, req);
 }
 
+size_t communication::send_reply(const string &client, zmq::message_t &&frame,
+                                 bool more)
+{
+    // A client that is gone or too slow drops its reply, ROUTER never blocks
+    if (!routed) {
+        zmq::message_t identity(client.data(), client.size()), delimiter;
+        send(identity, ZMQ_SNDMORE);
+        send(delimiter, ZMQ_SNDMORE);
+    }
+    routed = more;
+    size_t size = frame.size();
+    return send(frame, more ? ZMQ_SNDMORE : 0) ? size : 0;
+}
+
 size_t communication::send_rep(const string &str, msg_type rep)
 {
-    if (rep < msg_type::MIN_REP || rep > msg_type::MAX_REP)
-        throw runtime_error("fatal error");
-    return send_str(str, rep);
+    if (!wire::is_reply(rep)) throw runtime_error("fatal error");
+    wire::writer msg(rep);
+    msg.str(str);
+    return send_reply(reply_to, msg.finish());
 }
 
 void communication::monitor_init()
@@ -204,46 +423,70 @@ void communication::on_event_disconnected(const zmq_event_t &, const char*)
     connected = false;
 }
 
-void communication::rep_start(const std::string &name)
+void communication::rep_submit(job_kind kind, wire::reader &args)
 {
+    vector<string> targets(args.count(4));
+    for (auto &target : targets) target = args.str();
     try {
-        send_rep(master->start(name), msg_type::REP_REP);
+        wire::writer msg(msg_type::REP_JOB);
+        msg.u64(master->submit(kind, targets));
+        send_reply(reply_to, msg.finish());
     } catch (const exception &e) {
-        send_rep(name + ": error: " + e.what(), msg_type::REP_ERR);
+        send_rep(e.what(), msg_type::REP_ERR);
     }
 }
 
-void communication::rep_stop(const std::string &name)
-{
-    try {
-        send_rep(master->stop(name), msg_type::REP_REP);
-    } catch (const exception &e) {
-        send_rep(name + ": error: " + e.what(), msg_type::REP_ERR);
-    }
-}
-
-void communication::rep_restart(const std::string &name)
+// A waiting client gets its reply from the event loop once the job is over,
+// the other clients are served meanwhile
+void communication::rep_job(wire::reader &args)
 {
+    uint64_t id = args.u64();
+    bool wait = args.u8();
+    auto reply = [this, client = reply_to](const job_info &info) {
+        wire::writer msg(msg_type::REP_JOB_STATE);
+        msg.u64(info.id).u8(info.state).str(info.result);
+        send_reply(client, msg.finish());
+        wake_up();
+    };
     try {
-        send_rep(master->restart(name), msg_type::REP_REP);
+        if (!wait) reply(master->job(id, false));
+        else if (!master->on_job_done(id, reply)) throw runtime_error("no such job");
     } catch (const exception &e) {
-        send_rep(name + ": error: " + e.what(), msg_type::REP_ERR);
+        send_rep(e.what(), msg_type::REP_ERR);
     }
 }
 
-void communication::rep_status(const std::string &name)
+// Replies the summary of the rest of the page after cursor and at most
+// TSTATUS_CHUNK of its tasks, the daemon never holds more
+void communication::rep_status(wire::reader &args)
 {
+    status_query query;
+    wire::read_query(args, query);
+    uint64_t cursor = args.u64();
     try {
-        send_rep(master->status(name), msg_type::REP_REP);
+        if (query.limit && cursor >= query.limit)
+            throw runtime_error("cursor past the page");
+        query.offset += cursor;
+        if (query.limit) query.limit -= cursor;
+        status_report reply;
+        bool summary = true;
+        // The second part holds the first tasks, the summary is the same
+        master->report(query, TSTATUS_CHUNK, [&reply, &summary](const status_report &part) {
+            reply = part;
+            return exchange(summary, false);
+        });
+        wire::writer msg(msg_type::REP_STATUS);
+        wire::write_status(msg, reply);
+        send_reply(reply_to, msg.finish());
     } catch (const exception &e) {
-        send_rep(name + ": error: " + e.what(), msg_type::REP_ERR);
+        send_rep(query.pattern + ": error: " + e.what(), msg_type::REP_ERR);
     }
 }
 
-void communication::rep_reload_config(const std::string &file)
+void communication::rep_plan_reload(const std::string &file)
 {
     try {
-        send_rep(master->reload_config(file), msg_type::REP_REP);
+        send_rep(master->plan_reload(file), msg_type::REP_TEXT);
     } catch (const exception &e) {
         send_rep(file + ": error: " + e.what(), msg_type::REP_ERR);
     }
@@ -251,6 +494,24 @@ void communication::rep_reload_config(const std::string &file)
 
 void communication::rep_exit()
 {
-    send_rep("goodbye", msg_type::REP_REP);
+    send_rep("goodbye", msg_type::REP_TEXT);
     master->exit();
 }
+
+void communication::rep_tail(wire::reader &args)
+{
+    string name = args.str();
+    size_t backlog = args.u64();
+    vector<uint64_t> cursors(args.count(8));
+    for (auto &cursor : cursors) cursor = args.u64();
+    try {
+        string output = master->tail(name, cursors, backlog);
+        wire::writer msg(msg_type::REP_TAIL);
+        msg.u32(cursors.size());
+        for (auto cursor : cursors) msg.u64(cursor);
+        msg.str(output);
+        send_reply(reply_to, msg.finish());
+    } catch (const exception &e) {
+        send_rep(name + ": error: " + e.what(), msg_type::REP_ERR);
+    }
+}
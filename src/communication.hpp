@@ -12,55 +12,50 @@
 
 #include "master.hpp"
 #include "taskmaster.hpp"
+#include "reactor.hpp"
+#include "protocol.hpp"
 
 constexpr unsigned int TDAEMON_PORT = 4242;
+constexpr unsigned int TEVENTS_PORT_OFFSET = 1;  // The PUB socket follows the port
 constexpr int          TCLI_SNDTIMEO = 0;
 constexpr int          TCLI_RCVTIMEO = 1000;
 
 class communication : public master, private zmq::context_t, zmq::socket_t, zmq::monitor_t
 {
-private:
-    enum class msg_type : int {
-        MIN_REQ = 0,
-        REQ_START = MIN_REQ,
-        REQ_STOP,
-        REQ_RESTART,
-        REQ_STATUS,
-        REQ_RELOAD_CONFIG,
-        REQ_EXIT,
-        MAX_REQ = REQ_EXIT,
-        MIN_REP,
-        REP_REP = MIN_REP,
-        REP_ERR,
-        MAX_REP = REP_ERR
-    };
-    struct msg_hdr {
-        msg_type type;
-        std::size_t total_len;
-        char data[0];
-    } __attribute__((packed));
 public:
     communication(taskmaster *master_p,
                   unsigned int port = TDAEMON_PORT,
                   const std::string address = "localhost");
     ~communication();
-    void run_master();
+    // The loop must outlive the master and this object
+    void run_master(reactor &event_loop);
 
-    virtual std::string start(const std::string &name);
-    virtual std::string stop(const std::string &name);
-    virtual std::string restart(const std::string &name);
-    // An empty name returns the status of all programs
-    virtual std::string status(const std::string &name);
+    // The page is read one request per TSTATUS_CHUNK tasks, each chunk is
+    // rendered as it comes
+    virtual void status(const status_query &query, const status_sink &out);
     // An empty name uses old config
     virtual std::string reload_config(const std::string &file);
+    virtual std::string plan_reload(const std::string &file);
     virtual std::string exit();
+    // Pulls one chunk per call, a slow client only delays its own cursors
+    virtual std::string tail(const std::string &name,
+                             std::vector<std::uint64_t> &cursors,
+                             std::size_t backlog);
+    // Returns 0 if the request was not sent
+    virtual std::uint64_t submit(job_kind kind,
+                                 const std::vector<std::string> &targets);
+    // The daemon defers the reply of wait until the job is over
+    virtual job_info job(std::uint64_t id, bool wait);
+    // Subscribes to the PUB socket of the daemon, a lost event shows as a
+    // gap in the sequence numbers
+    virtual void events(const std::string &name, const event_sink &out);
 private:
-    std::unique_ptr<msg_hdr, void(*)(msg_hdr *)>
-    get_raw_msg(std::size_t content_size);
-    size_t send_msg(msg_hdr *msg);
+    using msg_type = wire::msg_type;
+    size_t send_msg(zmq::message_t &&msg);
     size_t send_str(const std::string &str, msg_type type);
 
     // Cli members
+    std::string events_address;
     std::atomic_bool connected = false;
     std::thread monitor_thread;
     std::mutex  monitor_mutex;
@@ -70,16 +65,39 @@ private:
     virtual void on_event_disconnected(const zmq_event_t &event_, const char* addr_);
     size_t send_req(const std::string &name, msg_type req);
     std::string get_reply();
+    // Submits a job and waits for it
+    std::string run_job(job_kind kind, const std::string &name);
 
-    // Master members
+    // Master members, the socket is a ROUTER so any number of clients
+    // may wait for a reply at once
     taskmaster *master = nullptr;
+    reactor *loop = nullptr;
+    int requests_fd = -1;                    // ZMQ_FD while it is in the loop
+    int wakeup_fd = -1;                      // Reads requests after a late reply
+    struct client_request
+    {
+        std::string client;                  // Routing identity
+        zmq::message_t request;
+    };
+    std::unique_ptr<zmq::socket_t> publisher; // Events, topic is the task name
+    std::uint64_t events_listener = 0;
+    void publish(const task_event &event);
+    std::string reply_to;                    // Client of the current request
+    bool routed = false;                     // The envelope of a reply was sent
+    void on_requests();
+    void wake_up();
+    bool recv_request(client_request &req);
+    void handle_request(client_request &req);
+    // Sends the envelope of client before the first frame of a reply
+    size_t send_reply(const std::string &client, zmq::message_t &&frame,
+                      bool more = false);
     size_t send_rep(const std::string &str, msg_type rep);
-    void rep_start(const std::string &name);
-    void rep_stop(const std::string &name);
-    void rep_restart(const std::string &name);
-    void rep_status(const std::string &name);
-    void rep_reload_config(const std::string &file);
+    void rep_submit(job_kind kind, wire::reader &args);
+    void rep_job(wire::reader &args);
+    void rep_status(wire::reader &args);
+    void rep_plan_reload(const std::string &file);
     void rep_exit();
+    void rep_tail(wire::reader &args);
 };
 
 #endif // COMM_HPP
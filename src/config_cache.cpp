@@ -0,0 +1,355 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "config_cache.hpp"
+
+using namespace std;
+
+constexpr char config_cache::MAGIC[4];
+
+namespace {
+
+// Fields are written and read by the same *_fields() functions, so the
+// two cannot disagree on the layout
+class encoder
+{
+public:
+    string buf;
+    void raw(const void *data, size_t size)
+    {buf.append(static_cast<const char *>(data), size);}
+    template<typename T>
+    typename enable_if<is_arithmetic<T>::value || is_enum<T>::value>::type
+    operator()(const T &value) {raw(&value, sizeof(value));}
+    void operator()(const string &value)
+    {
+        (*this)(static_cast<uint32_t>(value.size()));
+        raw(value.data(), value.size());
+    }
+    template<typename A, typename B>
+    void operator()(const pair<A, B> &value)
+    {
+        (*this)(value.first);
+        (*this)(value.second);
+    }
+    void operator()(const rlimit &value)
+    {
+        (*this)(value.rlim_cur);
+        (*this)(value.rlim_max);
+    }
+    template<typename T>
+    void operator()(const vector<T> &values)
+    {
+        (*this)(static_cast<uint32_t>(values.size()));
+        for (auto &value : values) (*this)(value);
+    }
+};
+
+class decoder
+{
+public:
+    decoder(const char *data, size_t size) : pos(data), end(data + size) {}
+    bool at_end() const {return pos == end;}
+    void raw(void *data, size_t size)
+    {
+        if (size > size_t(end - pos)) throw runtime_error("truncated file");
+        memcpy(data, pos, size);
+        pos += size;
+    }
+    template<typename T>
+    typename enable_if<is_arithmetic<T>::value || is_enum<T>::value>::type
+    operator()(T &value) {raw(&value, sizeof(value));}
+    void operator()(string &value)
+    {
+        uint32_t size;
+        (*this)(size);
+        if (size > size_t(end - pos)) throw runtime_error("truncated file");
+        value.assign(pos, size);
+        pos += size;
+    }
+    template<typename A, typename B>
+    void operator()(pair<A, B> &value)
+    {
+        (*this)(value.first);
+        (*this)(value.second);
+    }
+    void operator()(rlimit &value)
+    {
+        (*this)(value.rlim_cur);
+        (*this)(value.rlim_max);
+    }
+    template<typename T>
+    void operator()(vector<T> &values)
+    {
+        uint32_t size;
+        (*this)(size);
+        // Every element takes at least a byte
+        if (size > size_t(end - pos)) throw runtime_error("truncated file");
+        values.resize(size);
+        for (auto &value : values) (*this)(value);
+    }
+private:
+    const char *pos;
+    const char *end;
+};
+
+// A file read by the config
+struct source
+{
+    string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;                       // Nanoseconds
+    uint64_t hash = 0;
+};
+
+}
+
+template<typename C, typename IO>
+static void _master_fields(C &c, IO &io)
+{
+    io(c.spawn_workers);
+    io(c.spawn_rate);
+    io(c.max_starting);
+    io(c.sample_interval);
+    io(c.include);
+    io(c.include_files);
+    io(c.watch);
+    io(c.watch_delay);
+    io(c.max_probes);
+}
+
+template<typename P, typename IO>
+static void _probe_fields(P &p, IO &io)
+{
+    io(p.kind);
+    io(p.target);
+    io(p.delay);
+    io(p.interval);
+    io(p.timeout);
+    io(p.failures);
+}
+
+template<typename C, typename IO>
+static void _task_fields(C &c, IO &io)
+{
+    io(c.name);
+    io(c.bin);
+    io(c.args);
+    io(c.envs);
+    io(c.numprocs);
+    io(c.mask);
+    io(c.workdir);
+    io(c.autostart);
+    io(c.autorestart);
+    io(c.exitcodes);
+    io(c.startretries);
+    io(c.startsecs);
+    io(c.stopsignal);
+    io(c.stopsecs);
+    io(c.stdin_file);
+    io(c.stdout_file);
+    io(c.stderr_file);
+    io(c.zygote);
+    io(c.capture);
+    io(c.maxbytes);
+    io(c.backups);
+    io(c.prefix);
+    io(c.tailbytes);
+    io(c.cgroup_mode);
+    io(c.cgroup_limits);
+    io(c.max_rss);
+    io(c.max_cpu);
+    io(c.max_cpu_secs);
+    io(c.max_fds);
+    io(c.watchdog_action);
+    io(c.watchdog_signal);
+    io(c.affinity);
+    io(c.cpu_lists);
+    io(c.sched.set_nice);
+    io(c.sched.nice);
+    io(c.sched.ioprio);
+    io(c.sched.policy);
+    io(c.sched.priority);
+    io(c.sched.rlimits);
+    io(c.backoff_initial);
+    io(c.backoff_multiplier);
+    io(c.backoff_max);
+    io(c.backoff_jitter);
+    io(c.crashloop_exits);
+    io(c.crashloop_window);
+    io(c.crashloop_action);
+    io(c.groups);
+    io(c.depends_on);
+    _probe_fields(c.readiness, io);
+    _probe_fields(c.liveness, io);
+}
+
+template<typename S, typename IO>
+static void _source_fields(S &s, IO &io)
+{
+    io(s.path);
+    io(s.size);
+    io(s.mtime);
+    io(s.hash);
+}
+
+// FNV-1a of the content, false if the file cannot be read
+static bool _hash_file(const string &path, uint64_t &hash)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    hash = 14695981039346656037ULL;
+    unsigned char buf[64 * 1024];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        for (ssize_t i = 0; i < n; i++) hash = (hash ^ buf[i]) * 1099511628211ULL;
+    close(fd);
+    return n == 0;
+}
+
+static bool _stat_file(const string &path, source &s)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st)) return false;
+    s.path = path;
+    s.size = st.st_size;
+    s.mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+// The size and mtime are enough unless one of them changed
+static bool _is_fresh(const source &s)
+{
+    source now;
+    if (!_stat_file(s.path, now)) return false;
+    if (now.size != s.size) return false;
+    if (now.mtime == s.mtime) return true;
+    return _hash_file(s.path, now.hash) && now.hash == s.hash;
+}
+
+bool config_cache::load(const string &file, vector<task_config> &tconfs,
+                        master_config &mconf) const
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno == ENOENT) return false;
+        throw runtime_error(path + ": " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+        int err = errno;
+        close(fd);
+        throw runtime_error(path + ": " + strerror(err));
+    }
+    if (st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        close(fd);
+        throw runtime_error(path + ": not owned by the daemon's user or "
+                            "writable by others");
+    }
+    void *data = st.st_size ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                            : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED) throw runtime_error(path + ": cannot be mapped");
+    try {
+        decoder in(static_cast<const char *>(data), st.st_size);
+        char magic[sizeof(MAGIC)];
+        uint32_t version, config_size;
+        in.raw(magic, sizeof(magic));
+        in(version);
+        in(config_size);
+        // Another build wrote it, it is replaced by the next save
+        if (memcmp(magic, MAGIC, sizeof(MAGIC)) || version != VERSION ||
+            config_size != sizeof(task_config)) {
+            munmap(data, st.st_size);
+            return false;
+        }
+        string cached_file;
+        in(cached_file);
+        uint32_t count;
+        in(count);
+        if (count > size_t(st.st_size)) throw runtime_error("truncated file");
+        vector<source> sources(count);
+        for (auto &s : sources) _source_fields(s, in);
+        bool fresh = cached_file == file;
+        for (size_t i = 0; fresh && i < sources.size(); i++)
+            fresh = _is_fresh(sources[i]);
+        master_config m;
+        vector<task_config> t;
+        if (fresh) {
+            _master_fields(m, in);
+            // The include directory must hold the same files
+            fresh = m.include.empty() || list_config_dir(m.include) == m.include_files;
+        }
+        if (fresh) {
+            in(count);
+            if (count > size_t(st.st_size)) throw runtime_error("truncated file");
+            t.resize(count);
+            for (auto &c : t) _task_fields(c, in);
+            if (!in.at_end()) throw runtime_error("trailing bytes");
+            tconfs = move(t);
+            mconf = move(m);
+        }
+        munmap(data, st.st_size);
+        return fresh;
+    } catch (const exception &e) {
+        munmap(data, st.st_size);
+        throw runtime_error(path + ": " + e.what());
+    }
+}
+
+void config_cache::save(const string &file, const vector<task_config> &tconfs,
+                        const master_config &mconf,
+                        chrono::system_clock::time_point begin) const
+{
+    int64_t since = chrono::duration_cast<chrono::nanoseconds>(
+                begin.time_since_epoch()).count();
+    vector<string> paths = {file};
+    paths.insert(paths.end(), mconf.include_files.begin(), mconf.include_files.end());
+    vector<source> sources(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        auto &s = sources[i];
+        if (!_stat_file(paths[i], s) || !_hash_file(s.path, s.hash))
+            throw runtime_error(paths[i] + ": " + strerror(errno));
+        // What was parsed may not be what is hashed now
+        if (s.mtime >= since) return;
+    }
+    if (!mconf.include.empty()) {
+        source dir;
+        if (_stat_file(mconf.include, dir) && dir.mtime >= since) return;
+    }
+
+    encoder out;
+    out.raw(MAGIC, sizeof(MAGIC));
+    out(VERSION);
+    out(static_cast<uint32_t>(sizeof(task_config)));
+    out(file);
+    out(static_cast<uint32_t>(sources.size()));
+    for (auto &s : sources) _source_fields(s, out);
+    _master_fields(mconf, out);
+    out(static_cast<uint32_t>(tconfs.size()));
+    for (auto &c : tconfs) _task_fields(c, out);
+
+    // Readers see the old cache or the new one, never a partial file
+    string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) throw runtime_error(tmp + ": " + strerror(errno));
+    bool ok = true;
+    for (size_t done = 0; ok && done < out.buf.size();) {
+        ssize_t n = write(fd, out.buf.data() + done, out.buf.size() - done);
+        if (n == -1 && errno == EINTR) continue;
+        ok = n != -1;
+        done += n;
+    }
+    if (close(fd)) ok = false;
+    if (!ok || rename(tmp.c_str(), path.c_str())) {
+        int err = errno;
+        unlink(tmp.c_str());
+        throw runtime_error(path + ": " + strerror(err));
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef CONFIG_CACHE_HPP
+#define CONFIG_CACHE_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "task.hpp"
+
+/*
+ * Binary copy of a parsed config, so a restarted daemon starts its tasks
+ * without building yaml-cpp trees. The file holds
+ *   magic, u32 version, u32 size of a task_config
+ *   the config file, then path, size, mtime and FNV-1a hash of every
+ *   file read: the config file and its included files
+ *   master_config, a u32 count and the task_configs
+ * in host byte order, a string being a u32 length and its bytes.
+ * A cache is stale once a file changed or the include directory holds
+ * other files. It is only read if the daemon's user owns it and nobody
+ * else can write it, it would run any program otherwise.
+ */
+class config_cache
+{
+public:
+    explicit config_cache(const std::string &path = "") : path(path) {}
+    bool enabled() const {return !path.empty();}
+    const std::string &get_path() const {return path;}
+    // Fills tconfs and mconf from the cache of file. Returns false if there
+    // is none or it is stale, throws if it is corrupt or not trusted
+    bool load(const std::string &file, std::vector<task_config> &tconfs,
+              master_config &mconf) const;
+    // Replaces the cache with the configs parsed from file since begin.
+    // Nothing is written if a file changed while it was parsed. Throws if
+    // the cache cannot be written
+    void save(const std::string &file, const std::vector<task_config> &tconfs,
+              const master_config &mconf,
+              std::chrono::system_clock::time_point begin) const;
+private:
+    static constexpr char MAGIC[4] = {'T', 'M', 'C', 'C'};
+    static constexpr std::uint32_t VERSION = 3;
+    std::string path;
+};
+
+#endif // CONFIG_CACHE_HPP
@@ -5,4 +5,53 @@
 
 static const std::string TDEFAULT_CONFIG_PATH = "/etc/taskmaster.yaml";
 
+// Zygote mode: how long to wait for the template to initialize and for a replica
+static constexpr int TZYGOTE_READY_TIMEOUT_MS = 60000;
+static constexpr int TZYGOTE_REPLY_TIMEOUT_MS = 5000;
+
+// Output capture: pipe buffer of a replica, bytes per write and per wakeup
+static constexpr int TLOG_PIPE_SIZE = 256 * 1024;
+static constexpr std::size_t TLOG_CHUNK_SIZE = 64 * 1024;
+static constexpr std::size_t TLOG_DRAIN_LIMIT = 1024 * 1024;
+static constexpr int TLOG_EVENTS = 64;
+
+// tail and attach: bytes per reply, history shown by tail, follow interval
+static constexpr std::size_t TTAIL_CHUNK_SIZE = 64 * 1024;
+static constexpr std::size_t TTAIL_BACKLOG = 4 * 1024;
+static constexpr int TTAIL_POLL_MS = 200;
+
+// status: tasks per reply, a page takes a request per chunk
+static constexpr std::size_t TSTATUS_CHUNK = 64;
+
+// events: longest wait for an event before the CLI checks for Enter
+static constexpr int TEVENTS_POLL_MS = 200;
+
+// Jobs: finished jobs kept for polling
+static constexpr std::size_t TJOB_HISTORY = 256;
+
+// Config watcher: seconds without a change before the files are reloaded
+static constexpr double TWATCH_DELAY = 1;
+
+// cgroups: leaf of the daemon in its delegated cgroup, prefix of task groups
+static const std::string TCGROUP_DAEMON_LEAF = "taskmaster";
+static const std::string TCGROUP_TASK_PREFIX = "task-";
+
+// Resource sampling: default interval, samples in the moving averages
+static constexpr double TSAMPLE_INTERVAL = 5;
+static constexpr int TSAMPLE_WINDOW = 12;
+
+// Restarts: first delay and cap in seconds, growth, random share of a delay
+static constexpr double TBACKOFF_INITIAL = 1;
+static constexpr double TBACKOFF_MULTIPLIER = 2;
+static constexpr double TBACKOFF_MAX = 60;
+static constexpr double TBACKOFF_JITTER = 0.2;
+
+// Probes: seconds between and per probe, liveness failures before a restart,
+// probes in flight, connects completed per wakeup
+static constexpr double TPROBE_INTERVAL = 1;
+static constexpr double TPROBE_TIMEOUT = 1;
+static constexpr unsigned TPROBE_FAILURES = 3;
+static constexpr std::size_t TPROBE_MAX_RUNNING = 256;
+static constexpr int TPROBE_EVENTS = 64;
+
 #endif
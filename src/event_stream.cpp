@@ -0,0 +1,31 @@
+#include <algorithm>
+#include <chrono>
+
+#include "event_stream.hpp"
+
+using namespace std;
+
+uint64_t event_stream::subscribe(listener func)
+{
+    listeners.emplace_back(++last_id, move(func));
+    return last_id;
+}
+
+void event_stream::unsubscribe(uint64_t id)
+{
+    auto gone = remove_if(listeners.begin(), listeners.end(),
+                          [id](const pair<uint64_t, listener> &l) {return l.first == id;});
+    listeners.erase(gone, listeners.end());
+}
+
+void event_stream::publish(task_event &event)
+{
+    event.seq = ++seq;
+    event.task_seq = ++task_seqs[event.task];
+    event.time_us = chrono::duration_cast<chrono::microseconds>(
+                chrono::system_clock::now().time_since_epoch()).count();
+    if (listeners.empty()) return;
+    // A listener may unsubscribe while it is called
+    auto current = listeners;
+    for (auto &l : current) l.second(event);
+}
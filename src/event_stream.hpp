@@ -0,0 +1,63 @@
+#ifndef EVENT_STREAM_HPP
+#define EVENT_STREAM_HPP
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A state transition of a task or one of its processes
+struct task_event
+{
+    enum kind_t : std::uint8_t {
+        TASK_STATE,                          // state is the new task_status
+        PROC_SPAWN,
+        PROC_EXIT,                           // code is the exit code
+        PROC_SIGNAL                          // code is the terminating signal
+    } kind = TASK_STATE;
+    std::uint64_t seq = 0;                   // Of all events, from 1
+    std::uint64_t task_seq = 0;              // Of the events of the task
+    std::int64_t time_us = 0;                // Wall clock of the transition
+    std::string task;
+    int state = 0;
+    std::uint32_t replica = 0;
+    pid_t pid = 0;
+    int code = 0;
+    time_t starttime = 0;                    // Of the process
+};
+
+// Receives the events, and nullptr after each wait of at most
+// TEVENTS_POLL_MS so the caller may stop. Returns false to stop
+using event_sink = std::function<bool(const task_event *event)>;
+
+/*
+ * Numbers the events and hands them to the listeners on the event loop.
+ * Subscribers detect lost events by a gap in the sequence numbers, seq if
+ * they follow every task and task_seq if they follow one.
+ */
+class event_stream
+{
+public:
+    using listener = std::function<void(const task_event &event)>;
+
+    event_stream() = default;
+    event_stream(const event_stream &) = delete;
+    event_stream& operator=(const event_stream &) = delete;
+
+    // Returns an id for unsubscribe()
+    std::uint64_t subscribe(listener func);
+    void unsubscribe(std::uint64_t id);
+    // Sets the sequence numbers and the time
+    void publish(task_event &event);
+private:
+    std::uint64_t seq = 0;
+    std::unordered_map<std::string, std::uint64_t> task_seqs;
+    std::uint64_t last_id = 0;
+    std::vector<std::pair<std::uint64_t, listener>> listeners;
+};
+
+#endif // EVENT_STREAM_HPP
@@ -0,0 +1,82 @@
+#include "launch_spec.hpp"
+
+using namespace std;
+using namespace proc;
+
+string_table &string_table::instance()
+{
+    static string_table table;
+    return table;
+}
+
+istring string_table::intern(const string &str)
+{
+    lock_guard<mutex> lock(strings_mutex);
+    auto it = strings.find(str);
+    if (it != strings.end())
+        if (auto s = it->second.lock()) return s;
+    auto deleter = [](const string *p) {
+        string_table::instance().release(p);
+        delete p;
+    };
+    istring s(new string(str), deleter);
+    if (it != strings.end()) strings.erase(it);
+    strings.emplace(*s, s);
+    return s;
+}
+
+size_t string_table::size()
+{
+    lock_guard<mutex> lock(strings_mutex);
+    return strings.size();
+}
+
+void string_table::release(const string *str) noexcept
+{
+    lock_guard<mutex> lock(strings_mutex);
+    auto it = strings.find(*str);
+    // The entry may already belong to a newer copy of the string
+    if (it != strings.end() && it->first.data() == str->data())
+        strings.erase(it);
+}
+
+shared_ptr<const launch_spec> launch_spec::create(const params &p)
+{
+    return shared_ptr<const launch_spec>(new launch_spec(p));
+}
+
+launch_spec::launch_spec(const params &p) :
+    stoptime_(p.stoptime), mask_(p.mask), sched_(p.sched)
+{
+    auto &table = string_table::instance();
+    bin_ = table.intern(p.bin);
+    for (auto &arg : p.args) args_.push_back(table.intern(arg));
+    for (auto &env : p.envs) envs_.push_back(table.intern(env));
+    workdir_ = table.intern(p.workdir);
+    stdin_ = table.intern(p.stdin_file);
+    stdout_ = table.intern(p.stdout_file);
+    stderr_ = table.intern(p.stderr_file);
+
+    argv_.push_back(bin_->c_str());
+    for (auto &arg : args_) argv_.push_back(arg->c_str());
+    argv_.push_back(nullptr);
+    for (auto &env : envs_) envp_.push_back(env->c_str());
+    envp_.push_back(nullptr);
+}
+
+size_t launch_spec::memory_usage() const
+{
+    auto str_bytes = [](const istring &s) -> size_t {
+        size_t bytes = sizeof(string) + s->capacity() + 1;
+        return bytes / static_cast<size_t>(s.use_count());
+    };
+    size_t bytes = sizeof(*this);
+    bytes += (args_.capacity() + envs_.capacity()) * sizeof(istring);
+    bytes += (argv_.capacity() + envp_.capacity()) * sizeof(const char *);
+    bytes += sched_.rlimits.capacity() * sizeof(sched_.rlimits[0]);
+    for (auto s : {&bin_, &workdir_, &stdin_, &stdout_, &stderr_})
+        bytes += str_bytes(*s);
+    for (auto &s : args_) bytes += str_bytes(s);
+    for (auto &s : envs_) bytes += str_bytes(s);
+    return bytes;
+}
@@ -0,0 +1,97 @@
+#ifndef LAUNCH_SPEC_HPP
+#define LAUNCH_SPEC_HPP
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace proc{
+
+using istring = std::shared_ptr<const std::string>;
+
+// Pool of immutable strings, equal strings share one allocation
+class string_table
+{
+public:
+    static string_table &instance();
+    istring intern(const std::string &str);
+    std::size_t size();
+private:
+    string_table() = default;
+    void release(const std::string *str) noexcept;
+    std::mutex strings_mutex;
+    std::unordered_map<std::string_view, std::weak_ptr<const std::string>> strings;
+};
+
+// Scheduling and limits the child applies to itself before execve()
+struct sched_params
+{
+    bool set_nice = false;
+    int nice = 0;
+    int ioprio = -1;                         // ioprio_set() value, -1 if none
+    int policy = -1;                         // SCHED_* policy, -1 if none
+    int priority = 0;                        // Only for SCHED_FIFO and SCHED_RR
+    std::vector<std::pair<int, rlimit>> rlimits;
+};
+
+// Everything needed to execve() a replica, shared by all replicas of a task
+class launch_spec
+{
+public:
+    struct params {
+        std::string bin;
+        std::vector<std::string> args;
+        std::vector<std::string> envs;
+        std::string workdir = "/";
+        std::string stdin_file = "/dev/null";
+        std::string stdout_file = "/dev/null";
+        std::string stderr_file = "/dev/null";
+        time_t stoptime = 10;
+        mode_t mask = S_IWGRP | S_IWOTH;
+        sched_params sched;
+    };
+    static std::shared_ptr<const launch_spec> create(const params &p);
+
+    launch_spec(const launch_spec &) = delete;
+    launch_spec& operator=(const launch_spec &) = delete;
+
+    const std::string &bin() const {return *bin_;}
+    const std::string &workdir() const {return *workdir_;}
+    const std::string &stdin_file() const {return *stdin_;}
+    const std::string &stdout_file() const {return *stdout_;}
+    const std::string &stderr_file() const {return *stderr_;}
+    time_t stoptime() const {return stoptime_;}
+    mode_t mask() const {return mask_;}
+    const sched_params &sched() const {return sched_;}
+    char *const *argv() const {return const_cast<char *const *>(argv_.data());}
+    char *const *envp() const {return const_cast<char *const *>(envp_.data());}
+
+    // Heap and object bytes owned by the spec, interned strings are counted
+    // in proportion to the number of their owners
+    std::size_t memory_usage() const;
+private:
+    launch_spec(const params &p);
+    istring bin_;
+    std::vector<istring> args_;
+    std::vector<istring> envs_;
+    istring workdir_;
+    istring stdin_;
+    istring stdout_;
+    istring stderr_;
+    time_t stoptime_;
+    mode_t mask_;
+    sched_params sched_;
+    std::vector<const char *> argv_;         // Is used for execve()
+    std::vector<const char *> envp_;         // Is used for execve()
+};
+
+} // namespace proc
+
+#endif // LAUNCH_SPEC_HPP
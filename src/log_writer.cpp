@@ -0,0 +1,283 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log_writer.hpp"
+#include "defaults.hpp"
+
+using namespace std;
+
+// A log file that is only written by the log_writer thread
+class log_file
+{
+public:
+    log_file(const string &path, size_t maxbytes, size_t backups) :
+        path(path), maxbytes(maxbytes), backups(backups) {}
+    ~log_file() {if (fd != -1) close(fd);}
+    log_file(const log_file &) = delete;
+    log_file& operator=(const log_file &) = delete;
+
+    // Moves the content of a pipe into the file, returns like splice().
+    // Fails with EINVAL if the file cannot take a splice
+    ssize_t splice_from(int pipe);
+    // Data is dropped if the file cannot be written
+    void write(const char *data, size_t len);
+    bool can_splice() const {return splicing;}
+private:
+    bool reopen();
+    // Bytes before the next rotation, rotates the file if it is full
+    size_t room();
+    void rotate();
+
+    string path;
+    size_t maxbytes;
+    size_t backups;
+    int fd = -1;
+    bool regular = false;                    // Only regular files are rotated
+    bool splicing = true;
+    off_t size = 0;
+};
+
+ssize_t log_file::splice_from(int pipe)
+{
+    if (fd == -1 && !reopen()) {
+        splicing = false;
+        errno = EINVAL;
+        return -1;
+    }
+    size_t len = room();
+    if (fd == -1) {
+        // The file was rotated but not reopened, the next call tries again
+        // and falls back to reading and dropping the output
+        errno = EINVAL;
+        return -1;
+    }
+    loff_t off = size;
+    ssize_t n = splice(pipe, nullptr, fd, regular ? &off : nullptr, len,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0 && regular) size += n;
+    if (n == -1 && errno == EINVAL) splicing = false;
+    return n;
+}
+
+void log_file::write(const char *data, size_t len)
+{
+    while (len) {
+        if (fd == -1 && !reopen()) return;
+        size_t chunk = min(len, room());
+        ssize_t n = regular ? pwrite(fd, data, chunk, size) : ::write(fd, data, chunk);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return;
+        if (regular) size += n;
+        data += n;
+        len -= n;
+    }
+}
+
+bool log_file::reopen()
+{
+    // Writes go to explicit offsets, O_APPEND would prevent splice()
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | O_NONBLOCK, 0666);
+    if (fd == -1) return false;
+    struct stat st;
+    regular = !fstat(fd, &st) && S_ISREG(st.st_mode);
+    size = regular ? st.st_size : 0;
+    return true;
+}
+
+size_t log_file::room()
+{
+    if (!regular || !maxbytes) return TLOG_CHUNK_SIZE;
+    if (static_cast<size_t>(size) >= maxbytes) rotate();
+    return min(maxbytes - size, TLOG_CHUNK_SIZE);
+}
+
+void log_file::rotate()
+{
+    if (!backups) {
+        if (!ftruncate(fd, 0)) size = 0;
+        return;
+    }
+    for (size_t i = backups - 1; i > 0; --i)
+        rename((path + "." + to_string(i)).c_str(),
+               (path + "." + to_string(i + 1)).c_str());
+    rename(path.c_str(), (path + ".1").c_str());
+    close(fd);
+    fd = -1;
+    if (!reopen()) size = 0;
+}
+
+/*
+ * log_writer
+ */
+
+log_writer::~log_writer()
+{
+    if (!thread.joinable()) return;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    uint64_t one = 1;
+    while (::write(efd, &one, sizeof(one)) == -1 && errno == EINTR);
+    thread.join();
+    for (auto &src : sources) close(src.first);
+    for (auto &src : incoming) close(src->fd);
+    close(epfd);
+    close(efd);
+}
+
+shared_ptr<log_file> log_writer::open(const string &path, size_t maxbytes,
+                                      size_t backups)
+{
+    lock_guard<std::mutex> lock(mutex);
+    for (auto it = files.begin(); it != files.end();) {
+        if (it->second.expired()) it = files.erase(it);
+        else ++it;
+    }
+    auto &weak = files[path];
+    auto file = weak.lock();
+    if (!file) {
+        file = make_shared<log_file>(path, maxbytes, backups);
+        weak = file;
+    }
+    return file;
+}
+
+bool log_writer::open_pipes(const capture &c, size_t replica,
+                            proc::output_fds &fds, int &err)
+{
+    string prefix;
+    if (!c.prefix.empty()) prefix = c.prefix + ":" + to_string(replica) + " ";
+    shared_ptr<output_ring> ring;
+    if (replica < c.rings.size()) ring = c.rings[replica];
+    int out[2], errp[2];
+    if (pipe2(out, O_CLOEXEC)) {
+        err = errno;
+        return false;
+    }
+    fds.out = out[1];
+    fds.err = out[1];
+    // stdout and stderr share a pipe when they go to the same file
+    if (c.err != c.out) {
+        if (pipe2(errp, O_CLOEXEC)) {
+            err = errno;
+            close(out[0]);
+            close(out[1]);
+            fds = {};
+            return false;
+        }
+        fds.err = errp[1];
+        add(errp[0], c.err, prefix, ring);
+    }
+    add(out[0], c.out, move(prefix), move(ring));
+    return true;
+}
+
+/*
+ * Private
+ */
+
+void log_writer::add(int fd, shared_ptr<log_file> out, string prefix,
+                     shared_ptr<output_ring> ring)
+{
+    // A bigger pipe absorbs bursts while the disk is slow
+    fcntl(fd, F_SETPIPE_SZ, TLOG_PIPE_SIZE);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    lock_guard<std::mutex> lock(mutex);
+    if (!thread.joinable()) {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = efd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev);
+        // Signals are handled by the event loop
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        thread = std::thread(&log_writer::run, this);
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    }
+    incoming.push_back(unique_ptr<source>(new source{fd, move(out), move(prefix),
+                                                move(ring)}));
+    uint64_t one = 1;
+    while (::write(efd, &one, sizeof(one)) == -1 && errno == EINTR);
+}
+
+void log_writer::run()
+{
+    epoll_event events[TLOG_EVENTS];
+    for (;;) {
+        int n = epoll_wait(epfd, events, TLOG_EVENTS, -1);
+        if (n == -1 && errno != EINTR) return;
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == efd) {
+                uint64_t count;
+                while (read(efd, &count, sizeof(count)) == -1 && errno == EINTR);
+                lock_guard<std::mutex> lock(mutex);
+                if (quit) return;
+                for (auto &src : incoming) {
+                    epoll_event ev = {};
+                    ev.events = EPOLLIN;
+                    ev.data.fd = src->fd;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, src->fd, &ev);
+                    sources[src->fd] = move(src);
+                }
+                incoming.clear();
+                continue;
+            }
+            auto src = sources.find(fd);
+            if (src == sources.end() || drain(*src->second)) continue;
+            epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            sources.erase(src);
+        }
+    }
+}
+
+bool log_writer::drain(source &src)
+{
+    char buf[TLOG_CHUNK_SIZE];
+    string lines;
+    // A chatty replica yields to the others after a bounded amount of output
+    for (size_t total = 0; total < TLOG_DRAIN_LIMIT;) {
+        ssize_t n;
+        if (src.prefix.empty() && !src.ring && src.out->can_splice()) {
+            n = src.out->splice_from(src.fd);
+            if (n == -1 && errno == EINVAL) continue;
+        } else if ((n = read(src.fd, buf, sizeof(buf))) > 0) {
+            if (src.prefix.empty()) {
+                src.out->write(buf, n);
+                if (src.ring) src.ring->write(buf, n);
+            } else {
+                lines.clear();
+                for (const char *p = buf, *end = buf + n; p < end;) {
+                    if (src.line_start) lines += src.prefix;
+                    auto nl = static_cast<const char *>(memchr(p, '\n', end - p));
+                    const char *next = nl ? nl + 1 : end;
+                    lines.append(p, next);
+                    src.line_start = nl;
+                    p = next;
+                }
+                src.out->write(lines.data(), lines.size());
+                if (src.ring) src.ring->write(lines.data(), lines.size());
+            }
+        }
+        if (n > 0) {
+            total += n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) continue;
+        return n == -1 && errno == EAGAIN;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef LOG_WRITER_HPP
+#define LOG_WRITER_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "process.hpp"
+#include "output_ring.hpp"
+
+class log_file;
+
+/*
+ * Drains the output pipes of the replicas into log files on its own thread,
+ * so a slow disk never blocks the children or the event loop. Output that
+ * is neither prefixed nor kept in a ring is moved with splice(). A file is
+ * rotated before it grows past maxbytes and keeps 'backups' old files as
+ * file.1, file.2...
+ */
+class log_writer
+{
+public:
+    // Output of a task captured through pipes
+    struct capture
+    {
+        std::shared_ptr<log_file> out;
+        std::shared_ptr<log_file> err;
+        std::string prefix;                  // Task name, empty if no prefix
+        // Recent output per replica, empty if it is not kept
+        std::vector<std::shared_ptr<output_ring>> rings;
+    };
+
+    log_writer() = default;
+    ~log_writer();
+    log_writer(const log_writer &) = delete;
+    log_writer& operator=(const log_writer &) = delete;
+
+    // Files are shared by path, the first owner sets the rotation, 0 maxbytes
+    // disables it
+    std::shared_ptr<log_file> open(const std::string &path, std::size_t maxbytes,
+                                   std::size_t backups);
+    // Creates the pipes of a replica and drains them, thread-safe.
+    // The caller closes the write ends in fds once the replica is started
+    bool open_pipes(const capture &c, std::size_t replica, proc::output_fds &fds,
+                    int &err);
+private:
+    struct source
+    {
+        int fd;
+        std::shared_ptr<log_file> out;
+        std::string prefix;                  // Written at the start of a line
+        std::shared_ptr<output_ring> ring;   // Also receives the output
+        bool line_start = true;
+    };
+
+    void add(int fd, std::shared_ptr<log_file> out, std::string prefix,
+             std::shared_ptr<output_ring> ring);
+    void run();
+    // Returns false once the pipe is closed
+    bool drain(source &src);
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<log_file>> files;
+    std::vector<std::unique_ptr<source>> incoming;
+    bool quit = false;
+    int epfd = -1;
+    int efd = -1;                            // Wakes up the thread
+    std::thread thread;
+    // Owned by the thread
+    std::unordered_map<int, std::unique_ptr<source>> sources;
+};
+
+#endif // LOG_WRITER_HPP
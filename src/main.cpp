@@ -13,12 +13,13 @@
 
 //Common defines
 const char *const shortopts = "+hdcp:a:";
-static const std::array<option, 8> longopts {
+static const std::array<option, 9> longopts {
     option({"help", no_argument, nullptr, 'h'}),
     option({"daemon", no_argument, nullptr, 'd'}),
     option({"cli", no_argument, nullptr, 'c'}),
     option({"logfile", required_argument, nullptr, 1}),
     option({"config", required_argument, nullptr, 2}),
+    option({"config-cache", required_argument, nullptr, 3}),
     option({"port", required_argument, nullptr, 'p'}),
     option({"address", required_argument, nullptr, 'a'}),
     option({nullptr, 0, nullptr, 0})
@@ -30,6 +31,7 @@ using namespace proc;
 
 string logfile;
 string conffile;
+string cachefile;
 bool daemon_mode = 0;
 bool client_mode = 0;
 unsigned int port = 4242;
@@ -40,7 +42,8 @@ void usage()
     cerr << "usage: taskmaster [-h] [--logfile log_file] [-d | --daemon]\n"
             "                  [-c | --cli] [-p port | --port=port]\n"
             "                  [-a address | --address=address]\n"
-            "                  [--config=config_file]" << endl;
+            "                  [--config=config_file]\n"
+            "                  [--config-cache=cache_file]" << endl;
 }
 
 void check_daemon()
@@ -73,6 +76,9 @@ int parse_opt(int argc, char **argv)
         case 2:                   // --logfile
             conffile = optarg;
             break;
+        case 3:                   // --config-cache
+            cachefile = optarg;
+            break;
         case 'd':                 // -d, --daemon
             client_mode = 0;
             daemon_mode = 1;
@@ -106,18 +112,23 @@ int main(int  argc, char *argv[])
     try {
         if (daemon_mode) {
             daemonize();
-            taskmaster master(conffile);
+            // The master removes its descriptors from the loop when it is
+            // destroyed
+            reactor loop;
+            taskmaster master(conffile, cachefile);
             communication comm(&master, port);
-            comm.run_master();
+            comm.run_master(loop);
         } else if (client_mode) {
             communication comm(nullptr, port, address);
             cli console(comm);
             console.run();
         } else {
             check_daemon();
-            taskmaster master(conffile);
+            reactor loop;
+            taskmaster master(conffile, cachefile);
+            master.attach(loop);
             cli console(master);
-            console.run();
+            console.run(loop);
         }
     } catch (const exception &e) {
         clog.rdbuf(nullptr);
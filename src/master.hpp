@@ -2,22 +2,56 @@
 #define MASTER_HPP
 
 #include <string>
+#include <vector>
+#include <cstdint>
 
 #include"task.hpp"
 
+// Commands that wait for processes run as jobs
+enum class job_kind : std::uint8_t {
+    START,                                   // Done once no replica is starting
+    STOP,                                    // Done once the replicas are reaped
+    RESTART,                                 // STOP, then START
+    RELOAD_CONFIG
+};
+
+struct job_info
+{
+    std::uint64_t id = 0;
+    enum {RUNNING, DONE, FAILED} state = RUNNING;
+    std::string result;                      // Set once the job is over,
+                                             // one line per task
+};
+
 class master
 {
 public:
     master() = default;
     virtual ~master() = default;
-    virtual std::string start(const std::string &name) = 0;
-    virtual std::string stop(const std::string &name) = 0;
-    virtual std::string restart(const std::string &name) = 0;
-    // An empty name returns the status of all programs
-    virtual std::string status(const std::string &name) = 0;
-    // An empty name uses old config
+    // Streams the status of the tasks matching query to out
+    virtual void status(const status_query &query, const status_sink &out) = 0;
+    // An empty name uses old config. Only the tasks whose config changed
+    // are touched
     virtual std::string reload_config(const std::string &file) = 0;
+    // Returns what reload_config() would do, nothing is changed
+    virtual std::string plan_reload(const std::string &file) = 0;
     virtual std::string exit() = 0;
+    // Returns the captured output after the cursors, one per replica, and
+    // advances them. Empty cursors start 'backlog' bytes before the end
+    virtual std::string tail(const std::string &name,
+                             std::vector<std::uint64_t> &cursors,
+                             std::size_t backlog) = 0;
+    // Starts a command without waiting for it, returns the job id. Targets
+    // are task names, groups, globs or "all", RELOAD_CONFIG takes an
+    // optional file. Throws if a target matches no task
+    virtual std::uint64_t submit(job_kind kind,
+                                 const std::vector<std::string> &targets) = 0;
+    // Returns the job, with wait once it is over. Throws if there is no
+    // such job, finished jobs are forgotten after TJOB_HISTORY newer ones
+    virtual job_info job(std::uint64_t id, bool wait) = 0;
+    // Streams the transitions of a task, of every task if name is empty,
+    // until out returns false
+    virtual void events(const std::string &name, const event_sink &out) = 0;
 };
 
 #endif // MASTER_HPP
@@ -0,0 +1,50 @@
+#include <algorithm>
+#include <cstring>
+
+#include "output_ring.hpp"
+
+using namespace std;
+
+void output_ring::write(const char *data, size_t len)
+{
+    lock_guard<std::mutex> lock(mutex);
+    size_t cap = buf.size();
+    if (!cap) return;
+    total += len;
+    // Only the tail of a write bigger than the ring is kept
+    if (len > cap) {
+        data += len - cap;
+        len = cap;
+    }
+    size_t pos = (total - len) % cap;
+    size_t first = min(len, cap - pos);
+    memcpy(buf.data() + pos, data, first);
+    memcpy(buf.data(), data + first, len - first);
+}
+
+uint64_t output_ring::read(uint64_t &cursor, size_t max, string &out) const
+{
+    lock_guard<std::mutex> lock(mutex);
+    size_t cap = buf.size();
+    uint64_t start = total - min<uint64_t>(total, cap);
+    uint64_t lost = 0;
+    if (cursor < start) {
+        lost = start - cursor;
+        cursor = start;
+    }
+    if (cursor > total) cursor = total;
+    size_t len = min<uint64_t>(total - cursor, max);
+    if (!len) return lost;
+    size_t pos = cursor % cap;
+    size_t first = min(len, cap - pos);
+    out.append(buf.data() + pos, first);
+    out.append(buf.data(), len - first);
+    cursor += len;
+    return lost;
+}
+
+uint64_t output_ring::end() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    return total;
+}
@@ -0,0 +1,36 @@
+#ifndef OUTPUT_RING_HPP
+#define OUTPUT_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Recent output of a replica, written by the log thread and read by the
+ * tail commands. Readers keep a cursor, an offset in the whole output,
+ * so any number of clients can follow at their own pace.
+ */
+class output_ring
+{
+public:
+    output_ring(std::size_t capacity) : buf(capacity) {}
+    output_ring(const output_ring &) = delete;
+    output_ring& operator=(const output_ring &) = delete;
+
+    // Old output is overwritten when the ring is full
+    void write(const char *data, std::size_t len);
+    // Appends at most max bytes after cursor to out and advances cursor.
+    // Returns the bytes lost because the cursor fell behind the ring
+    std::uint64_t read(std::uint64_t &cursor, std::size_t max,
+                       std::string &out) const;
+    // The cursor of the next byte to be written
+    std::uint64_t end() const;
+private:
+    mutable std::mutex mutex;
+    std::vector<char> buf;
+    std::uint64_t total = 0;                 // Bytes written since the start
+};
+
+#endif // OUTPUT_RING_HPP
@@ -0,0 +1,130 @@
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "placement.hpp"
+
+using namespace std;
+
+namespace proc{
+
+// set_mempolicy() without libnuma
+static constexpr int MPOL_PREFERRED_ = 1;
+
+// Returns the CPU lists of the NUMA nodes indexed by node number
+static vector<cpu_set_t> _numa_nodes()
+{
+    vector<cpu_set_t> nodes;
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (!dir) return nodes;
+    while (dirent *d = readdir(dir)) {
+        int node;
+        if (sscanf(d->d_name, "node%d", &node) != 1) continue;
+        ifstream in(string("/sys/devices/system/node/") + d->d_name + "/cpulist");
+        string list;
+        if (!getline(in, list)) continue;
+        if (static_cast<size_t>(node) >= nodes.size()) {
+            cpu_set_t empty;
+            CPU_ZERO(&empty);
+            nodes.resize(node + 1, empty);
+        }
+        parse_cpu_list(list, nodes[node]);
+    }
+    closedir(dir);
+    return nodes;
+}
+
+vector<placement> plan_placement(affinity_mode mode, const vector<string> &lists,
+                                 size_t count)
+{
+    vector<placement> plan(count);
+    if (mode == affinity_mode::NONE) return plan;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed))
+        throw runtime_error("sched_getaffinity failed");
+    vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+    auto nodes = _numa_nodes();
+    // Nodes without allowed CPUs are skipped
+    vector<int> usable;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        CPU_AND(&nodes[n], &nodes[n], &allowed);
+        if (CPU_COUNT(&nodes[n])) usable.push_back(n);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        auto &p = plan[i];
+        p.has_cpus = true;
+        CPU_ZERO(&p.cpus);
+        switch (mode) {
+        case affinity_mode::LIST:
+            parse_cpu_list(lists[i % lists.size()], p.cpus);
+            break;
+        case affinity_mode::SPREAD:
+            CPU_SET(cpus[i % cpus.size()], &p.cpus);
+            break;
+        case affinity_mode::PER_NUMA_NODE:
+            if (usable.empty()) {
+                p.cpus = allowed;
+                break;
+            }
+            p.node = usable[i % usable.size()];
+            p.cpus = nodes[p.node];
+            break;
+        default:;
+        }
+    }
+    return plan;
+}
+
+void parse_cpu_list(const string &list, cpu_set_t &cpus)
+{
+    CPU_ZERO(&cpus);
+    istringstream ranges(list);
+    for (string range; getline(ranges, range, ',');) {
+        int first, last;
+        char dash;
+        istringstream r(range);
+        if (!(r >> first)) throw runtime_error("bad cpu list: " + list);
+        last = first;
+        if (r >> dash && (dash != '-' || !(r >> last)))
+            throw runtime_error("bad cpu list: " + list);
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            throw runtime_error("bad cpu list: " + list);
+        for (int cpu = first; cpu <= last; ++cpu) CPU_SET(cpu, &cpus);
+    }
+}
+
+string format_cpu_list(const cpu_set_t &cpus)
+{
+    string list;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &cpus)) continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus)) ++last;
+        if (!list.empty()) list += ",";
+        list += to_string(cpu);
+        if (last > cpu) list += "-" + to_string(last);
+        cpu = last;
+    }
+    return list;
+}
+
+int apply_placement(const placement &p)
+{
+    if (p.has_cpus && sched_setaffinity(0, sizeof(p.cpus), &p.cpus)) return errno;
+    if (p.node >= 0 && p.node < static_cast<int>(8 * sizeof(unsigned long))) {
+        unsigned long mask = 1UL << p.node;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED_, &mask, 8 * sizeof(mask)))
+            return errno;
+    }
+    return 0;
+}
+
+} // namespace proc
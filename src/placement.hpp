@@ -0,0 +1,40 @@
+#ifndef PLACEMENT_HPP
+#define PLACEMENT_HPP
+
+#include <sched.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+namespace proc{
+
+// Where a replica runs, it is applied in the child before execve()
+struct placement
+{
+    bool has_cpus = false;
+    cpu_set_t cpus;
+    int node = -1;                           // Preferred NUMA node, -1 if none
+};
+
+enum class affinity_mode {
+    NONE,
+    LIST,                                    // Explicit CPU lists
+    SPREAD,                                  // One CPU per replica
+    PER_NUMA_NODE                            // Replicas take turns on nodes
+};
+
+// Plans the placement of count replicas over the CPUs allowed to the
+// daemon. LIST cycles through lists like "0-3,8". Throws on a bad list
+std::vector<placement> plan_placement(affinity_mode mode,
+                                      const std::vector<std::string> &lists,
+                                      std::size_t count);
+void parse_cpu_list(const std::string &list, cpu_set_t &cpus);
+std::string format_cpu_list(const cpu_set_t &cpus);
+// Applies the CPU and memory placement to the calling process, it is
+// async-signal-safe. Returns 0 or an errno value
+int apply_placement(const placement &p);
+
+} // namespace proc
+
+#endif // PLACEMENT_HPP
@@ -0,0 +1,254 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+
+#include "prober.hpp"
+
+using namespace std;
+
+extern char **environ;
+
+prober::prober(timer_wheel &timers, watch_func watch) :
+    timers(timers), watch(move(watch)), epfd(epoll_create1(EPOLL_CLOEXEC))
+{
+    if (epfd == -1)
+        throw runtime_error(string("epoll_create1: ") + strerror(errno));
+}
+
+prober::~prober()
+{
+    for (auto &p : pending) timers.cancel(p.timer);
+    for (auto &a : active) release(a.second);
+    for (auto &a : active) timers.cancel(a.second.timer);
+    close(epfd);
+}
+
+void prober::configure(size_t limit)
+{
+    max_running = limit;
+    dispatch();
+}
+
+uint64_t prober::run(const probe_config &config, vector<string> env, done_func done)
+{
+    probe p;
+    p.id = ++last_id;
+    p.config = config;
+    p.env = move(env);
+    p.done = move(done);
+    pending.push_back(move(p));
+    dispatch();
+    return last_id;
+}
+
+void prober::cancel(uint64_t id)
+{
+    auto it = active.find(id);
+    if (it != active.end()) {
+        release(it->second);
+        timers.cancel(it->second.timer);
+        active.erase(it);
+        dispatch();
+        return;
+    }
+    auto queued = find_if(pending.begin(), pending.end(),
+                          [id](const probe &p) {return p.id == id;});
+    if (queued != pending.end()) pending.erase(queued);
+}
+
+void prober::dispatch()
+{
+    while (!pending.empty() && (!max_running || active.size() < max_running)) {
+        uint64_t id = pending.front().id;
+        auto &p = active.emplace(id, move(pending.front())).first->second;
+        pending.pop_front();
+        start(p);
+    }
+}
+
+void prober::start(probe &p)
+{
+    uint64_t id = p.id;
+    p.timer = timers.add(chrono::milliseconds(static_cast<long long>(p.config.timeout * 1000)),
+                         [this, id]() {finish(id, false, "timed out");});
+    switch (p.config.kind) {
+    case probe_config::PROBE_TCP:
+    case probe_config::PROBE_UNIX:
+        connect(p);
+        break;
+    case probe_config::PROBE_EXEC:
+        spawn(p);
+        break;
+    case probe_config::PROBE_FILE: {
+        struct stat st;
+        if (stat(p.config.target.c_str(), &st)) finish_later(p, false, strerror(errno));
+        else finish_later(p, true, "");
+        break;
+    }
+    default:
+        finish_later(p, false, "no probe");
+    }
+}
+
+bool prober::parse_address(const string &target, sockaddr_storage &addr, socklen_t &len)
+{
+    string host = "127.0.0.1", port = target;
+    auto colon = target.rfind(':');
+    if (colon != string::npos) {
+        host = target.substr(0, colon);
+        port = target.substr(colon + 1);
+        if (host.size() > 1 && host.front() == '[' && host.back() == ']')
+            host = host.substr(1, host.size() - 2);
+        if (host == "localhost") host = "127.0.0.1";
+    }
+    if (port.empty() || port.find_first_not_of("0123456789") != string::npos ||
+        port.size() > 5 || stoul(port) > 65535)
+        return false;
+    uint16_t number = htons(static_cast<uint16_t>(stoul(port)));
+    memset(&addr, 0, sizeof(addr));
+    auto v4 = reinterpret_cast<sockaddr_in *>(&addr);
+    auto v6 = reinterpret_cast<sockaddr_in6 *>(&addr);
+    if (inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = number;
+        len = sizeof(*v4);
+    } else if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = number;
+        len = sizeof(*v6);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void prober::connect(probe &p)
+{
+    sockaddr_storage addr;
+    socklen_t len;
+    if (p.config.kind == probe_config::PROBE_UNIX) {
+        auto un = reinterpret_cast<sockaddr_un *>(&addr);
+        memset(un, 0, sizeof(*un));
+        un->sun_family = AF_UNIX;
+        if (p.config.target.size() >= sizeof(un->sun_path))
+            return finish_later(p, false, "path too long");
+        strcpy(un->sun_path, p.config.target.c_str());
+        len = sizeof(*un);
+    } else if (!parse_address(p.config.target, addr, len)) {
+        return finish_later(p, false, "bad address");
+    }
+    p.fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (p.fd == -1) return finish_later(p, false, strerror(errno));
+    if (!::connect(p.fd, reinterpret_cast<sockaddr *>(&addr), len))
+        return finish_later(p, true, "");
+    // A unix socket with a full backlog says EAGAIN, it is not listening
+    if (errno != EINPROGRESS) return finish_later(p, false, strerror(errno));
+    epoll_event ev = {};
+    ev.events = EPOLLOUT;
+    ev.data.u64 = p.id;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, p.fd, &ev))
+        finish_later(p, false, strerror(errno));
+}
+
+void prober::spawn(probe &p)
+{
+    vector<char *> envp;
+    for (char **e = environ; *e; ++e) envp.push_back(*e);
+    for (auto &e : p.env) envp.push_back(&e[0]);
+    envp.push_back(nullptr);
+    char sh[] = "/bin/sh", c[] = "-c";
+    char *argv[] = {sh, c, &p.config.target[0], nullptr};
+
+    // The command gets its own group, a timeout kills all of it. Signals
+    // blocked by the daemon are restored
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK |
+                                    POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&attr, 0);
+    sigset_t none, defaults;
+    sigemptyset(&none);
+    posix_spawnattr_setsigmask(&attr, &none);
+    sigemptyset(&defaults);
+    for (int sig : {SIGCHLD, SIGTERM, SIGHUP, SIGPIPE}) sigaddset(&defaults, sig);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    for (int fd = 0; fd < 3; ++fd)
+        posix_spawn_file_actions_addopen(&actions, fd, "/dev/null", O_RDWR, 0);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, sh, &actions, &attr, argv, envp.data());
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (err) return finish_later(p, false, strerror(err));
+    p.pid = pid;
+    uint64_t id = p.id;
+    watch(pid, [this, id](int status) {
+        auto it = active.find(id);
+        if (it == active.end()) return; // Timed out or cancelled
+        it->second.pid = 0;
+        if (WIFEXITED(status) && !WEXITSTATUS(status)) finish(id, true, "");
+        else if (WIFEXITED(status)) finish(id, false, "exit code " + to_string(WEXITSTATUS(status)));
+        else finish(id, false, "killed by signal " + to_string(WTERMSIG(status)));
+    });
+}
+
+void prober::finish_later(probe &p, bool ok, const string &why)
+{
+    timers.cancel(p.timer);
+    uint64_t id = p.id;
+    p.timer = timers.add(chrono::milliseconds(0),
+                         [this, id, ok, why]() {finish(id, ok, why);});
+}
+
+void prober::finish(uint64_t id, bool ok, const string &why)
+{
+    auto it = active.find(id);
+    if (it == active.end()) return;
+    release(it->second);
+    timers.cancel(it->second.timer);
+    auto done = move(it->second.done);
+    active.erase(it);
+    dispatch();
+    done(ok, why);
+}
+
+// Closes the socket and kills the command of a probe that is over
+void prober::release(probe &p)
+{
+    if (p.fd != -1) close(p.fd);
+    if (p.pid > 0) ::kill(-p.pid, SIGKILL);
+    p.fd = -1;
+    p.pid = 0;
+}
+
+void prober::complete()
+{
+    epoll_event events[TPROBE_EVENTS];
+    int n;
+    while ((n = epoll_wait(epfd, events, TPROBE_EVENTS, 0)) > 0) {
+        for (int i = 0; i < n; ++i) {
+            uint64_t id = events[i].data.u64;
+            auto it = active.find(id);
+            if (it == active.end()) continue;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(it->second.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            finish(id, !err, err ? strerror(err) : "");
+        }
+        if (n < TPROBE_EVENTS) break;
+    }
+}
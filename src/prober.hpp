@@ -0,0 +1,108 @@
+#ifndef PROBER_HPP
+#define PROBER_HPP
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "timer_wheel.hpp"
+#include "defaults.hpp"
+
+// Health check of a replica, see task_config::readiness and liveness
+struct probe_config
+{
+    enum {
+        PROBE_NONE,
+        PROBE_TCP,                           // Connects to [host:]port
+        PROBE_UNIX,                          // Connects to a unix socket
+        PROBE_EXEC,                          // Runs a shell command, exit code 0
+        PROBE_FILE                           // The path exists
+    } kind = PROBE_NONE;
+    std::string target;
+    double delay = 0;                        // Seconds before the first probe
+    double interval = TPROBE_INTERVAL;       // Seconds between probes
+    double timeout = TPROBE_TIMEOUT;
+    unsigned failures = TPROBE_FAILURES;     // Liveness failures in a row
+    bool operator==(const probe_config &other) const
+    {
+        return kind == other.kind && target == other.target &&
+               delay == other.delay && interval == other.interval &&
+               timeout == other.timeout && failures == other.failures;
+    }
+};
+
+/*
+ * Runs health probes without blocking the event loop. Connects are
+ * non-blocking and watched by an epoll descriptor that the loop polls,
+ * commands are started with posix_spawn() and reaped like replicas, a
+ * file is checked at once and reported on the next timer tick.
+ * At most max_running probes are in flight, the others wait in order.
+ * A probe that is not over within its timeout fails, its command is
+ * killed with its process group.
+ */
+class prober
+{
+public:
+    // Is called once, why tells what failed
+    using done_func = std::function<void(bool ok, const std::string &why)>;
+    // Calls the handler with the status of the reaped child
+    using watch_func = std::function<void(pid_t pid, std::function<void(int status)>)>;
+
+    prober(timer_wheel &timers, watch_func watch);
+    ~prober();
+    prober(const prober &) = delete;
+    prober& operator=(const prober &) = delete;
+
+    // 0 disables the limit
+    void configure(std::size_t max_running);
+    // env is added to the environment of a command. done is not called
+    // before run() returns
+    std::uint64_t run(const probe_config &probe, std::vector<std::string> env,
+                      done_func done);
+    // The probe is dropped without calling done
+    void cancel(std::uint64_t id);
+    // Readable when a connect is over
+    int event_fd() const {return epfd;}
+    void complete();
+
+    std::size_t running() const {return active.size();}
+    std::size_t queued() const {return pending.size();}
+    // Reads "port", "host:port" or "[host]:port" with a numeric host,
+    // returns false if target is none of them
+    static bool parse_address(const std::string &target, sockaddr_storage &addr,
+                              socklen_t &len);
+private:
+    struct probe {
+        std::uint64_t id;
+        probe_config config;
+        std::vector<std::string> env;
+        done_func done;
+        int fd = -1;                         // Connecting socket
+        pid_t pid = 0;                       // Command not reaped yet
+        timer_wheel::timer_id timer;         // Timeout or result of a check
+    };
+    void dispatch();
+    void start(probe &p);
+    void connect(probe &p);
+    void spawn(probe &p);
+    // Reports the result from the timer wheel
+    void finish_later(probe &p, bool ok, const std::string &why);
+    void finish(std::uint64_t id, bool ok, const std::string &why);
+    static void release(probe &p);
+
+    timer_wheel &timers;
+    watch_func watch;
+    int epfd;
+    std::uint64_t last_id = 0;
+    std::size_t max_running = TPROBE_MAX_RUNNING;
+    std::deque<probe> pending;
+    std::unordered_map<std::uint64_t, probe> active;
+};
+
+#endif // PROBER_HPP
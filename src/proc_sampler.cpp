@@ -0,0 +1,215 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "proc_sampler.hpp"
+#include "defaults.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+proc_sampler::~proc_sampler()
+{
+    configure(milliseconds(0));
+}
+
+void proc_sampler::configure(milliseconds new_interval)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        interval = new_interval;
+        quit = interval.count() <= 0;
+        // A restarted thread opens the processes that are still known
+        if (!quit && !thread.joinable()) {
+            changes.clear();
+            for (auto &s : samples) changes.emplace_back(s.first, true);
+        }
+    }
+    cond.notify_all();
+    if (quit) {
+        if (thread.joinable()) thread.join();
+        return;
+    }
+    if (thread.joinable()) return;
+    // Three descriptors are kept open per process. Replicas are started
+    // with the limit the daemon inherited, see process::spawn()
+    rlimit nofile;
+    if (!getrlimit(RLIMIT_NOFILE, &nofile) && nofile.rlim_cur < nofile.rlim_max) {
+        nofile.rlim_cur = nofile.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &nofile);
+    }
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    thread = std::thread(&proc_sampler::run, this);
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
+milliseconds proc_sampler::get_interval() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    return interval;
+}
+
+void proc_sampler::add(pid_t pid)
+{
+    lock_guard<std::mutex> lock(mutex);
+    if (!thread.joinable() || samples.count(pid)) return;
+    samples.emplace(pid, sample());
+    changes.emplace_back(pid, true);
+}
+
+void proc_sampler::remove(pid_t pid)
+{
+    lock_guard<std::mutex> lock(mutex);
+    if (!samples.erase(pid)) return;
+    changes.emplace_back(pid, false);
+}
+
+bool proc_sampler::get(pid_t pid, sample &s) const
+{
+    lock_guard<std::mutex> lock(mutex);
+    auto it = samples.find(pid);
+    if (it == samples.end()) return false;
+    s = it->second;
+    return true;
+}
+
+/*
+ * Private
+ */
+
+void proc_sampler::run()
+{
+    vector<pair<pid_t, bool>> applied;
+    auto last = steady_clock::now();
+    unique_lock<std::mutex> lock(mutex);
+    while (!quit) {
+        cond.wait_for(lock, interval, [this]() {return quit;});
+        if (quit) break;
+        applied.swap(changes);
+        lock.unlock();
+        for (auto &change : applied) {
+            if (change.second) {
+                entry e;
+                if (open_entry(change.first, e)) entries.emplace(change.first, e);
+            } else {
+                auto it = entries.find(change.first);
+                if (it == entries.end()) continue;
+                close_entry(it->second);
+                entries.erase(it);
+            }
+        }
+        applied.clear();
+        auto now = steady_clock::now();
+        sweep(now, duration<double>(now - last).count());
+        last = now;
+        lock.lock();
+    }
+    for (auto &e : entries) close_entry(e.second);
+    entries.clear();
+}
+
+void proc_sampler::sweep(steady_clock::time_point now, double seconds)
+{
+    sample s;
+    s.seconds = seconds;
+    s.time = now;
+    for (auto &e : entries) {
+        // The CPU baseline of a new process was just taken
+        if (e.second.fresh) {
+            e.second.fresh = false;
+            continue;
+        }
+        bool ok = read_entry(e.second, seconds, s);
+        lock_guard<std::mutex> lock(mutex);
+        auto it = samples.find(e.first);
+        if (it == samples.end() || !ok) continue;
+        sample &prev = it->second;
+        // Exponential moving averages over about TSAMPLE_WINDOW samples
+        double alpha = prev.valid ? 1.0 / TSAMPLE_WINDOW : 1.0;
+        s.cpu_avg = prev.cpu_avg + alpha * (s.cpu - prev.cpu_avg);
+        s.rss_avg = prev.rss_avg + alpha * (s.rss - prev.rss_avg);
+        s.valid = true;
+        prev = s;
+    }
+}
+
+bool proc_sampler::open_entry(pid_t pid, entry &e)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    e.stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (e.stat_fd == -1) return false;
+    snprintf(path, sizeof(path), "/proc/%d/io", pid);
+    e.io_fd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+    e.fd_dir = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    sample s;
+    read_entry(e, 0, s);
+    return true;
+}
+
+void proc_sampler::close_entry(entry &e)
+{
+    for (int fd : {e.stat_fd, e.io_fd, e.fd_dir})
+        if (fd != -1) close(fd);
+    e = entry();
+}
+
+// The descriptors stay bound to the process, a reused pid is never read
+bool proc_sampler::read_entry(entry &e, double seconds, sample &s)
+{
+    static const long ticks_per_second = sysconf(_SC_CLK_TCK);
+    static const long page_size = sysconf(_SC_PAGESIZE);
+    char buf[4096];
+
+    ssize_t n = pread(e.stat_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) return false;
+    buf[n] = '\0';
+    // The command name may contain spaces, fields are counted after it
+    char *p = strrchr(buf, ')');
+    if (!p) return false;
+    unsigned long long utime = 0, stime = 0;
+    long rss = 0;
+    for (int field = 3; *p && field <= 24; ++field) {
+        p = strchr(p + 1, ' ');
+        if (!p) return false;
+        if (field == 14) utime = strtoull(p + 1, nullptr, 10);
+        else if (field == 15) stime = strtoull(p + 1, nullptr, 10);
+        else if (field == 24) rss = strtol(p + 1, nullptr, 10);
+    }
+    uint64_t ticks = utime + stime;
+    s.cpu = seconds > 0 ? (ticks - e.ticks) * 100.0 / ticks_per_second / seconds : 0;
+    e.ticks = ticks;
+    s.rss = static_cast<uint64_t>(rss) * page_size;
+
+    s.read_bytes = s.write_bytes = 0;
+    if (e.io_fd != -1 && (n = pread(e.io_fd, buf, sizeof(buf) - 1, 0)) > 0) {
+        buf[n] = '\0';
+        if ((p = strstr(buf, "\nread_bytes: ")))
+            s.read_bytes = strtoull(p + 13, nullptr, 10);
+        if ((p = strstr(buf, "\nwrite_bytes: ")))
+            s.write_bytes = strtoull(p + 14, nullptr, 10);
+    }
+
+    s.fds = 0;
+    if (e.fd_dir != -1 && lseek(e.fd_dir, 0, SEEK_SET) == 0) {
+        while ((n = syscall(SYS_getdents64, e.fd_dir, buf, sizeof(buf))) > 0) {
+            for (ssize_t off = 0; off < n;) {
+                auto d = reinterpret_cast<dirent64 *>(buf + off);
+                if (d->d_name[0] != '.') ++s.fds;
+                off += d->d_reclen;
+            }
+        }
+    }
+    return true;
+}
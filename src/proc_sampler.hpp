@@ -0,0 +1,78 @@
+#ifndef PROC_SAMPLER_HPP
+#define PROC_SAMPLER_HPP
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Samples the resources of the supervised processes from /proc on its own
+ * thread. The /proc files of a process are opened once and re-read with
+ * pread(), so a sweep does not allocate once every process is known.
+ */
+class proc_sampler
+{
+public:
+    struct sample
+    {
+        bool valid = false;                  // At least one sweep was done
+        double cpu = 0;                      // % of one core, last interval
+        double seconds = 0;                  // Length of the last interval
+        std::chrono::steady_clock::time_point time; // End of the last interval
+        double cpu_avg = 0;                  // Moving averages
+        std::uint64_t rss = 0;               // Bytes
+        double rss_avg = 0;
+        std::uint64_t read_bytes = 0;        // Storage I/O since the start
+        std::uint64_t write_bytes = 0;
+        unsigned fds = 0;
+    };
+
+    proc_sampler() = default;
+    ~proc_sampler();
+    proc_sampler(const proc_sampler &) = delete;
+    proc_sampler& operator=(const proc_sampler &) = delete;
+
+    // A zero interval stops the sampling
+    void configure(std::chrono::milliseconds interval);
+    std::chrono::milliseconds get_interval() const;
+    // Both are cheap and may be called for pids that are not sampled
+    void add(pid_t pid);
+    void remove(pid_t pid);
+    // Returns false if the pid is not sampled
+    bool get(pid_t pid, sample &s) const;
+private:
+    struct entry
+    {
+        int stat_fd = -1;
+        int io_fd = -1;
+        int fd_dir = -1;
+        std::uint64_t ticks = 0;             // utime + stime of the last sweep
+        bool fresh = true;                   // Opened during this sweep
+    };
+
+    void run();
+    void sweep(std::chrono::steady_clock::time_point now, double seconds);
+    bool open_entry(pid_t pid, entry &e);
+    static void close_entry(entry &e);
+    bool read_entry(entry &e, double seconds, sample &s);
+
+    // Shared with the thread
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::chrono::milliseconds interval{0};
+    bool quit = false;
+    std::vector<std::pair<pid_t, bool>> changes;     // pid, added
+    std::unordered_map<pid_t, sample> samples;
+    std::thread thread;
+
+    // Owned by the thread
+    std::unordered_map<pid_t, entry> entries;
+};
+
+#endif // PROC_SAMPLER_HPP
@@ -1,8 +1,6 @@
 #include <iostream>
 #include <utility>
 #include <cstring>
-#include <functional>
-#include <thread>
 
 #include <fcntl.h>
 #include <csignal>
@@ -10,26 +8,27 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <unistd.h>
-
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include "process.hpp"
 
 using namespace std;
 using namespace proc;
 
-process::process(const string &program_path) : bin(program_path)
+// The sampler raises the limit of the daemon, replicas get the one it was
+// started with
+static rlimit _inherited_nofile;
+static const bool _has_inherited_nofile = !getrlimit(RLIMIT_NOFILE, &_inherited_nofile);
+
+process::process(shared_ptr<const launch_spec> launch) : spec(move(launch))
 {
-    set_argv();
-    set_envp();
 }
 
-process::process(const process &other) :
-    bin(other.bin), args(other.args), envs(other.envs), workdir(other.workdir),
-    stdin_file(other.stdin_file), stdout_file(other.stdout_file),
-    stderr_file(other.stderr_file)
+process::process(const process &other) : spec(other.spec)
 {
-    set_argv();
-    set_envp();
 }
 
 process& process::operator=(const process &other)
@@ -37,30 +36,15 @@ process& process::operator=(const process &other)
     if (&other == this) return *this;
     // Stop current process if running
     stop(SIGKILL);
-    bin = other.bin;
-    args = other.args;
-    envs = other.envs;
-    workdir = other.workdir;
-    stdin_file = other.stdin_file;
-    stdout_file = other.stdout_file;
-    stderr_file = other.stderr_file;
-    stoptime = other.stoptime;
-    mask = other.mask;
-    set_argv();
-    set_envp();
+    spec = other.spec;
     return *this;
 }
 
 process::process(process &&other) noexcept:
-    bin(move(other.bin)), args(move(other.args)), envs(move(other.envs)),
-    workdir(move(other.workdir)), stdin_file(move(other.stdin_file)),
-    stdout_file(move(other.stdout_file)), stderr_file(move(other.stderr_file)),
-    stoptime(other.stoptime), mask(other.mask), state(other.state),
-    pid(other.pid), exitstatus(other.exitstatus), stopsig(other.stopsig),
+    spec(move(other.spec)), state(other.state), pid(other.pid),
+    exitstatus(other.exitstatus), stopsig(other.stopsig),
     termsig(other.termsig)
 {
-    set_argv();
-    set_envp();
     // Destructor 'other' must not stop the process
     other.state = process_state::EXITED;
 }
@@ -69,71 +53,65 @@ process& process::operator=(process &&other) noexcept
 {
     // Stop current process if running
     stop(SIGKILL);
-    bin = move(other.bin);
-    args = move(other.args);
-    envs = move(other.envs);
-    workdir = move(other.workdir);
-    stdin_file = move(other.stdin_file);
-    stdout_file = move(other.stdout_file);
-    stderr_file = move(other.stderr_file);
-    stoptime = other.stoptime;
+    spec.swap(other.spec);
     pid = other.pid;
     state = other.state;
     exitstatus = other.exitstatus;
     stopsig = other.stopsig;
     termsig = other.termsig;
-    set_argv();
-    set_envp();
+    // Destructor 'other' must not stop the process
+    other.state = process_state::EXITED;
     return *this;
 }
 
 pid_t process::start()
 {
     if (is_exist()) return pid;
-    if (access(bin.c_str(), X_OK)) {
+    if (access(spec->bin().c_str(), X_OK)) {
         state = process_state::ERROR;
         throw runtime_error(string("failed to start the process: ") +
                             strerror(errno));
     }
-    if ((pid = fork()) > 0) {
-        state = process_state::RUNNING;
-        return pid;
-    }
-    if (pid == -1) {
-        if (errno == EAGAIN) {
-            return start();
-        }
-        throw runtime_error(string("failed to start the process") +
-                            strerror(errno));
+    int err = 0;
+    pid_t child = launch(*spec, err);
+    if (child == -1) {
+        state = process_state::ERROR;
+        throw runtime_error(string("failed to start the process: ") +
+                            strerror(err));
     }
-    setpgrp();
-    apply_redir();
-    umask(mask);
-    chdir(workdir.c_str());
-    execve(bin.c_str(), const_cast<char **>(argv.data()), const_cast<char **>(envp.data()));
-    exit(1);
+    set_started(child);
+    return pid;
+}
+
+pid_t process::launch(const launch_spec &spec, int &err, int extra_fd,
+                      const output_fds &output, int cgroup_procs,
+                      const placement *where)
+{
+    int fds[3];
+    open_redir(spec, fds, output);
+    pid_t child = spawn(spec, fds, err, extra_fd, cgroup_procs, where);
+    for (int fd : fds) close(fd);
+    return child;
+}
+
+void process::set_started(pid_t child)
+{
+    pid = child;
+    state = process_state::RUNNING;
+    exitstatus = stopsig = termsig = 0;
 }
 
-void process::stop(int sig) noexcept
+pid_t process::stop(int sig) noexcept
 {
     // If the process is not launched, then return
-    if (!is_exist()) return;
+    if (!is_exist()) return 0;
     signal(sig);
     state = process_state::TERMINATED;
     termsig = sig;
     auto stop_pid = pid;
     pid = 0;
-    if (sig == SIGKILL) {
-        waitpid(stop_pid, nullptr, 0);
-        return;
-    }
-    std::function<void(pid_t, time_t)> termfunc = [](pid_t pid, time_t stoptime) {
-        sleep(stoptime);
-        kill(pid, SIGKILL);
-        waitpid(pid, nullptr, 0);
-    };
-    std::thread termthread(termfunc, stop_pid, stoptime);
-    termthread.detach();
+    if (sig == SIGKILL) waitpid(stop_pid, nullptr, 0);
+    return stop_pid;
 }
 
 // Returns true if state changed
@@ -147,7 +125,15 @@ bool process::update(bool wait)
     if (res < 0) {
         exitstatus = 0;
         state = process_state::EXITED;
-    } else if (WIFSTOPPED(status)) {
+    } else {
+        set_status(status);
+    }
+    return true;
+}
+
+void process::set_status(int status)
+{
+    if (WIFSTOPPED(status)) {
         stopsig = WSTOPSIG(status);
         state = process_state::STOPPED;
     } else if (WIFSIGNALED(status)) {
@@ -159,7 +145,6 @@ bool process::update(bool wait)
     } else {
         state = process_state::TERMINATED;
     }
-    return true;
 }
 
 int process::signal(int sig)
@@ -172,49 +157,105 @@ int process::signal(int sig)
 }
 
 
-void process::set_args(const std::vector<string> &arguments)
-{
-    args = arguments;
-    set_argv();
-}
-
-void process::set_envs(const std::vector<std::string> &variables)
+int process::apply_sched(const sched_params &sched)
 {
-    envs = variables;
-    set_envp();
+    for (auto &limit : sched.rlimits)
+        if (setrlimit(static_cast<__rlimit_resource_t>(limit.first), &limit.second))
+            return errno;
+    if (sched.set_nice && setpriority(PRIO_PROCESS, 0, sched.nice)) return errno;
+    // IOPRIO_WHO_PROCESS, glibc has no wrapper
+    if (sched.ioprio != -1 && syscall(SYS_ioprio_set, 1, 0, sched.ioprio))
+        return errno;
+    if (sched.policy != -1) {
+        sched_param param = {};
+        param.sched_priority = sched.priority;
+        if (sched_setscheduler(0, sched.policy, &param)) return errno;
+    }
+    return 0;
 }
 
-void process::set_redirection(const std::string &stdin_file_path,
-                              const std::string &stdout_file_path,
-                              const std::string &stderr_file_path)
-{
-    stdin_file = stdin_file_path;
-    stdout_file = stdout_file_path;
-    stderr_file = stderr_file_path;
-}
 
 /*
  * Private
  */
 
-void process::apply_redir()
+void process::open_redir(const launch_spec &spec, int (&fds)[3],
+                         const output_fds &output)
 {
-   if (!freopen(stdin_file.c_str(), "r", stdin)) freopen("/dev/null", "r", stdin);
-   if (!freopen(stdout_file.c_str(), "a", stdout)) freopen("/dev/null", "w", stdout);
-   if (!freopen(stderr_file.c_str(), "a", stderr)) freopen("/dev/null", "w", stderr);
+    const string *files[3] = {&spec.stdin_file(), &spec.stdout_file(),
+                              &spec.stderr_file()};
+    const int overrides[3] = {-1, output.out, output.err};
+    for (int i = 0; i < 3; ++i) {
+        if (overrides[i] != -1 &&
+            (fds[i] = fcntl(overrides[i], F_DUPFD_CLOEXEC, 3)) != -1)
+            continue;
+        int flags = O_CLOEXEC | (i ? O_WRONLY | O_CREAT | O_APPEND : O_RDONLY);
+        if ((fds[i] = open(files[i]->c_str(), flags, 0666)) == -1)
+            fds[i] = open("/dev/null", (i ? O_WRONLY : O_RDONLY) | O_CLOEXEC);
+    }
 }
 
-void process::set_argv()
+/*
+ * Launches the binary without copying the address space of the daemon.
+ * The child shares memory with the parent until execve(), so it may only
+ * use async-signal-safe calls and must not touch any C++ object.
+ * Returns the pid or -1 and sets err if fork or execve failed.
+ */
+pid_t process::spawn(const launch_spec &spec, const int (&fds)[3], int &err,
+                     int extra_fd, int cgroup_procs, const placement *where)
 {
-    argv.clear();
-    argv.push_back(bin.c_str());
-    for (const auto &arg: args) argv.push_back(arg.c_str());
-    argv.push_back(nullptr);
-}
+    const char *path = spec.bin().c_str();
+    const char *dir = spec.workdir().c_str();
+    char *const *av = spec.argv();
+    char *const *ep = spec.envp();
+    mode_t m = spec.mask();
+    const sched_params &sched = spec.sched();
+    volatile int exec_errno = 0;
 
-void process::set_envp()
-{
-    envp.clear();
-    for (auto &var : envs) envp.push_back(var.c_str());
-    envp.push_back(nullptr);
+    // Signal handlers of the daemon must not run on the shared stack
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pid_t child = vfork();
+    if (child == 0) {
+        for (int sig = 1; sig < NSIG; ++sig) {
+            struct sigaction sa;
+            if (!sigaction(sig, nullptr, &sa) && sa.sa_handler != SIG_DFL &&
+                sa.sa_handler != SIG_IGN)
+                ::signal(sig, SIG_DFL);
+        }
+        // The daemon blocks the signals it reads from a signalfd
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, nullptr);
+        // Writing 0 moves the calling process, its children follow it
+        if (cgroup_procs != -1 && write(cgroup_procs, "0", 1)) {}
+        setpgid(0, 0);
+        if (_has_inherited_nofile) setrlimit(RLIMIT_NOFILE, &_inherited_nofile);
+        // A replica that cannot get its limits or placement does not start
+        int res = apply_sched(sched);
+        if (!res && where) res = apply_placement(*where);
+        if (res) {
+            exec_errno = res;
+            _exit(127);
+        }
+        for (int i = 0; i < 3; ++i) {
+            if (fds[i] == i) fcntl(i, F_SETFD, 0);
+            else dup2(fds[i], i);
+        }
+        if (extra_fd == 3) fcntl(3, F_SETFD, 0);
+        else if (extra_fd != -1) dup2(extra_fd, 3);
+        umask(m);
+        if (chdir(dir)) {}
+        execve(path, av, ep);
+        exec_errno = errno;
+        _exit(127);
+    }
+    err = (child == -1) ? errno : exec_errno;
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    if (child > 0 && err) {
+        waitpid(child, nullptr, 0);
+        return -1;
+    }
+    return child;
 }
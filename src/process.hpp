@@ -12,8 +12,19 @@
 #include <vector>
 #include <memory>
 
+#include "launch_spec.hpp"
+#include "placement.hpp"
+
 namespace proc{
 
+// Descriptors that replace the stdout and stderr files of a spec, -1 keeps
+// the file. They are not owned, the caller closes them after the launch.
+struct output_fds
+{
+    int out = -1;
+    int err = -1;
+};
+
 class process
 {
 public:
@@ -26,7 +37,7 @@ public:
         EXITED,
         TERMINATED
     };
-    process(const std::string &program_path);
+    process(std::shared_ptr<const launch_spec> launch);
 
     process() = delete;
     process(const process &other);
@@ -35,18 +46,30 @@ public:
     process& operator=(process &&other) noexcept;
     ~process() {stop(SIGKILL);}
 
-    void set_args(const std::vector<std::string> &arguments = {});
-    void set_envs(const std::vector<std::string> &variables = {});
-    void set_workdir(const std::string &dir) {workdir = dir;}
-    void set_redirection(const std::string &stdin_file_path,
-                         const std::string &stdout_file_path,
-                         const std::string &stderr_file_path);
-    void set_stoptime(time_t time) {stoptime = time;}
-    void set_umask(mode_t mode) {mask = mode;}
+    const launch_spec &get_spec() const {return *spec;}
 
     pid_t start();
-    void stop(int sig = SIGTERM) noexcept;
+    // Starts a replica of spec without a process object, may be called from
+    // any thread. extra_fd is passed to the child as descriptor 3, the child
+    // moves itself to the cgroup of an open cgroup.procs and applies the
+    // placement before execve(). Returns the pid or -1 and sets err
+    static pid_t launch(const launch_spec &spec, int &err, int extra_fd = -1,
+                        const output_fds &output = {}, int cgroup_procs = -1,
+                        const placement *where = nullptr);
+    // Applies the scheduling settings of spec to the calling process, it is
+    // async-signal-safe. Returns 0 or an errno value
+    static int apply_sched(const sched_params &sched);
+    // Opens stdin, stdout, stderr of spec, falls back to /dev/null
+    static void open_redir(const launch_spec &spec, int (&fds)[3],
+                           const output_fds &output = {});
+    // Attaches a child started by launch()
+    void set_started(pid_t child);
+    // Returns the pid of the signaled process, the caller must reap it
+    // unless sig is SIGKILL
+    pid_t stop(int sig = SIGTERM) noexcept;
     bool update(bool wait = false);
+    // Applies a waitpid() status of the process reaped by the caller
+    void set_status(int status);
     int signal(int sig);
 
     process_state get_state() {return state;}
@@ -61,29 +84,18 @@ public:
 
 protected:
 private:
-    // Process config
-    std::string bin;                        // Binary file path, is used for execve()
-    std::vector<std::string> args;          // Programm arguments
-    std::vector<std::string> envs;          // Programm environment
-    std::string workdir = "/";              // Working directory
-    std::string stdin_file = "/dev/null";   // stdin file
-    std::string stdout_file = "/dev/null";  // stdout file
-    std::string stderr_file = "/dev/null";  // stderr file
-    time_t stoptime = 10;                   // Maximum process stop time until SIGKILL is received
-    mode_t mask = S_IWGRP | S_IWOTH;
+    std::shared_ptr<const launch_spec> spec; // Shared by all replicas of a task
 
     // Process status
-    std::vector<const char *> argv;          // Pointers to c_str in args, is used for execve()
-    std::vector<const char *> envp;          // Pointers to c_str in envs, is used for execve()
     process_state state = process_state::DID_NOT_START;
     pid_t pid = 0;
     int exitstatus = 0;                      // Process exit status, it makes sense if the process exited
     int stopsig = 0;                         // Process exit status, it makes sense if the process stopped
     int termsig = 0;                         // Process exit status, it makes sense if the process exited by signal
 
-    void apply_redir();                       // Applies redirection, used after fork()
-    void set_argv();
-    void set_envp();
+    // vfork() + execve()
+    static pid_t spawn(const launch_spec &spec, const int (&fds)[3], int &err,
+                       int extra_fd, int cgroup_procs, const placement *where);
 };
 
 } // namespace proc
@@ -0,0 +1,187 @@
+#include <cerrno>
+#include <algorithm>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "process_table.hpp"
+
+using namespace std;
+
+process_table::slice process_table::allocate(uint32_t count)
+{
+    slice s;
+    s.count = count;
+    s.owner = ++last_owner;
+    // First fit, the table only grows when no hole is large enough
+    auto hole = find_if(free_slices.begin(), free_slices.end(),
+                        [count](const slice &f) {return f.count >= count;});
+    if (hole != free_slices.end()) {
+        s.first = hole->first;
+        hole->first += count;
+        hole->count -= count;
+        if (!hole->count) free_slices.erase(hole);
+    } else {
+        s.first = static_cast<uint32_t>(size());
+        grow_table(size() + count);
+    }
+    init_rows(s.first, count, s.owner);
+    return s;
+}
+
+void process_table::release(slice &s) noexcept
+{
+    if (!s.owner) return;
+    for (uint32_t i = s.first; i < s.first + s.count; ++i) stop(i, SIGKILL);
+    free_rows(s.first, s.count);
+    s = slice();
+}
+
+bool process_table::resize(slice &s, uint32_t count)
+{
+    if (count <= s.count) {
+        for (uint32_t i = s.first + count; i < s.first + s.count; ++i) stop(i, SIGKILL);
+        free_rows(s.first + count, s.count - count);
+        s.count = count;
+        return false;
+    }
+    uint32_t extra = count - s.count;
+    uint32_t end = s.first + s.count;
+    auto hole = find_if(free_slices.begin(), free_slices.end(),
+                        [end](const slice &f) {return f.first == end;});
+    if (end == size() || (hole != free_slices.end() && hole->count >= extra)) {
+        if (end == size()) {
+            grow_table(size() + extra);
+        } else {
+            hole->first += extra;
+            hole->count -= extra;
+            if (!hole->count) free_slices.erase(hole);
+        }
+        init_rows(end, extra, s.owner);
+        s.count = count;
+        return false;
+    }
+    slice moved = allocate(count);
+    --last_owner;
+    moved.owner = s.owner;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t to = moved.first + i;
+        owners[to] = s.owner;
+        if (i >= s.count) continue;
+        uint32_t from = s.first + i;
+        states[to] = states[from];
+        pids[to] = pids[from];
+        exitcodes[to] = exitcodes[from];
+        termsigs[to] = termsigs[from];
+        starttimes[to] = starttimes[from];
+    }
+    free_rows(s.first, s.count);
+    s = moved;
+    return true;
+}
+
+void process_table::grow_table(size_t rows)
+{
+    states.resize(rows);
+    pids.resize(rows);
+    exitcodes.resize(rows);
+    termsigs.resize(rows);
+    starttimes.resize(rows);
+    owners.resize(rows);
+    generations.resize(rows);
+}
+
+void process_table::init_rows(uint32_t first, uint32_t count, uint32_t owner)
+{
+    for (uint32_t i = first; i < first + count; ++i) {
+        states[i] = static_cast<uint8_t>(process_state::DID_NOT_START);
+        pids[i] = 0;
+        exitcodes[i] = termsigs[i] = 0;
+        starttimes[i] = 0;
+        owners[i] = owner;
+        if (!++generations[i]) ++generations[i];
+    }
+}
+
+void process_table::free_rows(uint32_t first, uint32_t count) noexcept
+{
+    if (!count) return;
+    slice s{first, count, 0};
+    for (uint32_t i = first; i < first + count; ++i) {
+        pids[i] = 0;
+        owners[i] = 0;
+        if (!++generations[i]) ++generations[i];
+    }
+    // Neighbouring holes are merged
+    auto next = lower_bound(free_slices.begin(), free_slices.end(), s,
+        [](const slice &a, const slice &b) {return a.first < b.first;});
+    if (next != free_slices.begin() &&
+        prev(next)->first + prev(next)->count == s.first) {
+        --next;
+        next->count += s.count;
+    } else {
+        next = free_slices.insert(next, s);
+    }
+    auto after = next + 1;
+    if (after != free_slices.end() && next->first + next->count == after->first) {
+        next->count += after->count;
+        free_slices.erase(after);
+    }
+}
+
+void process_table::set_started(uint32_t i, pid_t pid)
+{
+    pids[i] = pid;
+    states[i] = static_cast<uint8_t>(process_state::RUNNING);
+    exitcodes[i] = termsigs[i] = 0;
+    starttimes[i] = time(nullptr);
+}
+
+void process_table::set_status(uint32_t i, int status)
+{
+    process_state state;
+    if (WIFSTOPPED(status)) {
+        termsigs[i] = WSTOPSIG(status);
+        state = process_state::STOPPED;
+    } else if (WIFSIGNALED(status)) {
+        termsigs[i] = WTERMSIG(status);
+        state = process_state::SIGNALED;
+    } else if (WIFEXITED(status)) {
+        exitcodes[i] = WEXITSTATUS(status);
+        state = process_state::EXITED;
+    } else {
+        state = process_state::TERMINATED;
+    }
+    states[i] = static_cast<uint8_t>(state);
+}
+
+pid_t process_table::stop(uint32_t i, int sig) noexcept
+{
+    if (!is_exist(i)) return 0;
+    signal(i, sig);
+    states[i] = static_cast<uint8_t>(process_state::TERMINATED);
+    termsigs[i] = sig;
+    pid_t stop_pid = pids[i];
+    pids[i] = 0;
+    if (sig == SIGKILL) waitpid(stop_pid, nullptr, 0);
+    return stop_pid;
+}
+
+int process_table::signal(uint32_t i, int sig)
+{
+    if (!is_exist(i)) {
+        errno = ESRCH;
+        return -1;
+    }
+    return kill(pids[i], sig);
+}
+
+size_t process_table::memory_usage() const
+{
+    return sizeof(*this) + states.capacity() * sizeof(uint8_t) +
+           pids.capacity() * sizeof(pid_t) +
+           (exitcodes.capacity() + termsigs.capacity()) * sizeof(int) +
+           starttimes.capacity() * sizeof(time_t) +
+           (owners.capacity() + generations.capacity()) * sizeof(uint32_t) +
+           free_slices.capacity() * sizeof(slice);
+}
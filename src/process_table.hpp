@@ -0,0 +1,91 @@
+#ifndef PROCESS_TABLE_HPP
+#define PROCESS_TABLE_HPP
+
+#include <sys/types.h>
+
+#include <csignal>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include "process.hpp"
+
+/*
+ * State of every replica of the daemon in dense columns, so a scan reads
+ * a few contiguous arrays instead of one heap object per process.
+ * A task owns a contiguous slice of rows. Rows are reused once a slice is
+ * released, a handle keeps the generation of its row so a callback that
+ * outlives its task sees that the row is gone.
+ */
+class process_table
+{
+public:
+    using process_state = proc::process::process_state;
+    struct handle {
+        std::uint32_t index = 0;
+        std::uint32_t generation = 0;     // 0 is never used by a live row
+        explicit operator bool() const {return generation;}
+    };
+    struct slice {
+        std::uint32_t first = 0;
+        std::uint32_t count = 0;
+        std::uint32_t owner = 0;          // Task id, 0 if not allocated
+    };
+
+    process_table() = default;
+    process_table(const process_table &) = delete;
+    process_table& operator=(const process_table &) = delete;
+
+    // Reserves count rows of a new owner, they start as DID_NOT_START
+    slice allocate(std::uint32_t count);
+    // Kills the processes of the slice and frees its rows
+    void release(slice &s) noexcept;
+    // Grows or shrinks a slice, the processes of the rows that are cut
+    // must be stopped first. Rows keep their contents but a slice that
+    // cannot grow in place is moved, then true is returned and the handles
+    // of its rows are stale
+    bool resize(slice &s, std::uint32_t count);
+    handle get_handle(std::uint32_t index) const {return {index, generations[index]};}
+    bool is_valid(handle h) const
+    {return h.index < generations.size() && generations[h.index] == h.generation;}
+
+    process_state get_state(std::uint32_t i) const {return static_cast<process_state>(states[i]);}
+    pid_t get_pid(std::uint32_t i) const {return pids[i];}
+    int get_exitcode(std::uint32_t i) const {return exitcodes[i];}
+    int get_termsignal(std::uint32_t i) const {return termsigs[i];}
+    time_t get_starttime(std::uint32_t i) const {return starttimes[i];}
+    std::uint32_t get_owner(std::uint32_t i) const {return owners[i];}
+    bool is_exist(std::uint32_t i) const
+    {return get_state(i) == process_state::RUNNING || get_state(i) == process_state::STOPPED;}
+    bool is_exited(std::uint32_t i) const {return get_state(i) == process_state::EXITED;}
+
+    void set_started(std::uint32_t i, pid_t pid);
+    // Applies a waitpid() status of the process reaped by the caller
+    void set_status(std::uint32_t i, int status);
+    // Returns the pid of the signaled process, the caller must reap it
+    // unless sig is SIGKILL
+    pid_t stop(std::uint32_t i, int sig = SIGTERM) noexcept;
+    int signal(std::uint32_t i, int sig);
+
+    std::size_t size() const {return states.size();}
+    static constexpr std::size_t row_size()
+    {return sizeof(std::uint8_t) + sizeof(pid_t) + 2 * sizeof(int) +
+            sizeof(time_t) + 2 * sizeof(std::uint32_t);}
+    std::size_t memory_usage() const;
+private:
+    void grow_table(std::size_t rows);
+    void init_rows(std::uint32_t first, std::uint32_t count, std::uint32_t owner);
+    // Returns the rows to the free list, their processes are left alone
+    void free_rows(std::uint32_t first, std::uint32_t count) noexcept;
+    std::vector<std::uint8_t> states;     // process_state
+    std::vector<pid_t> pids;
+    std::vector<int> exitcodes;
+    std::vector<int> termsigs;            // Or the stop signal while STOPPED
+    std::vector<time_t> starttimes;
+    std::vector<std::uint32_t> owners;
+    std::vector<std::uint32_t> generations;
+    std::vector<slice> free_slices;       // Sorted by first
+    std::uint32_t last_owner = 0;
+};
+
+#endif // PROCESS_TABLE_HPP
@@ -0,0 +1,257 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "protocol.hpp"
+
+using namespace std;
+
+namespace wire{
+
+buffer_pool &buffer_pool::instance()
+{
+    // Outlives the sockets, zmq may release a buffer on its own thread
+    static buffer_pool *pool = new buffer_pool;
+    return *pool;
+}
+
+vector<char> *buffer_pool::acquire()
+{
+    lock_guard<mutex> lock(buffers_mutex);
+    if (buffers.empty()) return new vector<char>;
+    auto buf = buffers.back().release();
+    buffers.pop_back();
+    return buf;
+}
+
+void buffer_pool::release(vector<char> *buf) noexcept
+{
+    unique_ptr<vector<char>> owned(buf);
+    // A large status reply does not pin its memory
+    if (buf->capacity() > MAX_KEPT_CAPACITY) return;
+    buf->clear();
+    lock_guard<mutex> lock(buffers_mutex);
+    if (buffers.size() < MAX_FREE) buffers.push_back(move(owned));
+}
+
+writer::writer(msg_type type) : buf(buffer_pool::instance().acquire())
+{
+    buf->resize(HEADER_SIZE);
+    (*buf)[0] = static_cast<char>(MAGIC);
+    (*buf)[1] = static_cast<char>(VERSION);
+    (*buf)[2] = static_cast<char>(type);
+    (*buf)[3] = 0;
+}
+
+writer::~writer()
+{
+    if (buf) buffer_pool::instance().release(buf);
+}
+
+writer &writer::put(uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) buf->push_back(static_cast<char>(value >> (8 * i)));
+    return *this;
+}
+
+writer &writer::f64(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return put(bits, 8);
+}
+
+writer &writer::str(const char *data, size_t size)
+{
+    if (size > UINT32_MAX) throw runtime_error("string too long");
+    put(size, 4);
+    buf->insert(buf->end(), data, data + size);
+    return *this;
+}
+
+zmq::message_t writer::finish()
+{
+    uint32_t length = static_cast<uint32_t>(buf->size() - HEADER_SIZE);
+    for (int i = 0; i < 4; ++i) (*buf)[4 + i] = static_cast<char>(length >> (8 * i));
+    auto release = [](void *, void *hint) {
+        buffer_pool::instance().release(static_cast<vector<char> *>(hint));
+    };
+    vector<char> *sent = buf;
+    buf = nullptr;
+    return zmq::message_t(sent->data(), sent->size(), release, sent);
+}
+
+reader::reader(const void *data, size_t size) :
+    pos(static_cast<const unsigned char *>(data)), end(pos + size)
+{
+    if (size < HEADER_SIZE || pos[0] != MAGIC)
+        throw runtime_error("not a taskmaster message");
+    if (pos[1] != VERSION)
+        throw runtime_error("protocol version " + to_string(pos[1]) +
+                            ", expected " + to_string(VERSION));
+    msg = static_cast<msg_type>(pos[2]);
+    pos += 4;
+    if (u32() != size - HEADER_SIZE) throw runtime_error("bad message length");
+}
+
+uint64_t reader::get(int bytes)
+{
+    if (end - pos < bytes) throw runtime_error("truncated message");
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) value |= static_cast<uint64_t>(pos[i]) << (8 * i);
+    pos += bytes;
+    return value;
+}
+
+double reader::f64()
+{
+    uint64_t bits = get(8);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+string reader::str()
+{
+    uint32_t size = u32();
+    if (static_cast<size_t>(end - pos) < size) throw runtime_error("truncated message");
+    string value(reinterpret_cast<const char *>(pos), size);
+    pos += size;
+    return value;
+}
+
+uint32_t reader::count(size_t min_size)
+{
+    uint32_t n = u32();
+    if (n > static_cast<size_t>(end - pos) / min_size)
+        throw runtime_error("truncated message");
+    return n;
+}
+
+// Smallest encoded proc_report and task_report, they bound the counts
+static constexpr size_t PROC_MIN_SIZE = 6 * 4 + 1 + 8 * 8;
+static constexpr size_t TASK_MIN_SIZE = 10 * 4 + 12 * 8;
+
+// json is not sent, the client renders the reply
+void write_query(writer &w, const status_query &query)
+{
+    w.str(query.pattern).u32(query.states).u8(query.failed).u32(query.offset).
+      u32(query.limit);
+}
+
+void read_query(reader &r, status_query &query)
+{
+    query.pattern = r.str();
+    query.states = r.u32();
+    query.failed = r.u8();
+    query.offset = r.u32();
+    query.limit = r.u32();
+}
+
+void write_status(writer &w, const status_report &report)
+{
+    w.u8(report.all).u8(report.startup_pending).u64(report.spawns_queued).
+      u64(report.procs_starting).u64(report.startup_ms).i64(report.now);
+    w.u64(report.total).u64(report.offset).u64(report.count);
+    w.u32(report.tasks.size());
+    for (auto &t : report.tasks) {
+        w.str(t.name).u32(t.state).u64(t.memory).u32(t.row_size).u32(t.zygote_pid);
+        w.str(t.cgroup).u64(t.cgroup_stats.usage_usec).u64(t.cgroup_stats.memory).
+          u64(t.cgroup_stats.memory_peak).u64(t.cgroup_stats.pids);
+        w.u64(t.watchdog_actions).str(t.watchdog_reason).str(t.error);
+        w.u64(t.crash_loops).f64(t.retry_in).f64(t.resume_in).str(t.waiting_for);
+        w.u64(t.liveness_restarts).str(t.probe_error);
+        w.i64(t.starttime).u64(t.starttries);
+        w.u32(t.procs.size());
+        for (auto &p : t.procs) {
+            uint32_t flags = p.running | p.exited << 1;
+            w.u32(flags).u32(p.pid).u32(p.exitcode).str(p.cpus).u32(p.node);
+            auto &use = p.use;
+            w.u8(use.valid).f64(use.cpu).f64(use.cpu_avg).u64(use.rss).
+              f64(use.rss_avg).u64(use.read_bytes).u64(use.write_bytes).u64(use.fds);
+            w.f64(p.restart_in).u32(p.backoff);
+        }
+    }
+}
+
+void read_status(reader &r, status_report &report)
+{
+    report.all = r.u8();
+    report.startup_pending = r.u8();
+    report.spawns_queued = r.u64();
+    report.procs_starting = r.u64();
+    report.startup_ms = r.u64();
+    report.now = r.i64();
+    report.total = r.u64();
+    report.offset = r.u64();
+    report.count = r.u64();
+    report.tasks.resize(r.count(TASK_MIN_SIZE));
+    for (auto &t : report.tasks) {
+        t.name = r.str();
+        t.state = r.u32();
+        t.memory = r.u64();
+        t.row_size = r.u32();
+        t.zygote_pid = r.u32();
+        t.cgroup = r.str();
+        t.cgroup_stats.usage_usec = r.u64();
+        t.cgroup_stats.memory = r.u64();
+        t.cgroup_stats.memory_peak = r.u64();
+        t.cgroup_stats.pids = r.u64();
+        t.watchdog_actions = r.u64();
+        t.watchdog_reason = r.str();
+        t.error = r.str();
+        t.crash_loops = r.u64();
+        t.retry_in = r.f64();
+        t.resume_in = r.f64();
+        t.waiting_for = r.str();
+        t.liveness_restarts = r.u64();
+        t.probe_error = r.str();
+        t.starttime = r.i64();
+        t.starttries = r.u64();
+        t.procs.resize(r.count(PROC_MIN_SIZE));
+        for (auto &p : t.procs) {
+            uint32_t flags = r.u32();
+            p.running = flags & 1;
+            p.exited = flags & 2;
+            p.pid = r.u32();
+            p.exitcode = static_cast<int32_t>(r.u32());
+            p.cpus = r.str();
+            p.node = static_cast<int32_t>(r.u32());
+            auto &use = p.use;
+            use.valid = r.u8();
+            use.cpu = r.f64();
+            use.cpu_avg = r.f64();
+            use.rss = r.u64();
+            use.rss_avg = r.f64();
+            use.read_bytes = r.u64();
+            use.write_bytes = r.u64();
+            use.fds = r.u64();
+            p.restart_in = r.f64();
+            p.backoff = r.u32();
+        }
+    }
+}
+
+void write_event(writer &w, const task_event &event)
+{
+    w.u8(event.kind).u64(event.seq).u64(event.task_seq).i64(event.time_us);
+    w.str(event.task).u32(event.state).u32(event.replica).u32(event.pid).
+      u32(event.code).i64(event.starttime);
+}
+
+void read_event(reader &r, task_event &event)
+{
+    uint8_t kind = r.u8();
+    if (kind > task_event::PROC_SIGNAL) throw runtime_error("invalid event kind");
+    event.kind = static_cast<task_event::kind_t>(kind);
+    event.seq = r.u64();
+    event.task_seq = r.u64();
+    event.time_us = r.i64();
+    event.task = r.str();
+    event.state = r.u32();
+    event.replica = r.u32();
+    event.pid = r.u32();
+    event.code = static_cast<int32_t>(r.u32());
+    event.starttime = r.i64();
+}
+
+} // namespace wire
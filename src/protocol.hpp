@@ -0,0 +1,125 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <zmq.hpp>
+
+#include "status_report.hpp"
+
+/*
+ * Control protocol between the CLI and the daemon. A message is a header
+ *   u8 magic, u8 version, u8 type, u8 reserved, u32 payload length
+ * followed by typed fields. Integers are little-endian, a double is sent
+ * as the bits of a u64 and a string as a u32 length and its bytes.
+ * Targets of a command are a u32 count and as many strings.
+ * The reader checks every field against the payload, a malformed message
+ * throws instead of being read past its end.
+ */
+namespace wire{
+
+constexpr std::uint8_t MAGIC = 0x54;
+constexpr std::uint8_t VERSION = 2;
+constexpr std::size_t HEADER_SIZE = 8;
+
+enum class msg_type : std::uint8_t {
+    REQ_START = 1,                           // targets, replied by REP_JOB
+    REQ_STOP,                                // targets, replied by REP_JOB
+    REQ_RESTART,                             // targets, replied by REP_JOB
+    REQ_STATUS,                              // status_query, u64 cursor
+    REQ_RELOAD_CONFIG,                       // targets: the file or none
+    REQ_EXIT,
+    REQ_TAIL,                                // str name, u64 backlog, cursors
+    REQ_JOB,                                 // u64 id, u8 wait
+    REQ_PLAN_RELOAD,                         // str file
+    REP_TEXT = 64,                           // str text
+    REP_ERR,                                 // str text
+    REP_TAIL,                                // cursors, str output
+    REP_STATUS,                              // status_report, a page chunk
+    REP_JOB,                                 // u64 id
+    REP_JOB_STATE,                           // u64 id, u8 state, str result
+    EVENT = 128                              // task_event, on the PUB socket
+};
+inline bool is_request(msg_type type)
+{return type >= msg_type::REQ_START && type <= msg_type::REQ_PLAN_RELOAD;}
+inline bool is_reply(msg_type type)
+{return type >= msg_type::REP_TEXT && type <= msg_type::REP_JOB_STATE;}
+// Read-only requests are answered before the commands queued with them
+inline bool is_read_only(msg_type type)
+{return type == msg_type::REQ_STATUS || type == msg_type::REQ_TAIL ||
+        type == msg_type::REQ_JOB || type == msg_type::REQ_PLAN_RELOAD;}
+
+// Buffers of outgoing messages, zmq gives them back once they are sent
+class buffer_pool
+{
+public:
+    static buffer_pool &instance();
+    std::vector<char> *acquire();
+    void release(std::vector<char> *buf) noexcept;
+private:
+    buffer_pool() = default;
+    static constexpr std::size_t MAX_FREE = 16;
+    static constexpr std::size_t MAX_KEPT_CAPACITY = 1024 * 1024;
+    std::mutex buffers_mutex;
+    std::vector<std::unique_ptr<std::vector<char>>> buffers;
+};
+
+// Builds a message in a pooled buffer
+class writer
+{
+public:
+    explicit writer(msg_type type);
+    ~writer();
+    writer(const writer &) = delete;
+    writer& operator=(const writer &) = delete;
+
+    writer &u8(std::uint8_t value) {return put(value, 1);}
+    writer &u32(std::uint32_t value) {return put(value, 4);}
+    writer &u64(std::uint64_t value) {return put(value, 8);}
+    writer &i64(std::int64_t value) {return put(static_cast<std::uint64_t>(value), 8);}
+    writer &f64(double value);
+    writer &str(const std::string &value) {return str(value.data(), value.size());}
+    writer &str(const char *data, std::size_t size);
+    // Hands the buffer to zmq without a copy, the writer is empty after it
+    zmq::message_t finish();
+private:
+    writer &put(std::uint64_t value, int bytes);
+    std::vector<char> *buf;
+};
+
+class reader
+{
+public:
+    // Checks the header, throws if it does not match the size
+    reader(const void *data, std::size_t size);
+    msg_type type() const {return msg;}
+
+    std::uint8_t u8() {return static_cast<std::uint8_t>(get(1));}
+    std::uint32_t u32() {return static_cast<std::uint32_t>(get(4));}
+    std::uint64_t u64() {return get(8);}
+    std::int64_t i64() {return static_cast<std::int64_t>(get(8));}
+    double f64();
+    std::string str();
+    // Reads an element count, each element takes at least min_size bytes
+    std::uint32_t count(std::size_t min_size);
+private:
+    std::uint64_t get(int bytes);
+    const unsigned char *pos;
+    const unsigned char *end;
+    msg_type msg;
+};
+
+void write_query(writer &w, const status_query &query);
+void read_query(reader &r, status_query &query);
+void write_status(writer &w, const status_report &report);
+void read_status(reader &r, status_report &report);
+void write_event(writer &w, const task_event &event);
+void read_event(reader &r, task_event &event);
+
+} // namespace wire
+
+#endif // PROTOCOL_HPP
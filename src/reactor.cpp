@@ -0,0 +1,70 @@
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <array>
+#include <string>
+#include <stdexcept>
+
+#include "reactor.hpp"
+
+using namespace std;
+
+reactor::reactor() : epoll_fd(epoll_create1(EPOLL_CLOEXEC))
+{
+    if (epoll_fd == -1)
+        throw runtime_error(string("epoll_create1: ") + strerror(errno));
+}
+
+reactor::~reactor()
+{
+    close(epoll_fd);
+}
+
+void reactor::add(int fd, uint32_t events, handler func)
+{
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev))
+        throw runtime_error(string("epoll_ctl: ") + strerror(errno));
+    handlers[fd] = move(func);
+}
+
+void reactor::modify(int fd, uint32_t events)
+{
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev))
+        throw runtime_error(string("epoll_ctl: ") + strerror(errno));
+}
+
+void reactor::remove(int fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    handlers.erase(fd);
+}
+
+void reactor::run()
+{
+    running = true;
+    while (running) run_once();
+}
+
+int reactor::run_once(int timeout)
+{
+    array<epoll_event, 64> events;
+    int n = epoll_wait(epoll_fd, events.data(), events.size(), timeout);
+    if (n == -1) {
+        if (errno == EINTR) return 0;
+        throw runtime_error(string("epoll_wait: ") + strerror(errno));
+    }
+    for (int i = 0; i < n; ++i) {
+        // A previous handler may have removed the descriptor
+        auto h = handlers.find(events[i].data.fd);
+        if (h == handlers.end()) continue;
+        handler func = h->second;
+        func(events[i].events);
+    }
+    return n;
+}
@@ -0,0 +1,35 @@
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#include <sys/epoll.h>
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+// Single-threaded epoll event loop, every handler runs on the loop thread
+class reactor
+{
+public:
+    using handler = std::function<void(std::uint32_t events)>;
+
+    reactor();
+    ~reactor();
+    reactor(const reactor &) = delete;
+    reactor& operator=(const reactor &) = delete;
+
+    void add(int fd, std::uint32_t events, handler func);
+    void modify(int fd, std::uint32_t events);
+    void remove(int fd);
+    // Dispatches events until stop() is called
+    void run();
+    // Waits at most timeout milliseconds, returns the number of events
+    int run_once(int timeout = -1);
+    void stop() {running = false;}
+private:
+    int epoll_fd;
+    bool running = false;
+    std::unordered_map<int, handler> handlers;
+};
+
+#endif // REACTOR_HPP
@@ -0,0 +1,112 @@
+#include <csignal>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "runtime.hpp"
+
+using namespace std;
+
+runtime::~runtime()
+{
+    for (auto &p : stopping) {
+        kill(p.first, SIGKILL);
+        waitpid(p.first, nullptr, 0);
+    }
+}
+
+void runtime::watch(pid_t pid, child_handler handler)
+{
+    auto early = early_exits.find(pid);
+    if (early != early_exits.end()) {
+        int status = early->second.status;
+        early_exits.erase(early);
+        timers.add(chrono::milliseconds(0),
+                   [handler = move(handler), status]() {handler(status);});
+        return;
+    }
+    children[pid] = move(handler);
+    sampler.add(pid);
+}
+
+void runtime::unwatch(pid_t pid)
+{
+    children.erase(pid);
+    sampler.remove(pid);
+}
+
+void runtime::stop_later(pid_t pid, time_t stoptime, child_handler reaped)
+{
+    // The pid is not reaped before the timer fires, so it cannot be reused
+    stopping[pid] = timers.add(stoptime, [pid]() {kill(pid, SIGKILL);});
+    watch(pid, [this, pid, reaped = move(reaped)](int status) {
+        if (WIFSTOPPED(status) || WIFCONTINUED(status)) return;
+        timers.cancel(stopping[pid]);
+        stopping.erase(pid);
+        if (reaped) reaped(status);
+    });
+}
+
+size_t runtime::reap()
+{
+    size_t reaped = 0;
+    int status;
+    pid_t pid;
+    // Only the children that changed state are visited
+    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {
+        ++reaped;
+        auto child = children.find(pid);
+        if (child == children.end()) {
+            uint64_t spawning = spawns.launching();
+            if (spawning && !WIFSTOPPED(status)) early_exits[pid] = {status, spawning};
+            continue;
+        }
+        child_handler handler;
+        if (WIFSTOPPED(status)) {
+            handler = child->second;
+        } else {
+            handler = move(child->second);
+            children.erase(child);
+            sampler.remove(pid);
+        }
+        handler(status);
+    }
+    if (reaped && !retired.empty()) {
+        auto gone = remove_if(retired.begin(), retired.end(),
+                              [](const shared_ptr<cgroup> &c) {return c->remove();});
+        retired.erase(gone, retired.end());
+    }
+    for (auto it = early_exits.begin(); it != early_exits.end();) {
+        if (spawns.is_completed(it->second.spawns)) it = early_exits.erase(it);
+        else ++it;
+    }
+    return reaped;
+}
+
+shared_ptr<cgroup> runtime::cgroup_root()
+{
+    if (!cgroups_probed) {
+        cgroups_probed = true;
+        cgroups = cgroup::delegated(cgroup_error);
+        if (cgroups)
+            clog << "cgroups: tasks are placed under " << cgroups->get_path() << endl;
+        else
+            clog << "Warning: cgroups are not available: " << cgroup_error << endl;
+    }
+    return cgroups;
+}
+
+void runtime::retire(shared_ptr<cgroup> group)
+{
+    if (group && !group->remove()) retired.push_back(move(group));
+}
+
+void runtime::reuse(const cgroup &group)
+{
+    const string &path = group.get_path();
+    auto used = remove_if(retired.begin(), retired.end(),
+                          [&path](const shared_ptr<cgroup> &c) {return c->get_path() == path;});
+    retired.erase(used, retired.end());
+}
@@ -0,0 +1,90 @@
+#ifndef RUNTIME_HPP
+#define RUNTIME_HPP
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "timer_wheel.hpp"
+#include "spawner.hpp"
+#include "log_writer.hpp"
+#include "cgroup.hpp"
+#include "proc_sampler.hpp"
+#include "process_table.hpp"
+#include "event_stream.hpp"
+#include "prober.hpp"
+
+// Services of the daemon shared by all tasks
+class runtime
+{
+public:
+    runtime() = default;
+    ~runtime();
+    runtime(const runtime &) = delete;
+    runtime& operator=(const runtime &) = delete;
+
+    // Is called with the waitpid() status of the child
+    using child_handler = std::function<void(int status)>;
+
+    timer_wheel timers;
+    process_table procs;                     // Replicas of all tasks
+    log_writer logs;                         // Used by the spawner workers
+    spawner spawns{timers};
+    proc_sampler sampler;                    // Samples every watched child
+    event_stream events;                     // Transitions of tasks and replicas
+    prober probes{timers, [this](pid_t pid, child_handler handler) {
+        watch(pid, std::move(handler));
+    }};
+
+    // Registers the owner of a child, the handler is dropped once the child
+    // is reaped. A child that was reaped before it was watched (a replica
+    // that exits before its spawn is completed) is delivered from the
+    // timer wheel, zygote replicas included.
+    void watch(pid_t pid, child_handler handler);
+    void unwatch(pid_t pid);
+    // Sends SIGKILL to a stopped process if it is still alive after stoptime,
+    // reaped is called once it is gone
+    void stop_later(pid_t pid, time_t stoptime, child_handler reaped = nullptr);
+    // Reaps every child that changed state and notifies its owner,
+    // returns the number of reaped children
+    std::size_t reap();
+    std::size_t stopping_count() const {return stopping.size();}
+    bool is_stopping(pid_t pid) const {return stopping.count(pid);}
+    // The delegated cgroup of the daemon, set up on the first call.
+    // Returns nullptr if cgroups are not available, see cgroup_error
+    std::shared_ptr<cgroup> cgroup_root();
+    const std::string &get_cgroup_error() const {return cgroup_error;}
+    // Keeps a group until its last process is reaped, then removes it
+    void retire(std::shared_ptr<cgroup> group);
+    // Takes back a retired group that a new task uses again
+    void reuse(const cgroup &group);
+    // Name of the leaves of a new run, unique across tasks so that a
+    // replaced task never shares a leaf with the old one
+    std::string next_leaf() {return "run" + std::to_string(++leaf_runs);}
+private:
+    std::unordered_map<pid_t, child_handler> children;
+    std::unordered_map<pid_t, timer_wheel::timer_id> stopping;
+    struct early_exit
+    {
+        int status;
+        std::uint64_t spawns;                // spawner::launching() when reaped
+    };
+    // Children reaped while a spawn was in flight, kept until the spawns
+    // that may report them are completed. Other unknown children (orphans
+    // of a replica, a zygote template) are dropped, so a reused pid never
+    // gets a stale status
+    std::unordered_map<pid_t, early_exit> early_exits;
+    std::shared_ptr<cgroup> cgroups;
+    bool cgroups_probed = false;
+    std::string cgroup_error;
+    std::vector<std::shared_ptr<cgroup>> retired;   // Children before parents
+    std::uint64_t leaf_runs = 0;
+};
+
+#endif // RUNTIME_HPP
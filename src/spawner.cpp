@@ -0,0 +1,174 @@
+#include <unistd.h>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "spawner.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr milliseconds SPAWN_BACKOFF_MIN(10);
+static constexpr milliseconds SPAWN_BACKOFF_MAX(1000);
+
+spawner::spawner(timer_wheel &timers) :
+    timers(timers), efd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (efd == -1)
+        throw runtime_error(string("eventfd: ") + strerror(errno));
+}
+
+spawner::~spawner()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    cond.notify_all();
+    for (auto &t : threads) t.join();
+    for (auto &j : done) if (j.pid > 0) kill(j.pid, SIGKILL);
+    timers.cancel(dispatch_timer);
+    close(efd);
+}
+
+void spawner::configure(size_t workers, double spawn_rate, size_t starting_limit)
+{
+    rate = spawn_rate;
+    tokens = max(rate, 1.0);
+    refill = steady_clock::now();
+    max_starting = starting_limit;
+    workers = max<size_t>(workers, 1);
+    // Workers must not receive the signals read by the event loop
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    while (threads.size() < workers) threads.emplace_back(&spawner::worker, this);
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    dispatch();
+}
+
+uint64_t spawner::submit(launch_func launch, bool hold, done_func done)
+{
+    uint64_t id = ++last_id;
+    callbacks.emplace(id, move(done));
+    pending.push_back({id, move(launch), hold});
+    dispatch();
+    return id;
+}
+
+void spawner::cancel(uint64_t id)
+{
+    callbacks.erase(id);
+}
+
+void spawner::release(size_t slots)
+{
+    held -= min(held, slots);
+    dispatch();
+}
+
+void spawner::complete()
+{
+    uint64_t count;
+    while (read(efd, &count, sizeof(count)) > 0);
+    vector<job> finished;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        finished.swap(done);
+    }
+    for (auto &j : finished) {
+        in_flight.erase(j.id);
+        if (j.pid == -1 && j.err == EAGAIN) {
+            // The kernel is out of processes, retry later in the same order
+            backoff = clamp(backoff * 2, SPAWN_BACKOFF_MIN, SPAWN_BACKOFF_MAX);
+            paused_until = steady_clock::now() + backoff;
+            if (j.hold) --held;
+            j.pid = -1;
+            j.err = 0;
+            pending.push_front(move(j));
+            continue;
+        }
+        if (j.pid != -1) backoff = milliseconds(0);
+        auto cb = callbacks.find(j.id);
+        if (cb == callbacks.end()) {
+            // Cancelled, the child is reaped as an unknown pid
+            if (j.pid != -1) kill(j.pid, SIGKILL);
+            if (j.hold) --held;
+            continue;
+        }
+        auto func = move(cb->second);
+        callbacks.erase(cb);
+        if (j.pid == -1 && j.hold) --held;
+        func(j.pid, j.err);
+    }
+    dispatch();
+}
+
+/*
+ * Private
+ */
+
+void spawner::dispatch()
+{
+    if (threads.empty()) return;
+    auto now = steady_clock::now();
+    if (now < paused_until) {
+        schedule_dispatch(ceil<milliseconds>(paused_until - now));
+        return;
+    }
+    if (rate > 0) {
+        tokens = min(max(rate, 1.0), tokens + duration<double>(now - refill).count() * rate);
+        refill = now;
+    }
+    vector<job> batch;
+    while (!pending.empty()) {
+        if (!callbacks.count(pending.front().id)) {
+            pending.pop_front();
+            continue;
+        }
+        if (rate > 0 && tokens < 1) {
+            schedule_dispatch(ceil<milliseconds>(duration<double>((1 - tokens) / rate)));
+            break;
+        }
+        if (pending.front().hold && max_starting && held >= max_starting)
+            break;                           // Resumed by release()
+        if (rate > 0) tokens -= 1;
+        if (pending.front().hold) ++held;
+        in_flight.insert(pending.front().id);
+        batch.push_back(move(pending.front()));
+        pending.pop_front();
+    }
+    if (batch.empty()) return;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        for (auto &j : batch) work.push_back(move(j));
+    }
+    cond.notify_all();
+}
+
+void spawner::schedule_dispatch(milliseconds delay)
+{
+    if (timers.is_pending(dispatch_timer)) return;
+    dispatch_timer = timers.add(delay, [this]() {dispatch();});
+}
+
+void spawner::worker()
+{
+    unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [this]() {return quit || !work.empty();});
+        if (quit) return;
+        job j = move(work.front());
+        work.pop_front();
+        lock.unlock();
+        j.pid = j.launch(j.err);
+        lock.lock();
+        done.push_back(move(j));
+        uint64_t one = 1;
+        if (write(efd, &one, sizeof(one))) {}
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef SPAWNER_HPP
+#define SPAWNER_HPP
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "timer_wheel.hpp"
+
+/*
+ * Starts processes on a small pool of worker threads.
+ * Spawns are dispatched at most 'rate' per second and while fewer than
+ * 'max_starting' processes hold a STARTING slot. EAGAIN from the kernel
+ * pauses the dispatch with an exponential backoff instead of retrying
+ * in place. Completions run on the thread that calls complete().
+ */
+class spawner
+{
+public:
+    // Runs on a worker thread, returns the pid or -1 and sets err
+    using launch_func = std::function<pid_t(int &err)>;
+    // Is called with the pid or with -1 and the errno of the failed spawn
+    using done_func = std::function<void(pid_t pid, int err)>;
+
+    spawner(timer_wheel &timers);
+    ~spawner();
+    spawner(const spawner &) = delete;
+    spawner& operator=(const spawner &) = delete;
+
+    // 0 disables the limit
+    void configure(std::size_t workers, double rate, std::size_t max_starting);
+    // A 'hold' spawn keeps a STARTING slot until release() is called
+    std::uint64_t submit(launch_func launch, bool hold, done_func done);
+    // The callback is dropped, a process started anyway is killed
+    void cancel(std::uint64_t id);
+    void release(std::size_t slots);
+    // Readable when completions are ready
+    int event_fd() const {return efd;}
+    void complete();
+
+    std::size_t queued() const {return pending.size();}
+    std::size_t starting() const {return held;}
+    // A started process may be reaped before its spawn is completed.
+    // Returns a mark of the spawns given to the workers, 0 if there are none
+    std::uint64_t launching() const {return in_flight.empty() ? 0 : *in_flight.rbegin();}
+    // Every spawn of the mark is completed
+    bool is_completed(std::uint64_t mark) const
+    {
+        return in_flight.empty() || *in_flight.begin() > mark;
+    }
+private:
+    struct job {
+        std::uint64_t id;
+        launch_func launch;
+        bool hold;
+        pid_t pid = -1;
+        int err = 0;
+    };
+
+    void dispatch();
+    void schedule_dispatch(std::chrono::milliseconds delay);
+    void worker();
+
+    timer_wheel &timers;
+    int efd;
+    std::uint64_t last_id = 0;
+    std::unordered_map<std::uint64_t, done_func> callbacks;
+    std::deque<job> pending;                 // Waiting for the limits
+    std::set<std::uint64_t> in_flight;       // Given to the workers
+    std::size_t held = 0;                    // STARTING slots
+    std::size_t max_starting = 0;
+    double rate = 0;
+    double tokens = 0;
+    std::chrono::steady_clock::time_point refill;
+    std::chrono::milliseconds backoff{0};    // After EAGAIN
+    std::chrono::steady_clock::time_point paused_until;
+    timer_wheel::timer_id dispatch_timer;
+
+    // Shared with the workers
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<job> work;
+    std::vector<job> done;
+    bool quit = false;
+    std::vector<std::thread> threads;
+};
+
+#endif // SPAWNER_HPP
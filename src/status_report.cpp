@@ -0,0 +1,366 @@
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "status_report.hpp"
+#include "task.hpp"
+
+using namespace std;
+
+static map<int, string> _states_map = {
+    {task_status::STOPPED,  "stoppped"},
+    {task_status::STARTING, "starting"},
+    {task_status::RUNNING,  "running"},
+    {task_status::EXITED,   "exited"},
+    {task_status::FATAL,    "fatal"},
+    {task_status::BACKOFF,  "backoff (crash loop)"},
+    {task_status::ERROR,    "process start error"},
+    {task_status::UNKNOWN,  "unknown (fatal error)"}
+};
+
+// Names accepted by status --state
+static const map<string, int> _state_names_map = {
+    {"stopped",  task_status::STOPPED},
+    {"starting", task_status::STARTING},
+    {"running",  task_status::RUNNING},
+    {"exited",   task_status::EXITED},
+    {"fatal",    task_status::FATAL},
+    {"backoff",  task_status::BACKOFF},
+    {"error",    task_status::ERROR},
+    {"unknown",  task_status::UNKNOWN}
+};
+
+int parse_state_name(const string &name)
+{
+    auto it = _state_names_map.find(name);
+    return it == _state_names_map.end() ? -1 : it->second;
+}
+
+// Machine readable name of a state
+static string _state_name(int state)
+{
+    for (auto &name : _state_names_map)
+        if (name.second == state) return name.first;
+    return "unknown";
+}
+
+bool is_failed_state(int state)
+{
+    return state == task_status::FATAL || state == task_status::ERROR ||
+           state == task_status::BACKOFF || state == task_status::UNKNOWN;
+}
+
+static void _render_task(const task_report &t, time_t now, ostringstream &s)
+{
+    s << t.name << ":\n";
+    s << "  state: " << _states_map[t.state] + "\n";
+    s << "  memory: " << t.memory << " bytes, " << t.row_size <<
+         " bytes per process" << endl;
+    if (t.zygote_pid)
+        s << "  zygote pid: " << t.zygote_pid << endl;
+    if (!t.cgroup.empty()) {
+        auto &st = t.cgroup_stats;
+        s << "  cgroup: " << t.cgroup << endl <<
+             "    cpu: " << st.usage_usec / 1000 << " ms, memory: " <<
+             st.memory << " bytes, peak: " << st.memory_peak <<
+             " bytes, pids: " << st.pids << endl;
+    }
+    if (t.watchdog_actions)
+        s << "  watchdog: " << t.watchdog_actions << " actions, last: " <<
+             t.watchdog_reason << endl;
+    if (t.state == task_status::ERROR && !t.error.empty())
+        s << "  error: " << t.error << endl;
+    if (!t.waiting_for.empty())
+        s << "  waiting for: " << t.waiting_for << endl;
+    if (t.liveness_restarts)
+        s << "  liveness restarts: " << t.liveness_restarts << endl;
+    if (!t.probe_error.empty())
+        s << "  last probe failure: " << t.probe_error << endl;
+    s << fixed << setprecision(1);
+    if (t.crash_loops)
+        s << "  crash loops: " << t.crash_loops << endl;
+    if (t.retry_in >= 0)
+        s << "  retry in: " << t.retry_in << "s" << endl;
+    if (t.resume_in >= 0)
+        s << "  restarts resume in: " << t.resume_in << "s" << endl;
+    s.unsetf(ios::floatfield);
+    if (t.state != task_status::STARTING && t.state != task_status::RUNNING &&
+        t.state != task_status::BACKOFF)
+        return;
+    time_t starttime = t.starttime;
+    s << "  starttime: " << ctime(&starttime) <<
+         "  run time: " << now - starttime << "s" << endl <<
+         "  starttries: " << t.starttries << endl <<
+         "  procs:" << endl;
+    for (size_t i = 0; i < t.procs.size(); ++i) {
+        auto &p = t.procs[i];
+        s << "    " << i << ":" << endl;
+        if (p.running) {
+            s << "      state: running" << endl;
+            s << "      pid: " << p.pid << endl;
+            if (!p.cpus.empty()) {
+                s << "      cpus: " << p.cpus;
+                if (p.node >= 0) s << " (node " << p.node << ")";
+                s << endl;
+            }
+            auto &use = p.use;
+            if (use.valid) {
+                s << fixed << setprecision(1) <<
+                     "      cpu: " << use.cpu << "% (avg " << use.cpu_avg <<
+                     "%), rss: " << use.rss / 1024 << " KiB (avg " <<
+                     use.rss_avg / 1024 << " KiB)" << endl <<
+                     "      io: read " << use.read_bytes << " bytes, written " <<
+                     use.write_bytes << " bytes, fds: " << use.fds << endl;
+                s.unsetf(ios::floatfield);
+            }
+        } else {
+            s << "      state: not running" << endl;
+            if (p.exited)
+                s << "      exitcode: " << p.exitcode << endl;
+            if (p.restart_in >= 0)
+                s << fixed << setprecision(1) << "      restart in: " <<
+                     p.restart_in << "s (backoff " << p.backoff << ")" << endl;
+            s.unsetf(ios::floatfield);
+        }
+    }
+}
+
+using json_writer = rapidjson::Writer<rapidjson::StringBuffer>;
+
+static void _json_seconds(json_writer &w, const char *key, double seconds)
+{
+    w.Key(key);
+    if (seconds < 0) w.Null();
+    else w.Double(seconds);
+}
+
+static void _json_task(const task_report &t, json_writer &w)
+{
+    w.StartObject();
+    w.Key("name");
+    w.String(t.name.c_str(), t.name.size());
+    w.Key("state");
+    w.String(_state_name(t.state).c_str());
+    w.Key("memory");
+    w.Uint64(t.memory);
+    w.Key("zygote_pid");
+    w.Int(t.zygote_pid);
+    if (!t.cgroup.empty()) {
+        w.Key("cgroup");
+        w.StartObject();
+        w.Key("path");
+        w.String(t.cgroup.c_str(), t.cgroup.size());
+        w.Key("cpu_usec");
+        w.Uint64(t.cgroup_stats.usage_usec);
+        w.Key("memory");
+        w.Uint64(t.cgroup_stats.memory);
+        w.Key("memory_peak");
+        w.Uint64(t.cgroup_stats.memory_peak);
+        w.Key("pids");
+        w.Uint64(t.cgroup_stats.pids);
+        w.EndObject();
+    }
+    w.Key("watchdog_actions");
+    w.Uint64(t.watchdog_actions);
+    w.Key("watchdog_reason");
+    w.String(t.watchdog_reason.c_str(), t.watchdog_reason.size());
+    w.Key("error");
+    w.String(t.error.c_str(), t.error.size());
+    w.Key("crash_loops");
+    w.Uint64(t.crash_loops);
+    _json_seconds(w, "retry_in", t.retry_in);
+    _json_seconds(w, "resume_in", t.resume_in);
+    w.Key("waiting_for");
+    w.String(t.waiting_for.c_str(), t.waiting_for.size());
+    w.Key("liveness_restarts");
+    w.Uint64(t.liveness_restarts);
+    w.Key("probe_error");
+    w.String(t.probe_error.c_str(), t.probe_error.size());
+    w.Key("starttime");
+    w.Int64(t.starttime);
+    w.Key("starttries");
+    w.Uint64(t.starttries);
+    w.Key("procs");
+    w.StartArray();
+    for (auto &p : t.procs) {
+        w.StartObject();
+        w.Key("running");
+        w.Bool(p.running);
+        if (p.running) {
+            w.Key("pid");
+            w.Int(p.pid);
+        } else if (p.exited) {
+            w.Key("exitcode");
+            w.Int(p.exitcode);
+        }
+        if (!p.cpus.empty()) {
+            w.Key("cpus");
+            w.String(p.cpus.c_str(), p.cpus.size());
+            w.Key("node");
+            w.Int(p.node);
+        }
+        if (p.use.valid) {
+            w.Key("cpu");
+            w.Double(p.use.cpu);
+            w.Key("cpu_avg");
+            w.Double(p.use.cpu_avg);
+            w.Key("rss");
+            w.Uint64(p.use.rss);
+            w.Key("rss_avg");
+            w.Double(p.use.rss_avg);
+            w.Key("read_bytes");
+            w.Uint64(p.use.read_bytes);
+            w.Key("write_bytes");
+            w.Uint64(p.use.write_bytes);
+            w.Key("fds");
+            w.Uint(p.use.fds);
+        }
+        _json_seconds(w, "restart_in", p.restart_in);
+        w.Key("backoff");
+        w.Uint(p.backoff);
+        w.EndObject();
+    }
+    w.EndArray();
+    w.EndObject();
+}
+
+// The JSON document is {"startup": {...}, "total": N, "offset": N, "tasks": [...]},
+// the array is left open until finish()
+static string _json_header(const status_report &report)
+{
+    rapidjson::StringBuffer buf;
+    json_writer w(buf);
+    w.StartObject();
+    if (report.all) {
+        w.Key("startup");
+        w.StartObject();
+        w.Key("pending");
+        w.Bool(report.startup_pending);
+        w.Key("spawns_queued");
+        w.Uint64(report.spawns_queued);
+        w.Key("processes_starting");
+        w.Uint64(report.procs_starting);
+        w.Key("time_ms");
+        w.Uint64(report.startup_ms);
+        w.EndObject();
+    }
+    w.Key("total");
+    w.Uint64(report.total);
+    w.Key("offset");
+    w.Uint64(report.offset);
+    w.Key("tasks");
+    w.StartArray();
+    return string(buf.GetString(), buf.GetSize());
+}
+
+string status_renderer::render(const status_report &part)
+{
+    ostringstream s;
+    if (!started) {
+        started = true;
+        now = part.now;
+        if (json) {
+            s << _json_header(part);
+        } else if (part.all && !part.total) {
+            return "no tasks\n";
+        } else {
+            s << "status:\n";
+            if (part.all && part.startup_pending)
+                s << "startup: in progress, " << part.spawns_queued <<
+                     " spawns queued, " << part.procs_starting <<
+                     " processes starting\n";
+            else if (part.all)
+                s << "startup: all tasks started in " << part.startup_ms << " ms\n";
+            if (part.count < part.total)
+                s << "tasks: " << part.offset + 1 << "-" << part.offset + part.count <<
+                     " of " << part.total << "\n";
+        }
+    }
+    for (auto &t : part.tasks) {
+        if (!json) {
+            _render_task(t, now, s);
+            continue;
+        }
+        rapidjson::StringBuffer buf;
+        json_writer w(buf);
+        _json_task(t, w);
+        if (rendered++) s << ",";
+        s.write(buf.GetString(), buf.GetSize());
+    }
+    return s.str();
+}
+
+string status_renderer::finish()
+{
+    if (!json) return "";
+    return "]}\n";
+}
+
+static const char *_event_kinds[] = {"state", "spawn", "exit", "signal"};
+
+string render_event(const task_event &e, bool json)
+{
+    if (json) {
+        rapidjson::StringBuffer buf;
+        json_writer w(buf);
+        w.StartObject();
+        w.Key("seq");
+        w.Uint64(e.seq);
+        w.Key("task_seq");
+        w.Uint64(e.task_seq);
+        w.Key("time_us");
+        w.Int64(e.time_us);
+        w.Key("task");
+        w.String(e.task.c_str(), e.task.size());
+        w.Key("event");
+        w.String(_event_kinds[e.kind]);
+        if (e.kind == task_event::TASK_STATE) {
+            w.Key("state");
+            w.String(_state_name(e.state).c_str());
+        } else {
+            w.Key("replica");
+            w.Uint(e.replica);
+            w.Key("pid");
+            w.Int(e.pid);
+            w.Key("starttime");
+            w.Int64(e.starttime);
+            if (e.kind != task_event::PROC_SPAWN) {
+                w.Key(e.kind == task_event::PROC_EXIT ? "exitcode" : "signal");
+                w.Int(e.code);
+            }
+        }
+        w.EndObject();
+        return string(buf.GetString(), buf.GetSize()) + "\n";
+    }
+    ostringstream s;
+    time_t seconds = e.time_us / 1000000;
+    tm local;
+    localtime_r(&seconds, &local);
+    s << put_time(&local, "%F %T") << "." << setfill('0') << setw(6) <<
+         e.time_us % 1000000 << setfill(' ') << " #" << e.seq << " " << e.task;
+    switch (e.kind) {
+    case task_event::TASK_STATE:
+        s << ": " << _states_map[e.state];
+        break;
+    case task_event::PROC_SPAWN:
+        s << "[" << e.replica << "]: spawned, pid " << e.pid;
+        break;
+    case task_event::PROC_EXIT:
+        s << "[" << e.replica << "]: pid " << e.pid << " exited with code " << e.code;
+        break;
+    case task_event::PROC_SIGNAL:
+        s << "[" << e.replica << "]: pid " << e.pid << " killed by signal " <<
+             e.code << " (" << strsignal(e.code) << ")";
+        break;
+    }
+    if (e.kind == task_event::PROC_EXIT || e.kind == task_event::PROC_SIGNAL)
+        s << ", ran " << max<time_t>(0, seconds - e.starttime) << "s";
+    s << "\n";
+    return s.str();
+}
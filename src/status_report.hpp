@@ -0,0 +1,101 @@
+#ifndef STATUS_REPORT_HPP
+#define STATUS_REPORT_HPP
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "cgroup.hpp"
+#include "proc_sampler.hpp"
+#include "event_stream.hpp"
+
+// Status of a replica, see task::report()
+struct proc_report
+{
+    bool running = false;
+    pid_t pid = 0;
+    bool exited = false;
+    int exitcode = 0;
+    std::string cpus;                        // Effective affinity if placed
+    int node = -1;
+    proc_sampler::sample use;
+    double restart_in = -1;                  // Seconds, -1 if none is due
+    std::uint32_t backoff = 0;
+};
+
+struct task_report
+{
+    std::string name;
+    int state = 0;                           // task_status state
+    std::uint64_t memory = 0;
+    std::uint32_t row_size = 0;
+    pid_t zygote_pid = 0;
+    std::string cgroup;                      // Empty if the task has none
+    cgroup::stats cgroup_stats;
+    std::uint64_t watchdog_actions = 0;
+    std::string watchdog_reason;
+    std::string error;
+    std::uint64_t crash_loops = 0;
+    double retry_in = -1;                    // Seconds, -1 if none is due
+    double resume_in = -1;
+    std::string waiting_for;                 // Dependency a start waits for
+    std::uint64_t liveness_restarts = 0;
+    std::string probe_error;                 // Of the last failed probe
+    std::int64_t starttime = 0;
+    std::uint64_t starttries = 0;
+    std::vector<proc_report> procs;          // Only while the task is up
+};
+
+// Selects the tasks of a status reply
+struct status_query
+{
+    std::string pattern;                     // Glob on the name, empty for all
+    std::uint32_t states = 0;                // Bit per task_status state, 0 for all
+    bool failed = false;                     // Only fatal, error, backoff, unknown
+    std::uint32_t offset = 0;                // Tasks skipped in name order
+    std::uint32_t limit = 0;                 // 0 for no limit
+    bool json = false;                       // Rendered by the client
+};
+
+// Receives a status reply part by part, returns false to stop early
+using status_sink = std::function<bool(const std::string &part)>;
+
+struct status_report
+{
+    bool all = false;                        // No filter, the startup line is shown
+    bool startup_pending = false;
+    std::uint64_t spawns_queued = 0;
+    std::uint64_t procs_starting = 0;
+    std::uint64_t startup_ms = 0;
+    std::int64_t now = 0;                    // Time of the daemon
+    std::uint64_t total = 0;                 // Tasks matching the query
+    std::uint64_t offset = 0;                // Of the first task of the page
+    std::uint64_t count = 0;                 // Tasks of the page over all parts
+    std::vector<task_report> tasks;          // Tasks of this part
+};
+
+// Renders a reply part by part, the summary is taken from the first part
+class status_renderer
+{
+public:
+    explicit status_renderer(bool json) : json(json) {}
+    std::string render(const status_report &part);
+    std::string finish();
+private:
+    bool json;
+    bool started = false;
+    std::int64_t now = 0;
+    std::size_t rendered = 0;
+};
+
+// One line per event, a JSON object with json
+std::string render_event(const task_event &event, bool json);
+
+// Returns the task_status state of a name like "running" or -1
+int parse_state_name(const std::string &name);
+bool is_failed_state(int state);
+
+#endif // STATUS_REPORT_HPP
@@ -7,27 +7,36 @@
 #include <exception>
 #include <yaml-cpp/yaml.h>
 #include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <atomic>
 
 #include <ctime>
+#include <climits>
+#include <cmath>
+#include <random>
+
+#include <sched.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <linux/ioprio.h>
 
 #include "unistd.h"
 #include "sys/types.h"
 
 #include "task.hpp"
+#include "taskmaster_zygote.h"
+#include "defaults.hpp"
 
 //using namespace tasks;
 
 using namespace std;
 
-static map<int, string> _states_map = {
-    {task_status::STOPPED,  "stoppped"},
-    {task_status::STARTING, "starting"},
-    {task_status::RUNNING,  "running"},
-    {task_status::EXITED,   "exited"},
-    {task_status::FATAL,    "fatal"},
-    {task_status::ERROR,    "process start error"},
-    {task_status::UNKNOWN,  "unknown (fatal error)"}
-};
+// Top-level key of the daemon settings, it cannot be a program name
+static const string MASTER_SECTION = "taskmaster";
 
 static void _config_read_prog(const YAML::Node &param, task_config &tconf);
 static void _config_read_args(const YAML::Node &param, task_config &tconf);
@@ -44,35 +53,168 @@ static void _config_read_stoptime(const YAML::Node &param, task_config &tconf);
 static void _config_read_stdout(const YAML::Node &param, task_config &tconf);
 static void _config_read_stderr(const YAML::Node &param, task_config &tconf);
 static void _config_read_env(const YAML::Node &param, task_config &tconf);
+static void _config_read_zygote(const YAML::Node &param, task_config &tconf);
+static void _config_read_capture(const YAML::Node &param, task_config &tconf);
+static void _config_read_maxbytes(const YAML::Node &param, task_config &tconf);
+static void _config_read_backups(const YAML::Node &param, task_config &tconf);
+static void _config_read_prefix(const YAML::Node &param, task_config &tconf);
+static void _config_read_tailbytes(const YAML::Node &param, task_config &tconf);
+static void _config_read_cgroup(const YAML::Node &param, task_config &tconf);
+static void _config_read_cpu_weight(const YAML::Node &param, task_config &tconf);
+static void _config_read_cpu_max(const YAML::Node &param, task_config &tconf);
+static void _config_read_memory_max(const YAML::Node &param, task_config &tconf);
+static void _config_read_memory_high(const YAML::Node &param, task_config &tconf);
+static void _config_read_pids_max(const YAML::Node &param, task_config &tconf);
+static void _config_read_io_weight(const YAML::Node &param, task_config &tconf);
+static void _config_read_max_rss(const YAML::Node &param, task_config &tconf);
+static void _config_read_max_cpu(const YAML::Node &param, task_config &tconf);
+static void _config_read_max_cpu_secs(const YAML::Node &param, task_config &tconf);
+static void _config_read_max_fds(const YAML::Node &param, task_config &tconf);
+static void _config_read_watchdog(const YAML::Node &param, task_config &tconf);
+static void _config_read_cpu_affinity(const YAML::Node &param, task_config &tconf);
+static void _config_read_nice(const YAML::Node &param, task_config &tconf);
+static void _config_read_ioprio(const YAML::Node &param, task_config &tconf);
+static void _config_read_sched_policy(const YAML::Node &param, task_config &tconf);
+static void _config_read_rlimits(const YAML::Node &param, task_config &tconf);
+static void _config_read_backoff_initial(const YAML::Node &param, task_config &tconf);
+static void _config_read_backoff_multiplier(const YAML::Node &param, task_config &tconf);
+static void _config_read_backoff_max(const YAML::Node &param, task_config &tconf);
+static void _config_read_backoff_jitter(const YAML::Node &param, task_config &tconf);
+static void _config_read_crashloop_exits(const YAML::Node &param, task_config &tconf);
+static void _config_read_crashloop_window(const YAML::Node &param, task_config &tconf);
+static void _config_read_crashloop_action(const YAML::Node &param, task_config &tconf);
+static void _config_read_groups(const YAML::Node &param, task_config &tconf);
+static void _config_read_depends_on(const YAML::Node &param, task_config &tconf);
+static void _config_read_readiness(const YAML::Node &param, task_config &tconf);
+static void _config_read_liveness(const YAML::Node &param, task_config &tconf);
+static double _config_read_seconds(const YAML::Node &param, const string &key);
+
+// Spreads the restarts of replicas that failed together
+static mt19937 _jitter_rng{random_device{}()};
 
 
-task::task(const task_config &tconf) : config(tconf)
+task::task(const task_config &tconf, runtime &rt) : config(tconf), rt(rt)
+{
+    proc::launch_spec::params params;
+    params.bin = config.bin;
+    params.args = config.args;
+    params.envs = config.envs;
+    params.workdir = config.workdir;
+    params.stdin_file = config.stdin_file;
+    params.stdout_file = config.stdout_file;
+    params.stderr_file = config.stderr_file;
+    params.stoptime = config.stopsecs;
+    params.mask = config.mask;
+    params.sched = config.sched;
+    spec = proc::launch_spec::create(params);
+    if (config.zygote) {
+        // The template is the same program told where its socket is
+        params.envs.push_back(string(TASKMASTER_ZYGOTE_ENV) + "=" +
+                              to_string(TASKMASTER_ZYGOTE_FD));
+        zygote = make_shared<class zygote>(proc::launch_spec::create(params));
+    }
+    if (config.capture) {
+        auto c = make_shared<log_writer::capture>();
+        c->out = rt.logs.open(config.stdout_file, config.maxbytes, config.backups);
+        c->err = rt.logs.open(config.stderr_file, config.maxbytes, config.backups);
+        if (config.prefix) c->prefix = config.name;
+        if (config.tailbytes)
+            for (size_t i = 0; i < config.numprocs; ++i)
+                c->rings.push_back(make_shared<output_ring>(config.tailbytes));
+        capture = move(c);
+    }
+    if (config.cgroup_mode != task_config::CGROUP_NONE) {
+        string error;
+        auto root = rt.cgroup_root();
+        if (root) cg = root->child(TCGROUP_TASK_PREFIX + config.name, true, error);
+        if (root && !cg)
+            clog << config.name << ": Warning: " << error << endl;
+        // The group of a replaced task may still wait for its last process
+        if (cg) rt.reuse(*cg);
+        if (cg && config.cgroup_mode == task_config::CGROUP_TASK)
+            for (auto &limit : config.cgroup_limits)
+                if (!cg->set(limit.first, limit.second))
+                    clog << config.name << ": Warning: cannot set " <<
+                            limit.first << ": " << strerror(errno) << endl;
+        leaves.resize(config.numprocs);
+    }
+    try {
+        if (config.affinity != proc::affinity_mode::NONE)
+            placements = proc::plan_placement(config.affinity, config.cpu_lists,
+                                              config.numprocs);
+    } catch (const exception &e) {
+        clog << config.name << ": Warning: " << e.what() << endl;
+    }
+    procs = rt.procs.allocate(config.numprocs);
+    spawn_jobs.resize(config.numprocs);
+    slot_timers.resize(config.numprocs);
+    restarts.resize(config.numprocs);
+    if (has_probes()) probes.resize(config.numprocs);
+    if (has_watchdog()) {
+        watches.resize(config.numprocs);
+        if (rt.sampler.get_interval().count() <= 0)
+            clog << config.name << ": Warning: the watchdog needs "
+                    "'taskmaster: sample_interval'" << endl;
+        arm_watchdog();
+    }
+}
+
+task::~task()
 {
-    resize(config.numprocs, config.bin);
-    for (auto &proc: *this) {
-        proc.set_args(config.args);
-        proc.set_envs(config.envs);
-        proc.set_workdir(config.workdir);
-        proc.set_redirection(config.stdin_file, config.stdout_file,
-                                   config.stderr_file);
-        proc.set_stoptime(config.stopsecs);
-        proc.set_umask(config.mask);
+    for (auto id : spawn_jobs) rt.spawns.cancel(id);
+    release_slots();
+    for (size_t i = 0; i < size(); ++i)
+        if (rt.procs.is_exist(row(i))) rt.unwatch(rt.procs.get_pid(row(i)));
+    rt.timers.cancel(start_timer);
+    rt.timers.cancel(retry_timer);
+    rt.timers.cancel(watchdog_timer);
+    rt.timers.cancel(resume_timer);
+    for (auto &w : watches) rt.timers.cancel(w.kill_timer);
+    for (auto &r : restarts) rt.timers.cancel(r.timer);
+    for (size_t i = 0; i < probes.size(); ++i) {
+        stop_probes(i);
+        rt.timers.cancel(probes[i].kill_timer);
     }
-    if (config.autostart) start();
+    for (auto &id : leaf_timers) rt.timers.cancel(id);
+    shared_ptr<cgroup> last;
+    for (auto &leaf : leaves) {
+        if (!leaf || leaf == last) continue;
+        last = leaf;
+        leaf->kill();
+        rt.retire(leaf);
+    }
+    leaves.clear();
+    rt.retire(move(cg));
+    rt.procs.release(procs);
 }
 
 void task::exec()
 {
-    try {
-        for (auto &proc: *this) proc.start();
-    } catch (const exception &e) {
-        for (auto &proc: *this) proc.stop();
-        state.state = task_status::ERROR;
-        throw runtime_error(e.what());
+    if (access(spec->bin().c_str(), X_OK)) {
+        set_state(task_status::ERROR);
+        state.error = strerror(errno);
+        throw runtime_error("failed to start the process: " + state.error);
     }
     state.starttime = time(nullptr);
     state.starttries++;
-    state.state = task_status::STARTING;
+    set_state(task_status::STARTING);
+    state.error.clear();
+    state.probe_error.clear();
+    rt.timers.cancel(start_timer);
+    if (cg) new_leaves();
+    // The startsecs timer is armed once the last replica is started
+    spawning = size();
+    for (size_t i = 0; i < size(); ++i) spawn(i, true);
+}
+
+void task::retry()
+{
+    if (state.state != task_status::STARTING) return;
+    try {
+        exec();
+    } catch (const exception &e) {
+        clog << config.name << ": restart failed: " << e.what() << endl;
+    }
 }
 
 void task::start()
@@ -82,93 +224,681 @@ void task::start()
     if (state.state == task_status::ERROR)
         throw runtime_error("process error");
     if (state.state == task_status::STARTING ||
-        state.state == task_status::RUNNING )
+        state.state == task_status::RUNNING ||
+        state.state == task_status::BACKOFF)
         throw runtime_error("process already started");
     state.starttries = 0;
+    for (auto &r : restarts) r.failures = 0;
+    exits.clear();
     exec();
 }
 
+void task::spawn(size_t index, bool hold)
+{
+    rt.spawns.cancel(spawn_jobs[index]);
+    shared_ptr<cgroup> leaf;
+    if (!leaves.empty()) leaf = leaves[index];
+    shared_ptr<const proc::placement> where;
+    if (!placements.empty())
+        where = make_shared<proc::placement>(placements[index]);
+    // Runs on a spawner worker, it must not touch the task
+    auto launch = [logs = &rt.logs, c = capture, z = zygote, s = spec, leaf,
+                   where, index](int &err) {
+        proc::output_fds output;
+        if (c && !logs->open_pipes(*c, index, output, err)) return -1;
+        // A zygote replica is moved and pinned once it is forked, its memory
+        // policy is inherited from the template
+        int procs = leaf && !z ? leaf->open_procs() : -1;
+        pid_t pid = z ? z->fork_replica(*s, index, err, output) :
+                        proc::process::launch(*s, err, -1, output, procs,
+                                              where.get());
+        if (procs != -1) close(procs);
+        if (pid > 0 && z && leaf) leaf->attach(pid);
+        if (pid > 0 && z && where && where->has_cpus &&
+            sched_setaffinity(pid, sizeof(where->cpus), &where->cpus))
+            clog << "Warning: cannot set the affinity of " << pid << ": " <<
+                    strerror(errno) << endl;
+        if (output.err != output.out) close(output.err);
+        if (output.out != -1) close(output.out);
+        return pid;
+    };
+    spawn_jobs[index] = rt.spawns.submit(move(launch), hold,
+        [this, index, hold](pid_t pid, int err) {
+            on_spawned(index, hold, pid, err);
+        });
+}
+
+void task::on_spawned(size_t index, bool hold, pid_t pid, int err)
+{
+    spawn_jobs[index] = 0;
+    // A failed spawn counts as an early exit of that replica only, its
+    // siblings keep running
+    if (pid == -1) {
+        state.error = strerror(err);
+        clog << config.name << ": failed to start replica " << index << ": " <<
+                state.error << endl;
+        if (state.state == task_status::STARTING) start_failed();
+        else if (state.state == task_status::RUNNING) schedule_restart(index);
+        return;
+    }
+    rt.procs.set_started(row(index), pid);
+    restarts[index].started = timer_wheel::clock::now();
+    publish_proc(task_event::PROC_SPAWN, index, 0);
+    watch(index, pid);
+    if (!probes.empty()) stop_probes(index);
+    if (!hold) {
+        if (config.liveness.kind != probe_config::PROBE_NONE)
+            schedule_probe(index, false, config.liveness.delay);
+        return;
+    }
+    if (config.readiness.kind != probe_config::PROBE_NONE)
+        schedule_probe(index, true, config.readiness.delay);
+    slot_timers[index] = rt.timers.add(config.startsecs,
+                                       [this]() {rt.spawns.release(1);});
+    if (--spawning || state.state != task_status::STARTING) return;
+    // Without readiness the task is RUNNING once it lived startsecs, with
+    // it the replicas have startsecs to become ready
+    start_timer = rt.timers.add(config.startsecs, [this]() {
+        if (state.state != task_status::STARTING) return;
+        if (config.readiness.kind == probe_config::PROBE_NONE)
+            return became_running();
+        state.error = "not ready after " + to_string(config.startsecs) + "s";
+        if (!state.probe_error.empty()) state.error += ": " + state.probe_error;
+        clog << config.name << ": " << state.error << endl;
+        if (state.starttries >= config.startretries) kill(config.stopsignal);
+        start_failed();
+    });
+}
+
+void task::became_running()
+{
+    rt.timers.cancel(start_timer);
+    set_state(task_status::RUNNING);
+    release_slots();
+    if (config.liveness.kind == probe_config::PROBE_NONE) return;
+    for (size_t i = 0; i < size(); ++i)
+        if (rt.procs.is_exist(row(i)))
+            schedule_probe(i, false, config.liveness.delay);
+}
+
+void task::watch(size_t index, pid_t pid)
+{
+    // An early exit is delivered from a timer that may outlive the task
+    rt.watch(pid, [this, table = &rt.procs, h = rt.procs.get_handle(row(index)),
+                   index](int status) {
+        if (table->is_valid(h)) on_exit(index, status);
+    });
+}
+
+void task::new_leaves()
+{
+    shared_ptr<cgroup> last;
+    for (auto &leaf : leaves) {
+        if (leaf && leaf != last) rt.retire(leaf);
+        last = move(leaf);
+    }
+    string run = rt.next_leaf();
+    string error;
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        if (config.cgroup_mode == task_config::CGROUP_TASK && i) {
+            leaves[i] = leaves[0];
+            continue;
+        }
+        string name = run;
+        if (config.cgroup_mode == task_config::CGROUP_REPLICA)
+            name += "-" + to_string(i);
+        if (!(leaves[i] = cg->child(name, false, error))) {
+            clog << config.name << ": Warning: " << error << endl;
+            continue;
+        }
+        if (config.cgroup_mode != task_config::CGROUP_REPLICA) continue;
+        for (auto &limit : config.cgroup_limits)
+            if (!leaves[i]->set(limit.first, limit.second))
+                clog << config.name << ": Warning: cannot set " <<
+                        limit.first << ": " << strerror(errno) << endl;
+    }
+}
+
+void task::release_slots()
+{
+    size_t slots = 0;
+    for (auto &id : slot_timers) slots += rt.timers.cancel(id);
+    rt.spawns.release(slots);
+}
+
 void task::kill(int signal)
 {
-    for (auto &proc: *this) proc.stop(signal);
+    for (auto &id : spawn_jobs) {
+        rt.spawns.cancel(id);
+        id = 0;
+    }
+    spawning = 0;
+    release_slots();
+    for (auto &w : watches) {
+        rt.timers.cancel(w.kill_timer);
+        w.restarting = false;
+        w.cpu_over = 0;
+    }
+    for (auto &r : restarts) rt.timers.cancel(r.timer);
+    for (size_t i = 0; i < probes.size(); ++i) {
+        stop_probes(i);
+        rt.timers.cancel(probes[i].kill_timer);
+        probes[i].restarting = false;
+    }
+    auto reaped = remove_if(stopped.begin(), stopped.end(),
+                            [this](pid_t pid) {return !rt.is_stopping(pid);});
+    stopped.erase(reaped, stopped.end());
+    for (size_t i = 0; i < size(); ++i) stop_replica(i, signal);
+    // The whole tree goes, including processes that left the process group
+    auto fired = remove_if(leaf_timers.begin(), leaf_timers.end(),
+                           [this](timer_wheel::timer_id id) {return !rt.timers.is_pending(id);});
+    leaf_timers.erase(fired, leaf_timers.end());
+    shared_ptr<cgroup> last;
+    for (auto &leaf : leaves) {
+        if (!leaf || leaf == last) continue;
+        last = leaf;
+        if (signal == SIGKILL) leaf->kill();
+        else leaf_timers.push_back(rt.timers.add(config.stopsecs, [leaf]() {leaf->kill();}));
+    }
+}
+
+void task::stop_replica(size_t index, int signal)
+{
+    task_event event;
+    event.task = config.name;
+    event.replica = index;
+    event.starttime = rt.procs.get_starttime(row(index));
+    pid_t pid = event.pid = rt.procs.stop(row(index), signal);
+    if (!pid) return;
+    if (signal == SIGKILL) {
+        rt.unwatch(pid);
+        event.kind = task_event::PROC_SIGNAL;
+        event.code = SIGKILL;
+        rt.events.publish(event);
+        return;
+    }
+    // The exit of a stopped replica is published once it is reaped,
+    // the task may be gone by then
+    rt.stop_later(pid, config.stopsecs, [events = &rt.events, event](int status) mutable {
+        event.kind = WIFSIGNALED(status) ? task_event::PROC_SIGNAL :
+                                           task_event::PROC_EXIT;
+        event.code = WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status);
+        events->publish(event);
+    });
+    stopped.push_back(pid);
 }
 
 void task::stop()
 {
+    rt.timers.cancel(start_timer);
+    rt.timers.cancel(retry_timer);
+    rt.timers.cancel(resume_timer);
     kill(config.stopsignal);
-    state.state = task_status::STOPPED;
+    set_state(task_status::STOPPED);
     state.starttries = 0;
     state.starttime = 0;
 }
 
-void task::restart()
+void task::set_state(int new_state)
+{
+    if (state.state == new_state) return;
+    state.state = static_cast<decltype(state.state)>(new_state);
+    task_event event;
+    event.task = config.name;
+    event.state = new_state;
+    rt.events.publish(event);
+}
+
+// status is the waitpid() status of an exit
+void task::publish_proc(int kind, size_t index, int status)
 {
-    stop();
-    start();
+    task_event event;
+    event.kind = static_cast<task_event::kind_t>(kind);
+    event.task = config.name;
+    event.replica = index;
+    event.pid = rt.procs.get_pid(row(index));
+    event.starttime = rt.procs.get_starttime(row(index));
+    if (kind == task_event::PROC_EXIT) event.code = WEXITSTATUS(status);
+    else if (kind == task_event::PROC_SIGNAL) event.code = WTERMSIG(status);
+    rt.events.publish(event);
 }
-string task::status()
+
+bool task::reconfigure(const task_config &next)
 {
-    ostringstream s;
-    s << config.name << ":\n";
-    s << "  state: " << _states_map[state.state] + "\n";
-    if (state.state == task_status::STARTING ||
-        state.state == task_status::RUNNING) {
-        s << "  starttime: " << ctime(&state.starttime) <<
-             "  run time: " << time(nullptr) - state.starttime << "s" << endl <<
-             "  starttries: " << state.starttries << endl <<
-             "  procs:" << endl;
-        size_t i = 0;
-        for (auto &p : *this) {
-            s << "    " << i++ << ":" << endl;
-            if (p.is_exist()) {
-                s << "      state: running" << endl;
-                s << "      pid: " << p.get_pid() << endl;
-            } else {
-                s << "      state: not running" << endl;
-                if (p.is_exited())
-                    s << "      exitcode: " << p.get_exitcode() << endl;
-            }
+    bool new_probes = !(next.readiness == config.readiness &&
+                        next.liveness == config.liveness);
+    // Replicas are not added or removed and readiness does not change in
+    // the middle of a start
+    if ((next.numprocs != size() || new_probes) &&
+        state.state == task_status::STARTING)
+        return false;
+    size_t count = next.numprocs;
+    if (new_probes)
+        for (size_t i = 0; i < probes.size(); ++i) stop_probes(i);
+    config = next;
+    if (new_probes && has_probes()) probes.resize(size());
+    if (new_probes && state.state == task_status::RUNNING &&
+        config.liveness.kind != probe_config::PROBE_NONE)
+        for (size_t i = 0; i < size(); ++i)
+            if (rt.procs.is_exist(row(i)) && !probes[i].restarting)
+                schedule_probe(i, false, config.liveness.delay);
+    if (count != size()) scale(count);
+    return true;
+}
+
+void task::scale(size_t count)
+{
+    size_t old = size();
+    for (size_t i = count; i < old; ++i) {
+        rt.spawns.cancel(spawn_jobs[i]);
+        rt.spawns.release(rt.timers.cancel(slot_timers[i]));
+        rt.timers.cancel(restarts[i].timer);
+        if (!watches.empty()) rt.timers.cancel(watches[i].kill_timer);
+        if (!probes.empty()) {
+            stop_probes(i);
+            rt.timers.cancel(probes[i].kill_timer);
         }
+        stop_replica(i, config.stopsignal);
+    }
+    // The replicas are watched by row, a moved slice watches them again
+    if (rt.procs.resize(procs, count))
+        for (size_t i = 0; i < min(old, count); ++i)
+            if (rt.procs.is_exist(row(i))) watch(i, rt.procs.get_pid(row(i)));
+    spawn_jobs.resize(count);
+    slot_timers.resize(count);
+    restarts.resize(count);
+    if (!watches.empty()) watches.resize(count);
+    if (!probes.empty()) probes.resize(count);
+    if (capture && !capture->rings.empty()) {
+        auto c = make_shared<log_writer::capture>(*capture);
+        c->rings.resize(count);
+        for (size_t i = old; i < count; ++i)
+            c->rings[i] = make_shared<output_ring>(config.tailbytes);
+        capture = move(c);
     }
-    return s.str();
+    clog << config.name << ": scaled from " << old << " to " << count <<
+            " replicas" << endl;
+    // A paused task spawns the new replicas on resume()
+    if (state.state != task_status::RUNNING) return;
+    for (size_t i = old; i < count; ++i) spawn(i, false);
 }
 
-void task::update()
+bool task::is_stopping() const
 {
+    return any_of(stopped.begin(), stopped.end(),
+                  [this](pid_t pid) {return rt.is_stopping(pid);});
+}
+
+void task::report(task_report &r) const
+{
+    r.name = config.name;
+    r.state = state.state;
+    r.memory = memory_usage();
+    r.row_size = process_table::row_size();
+    if (zygote) r.zygote_pid = zygote->get_pid();
+    if (cg) {
+        r.cgroup = cg->get_path();
+        r.cgroup_stats = cg->get_stats();
+    }
+    r.watchdog_actions = state.watchdog_actions;
+    r.watchdog_reason = state.watchdog_reason;
+    r.error = state.error;
+    r.crash_loops = state.crash_loops;
+    r.liveness_restarts = state.liveness_restarts;
+    r.probe_error = state.probe_error;
+    auto now = timer_wheel::clock::now();
+    auto seconds_until = [now](timer_wheel::clock::time_point deadline) {
+        return max(0.0, chrono::duration<double>(deadline - now).count());
+    };
+    if (rt.timers.is_pending(retry_timer)) r.retry_in = seconds_until(retry_at);
+    if (rt.timers.is_pending(resume_timer)) r.resume_in = seconds_until(retry_at);
+    r.starttime = state.starttime;
+    r.starttries = state.starttries;
     if (state.state != task_status::STARTING &&
-        state.state != task_status::RUNNING)
+        state.state != task_status::RUNNING &&
+        state.state != task_status::BACKOFF)
         return;
-    if (time(nullptr) - state.starttime >= config.startsecs)
-        state.state = task_status::RUNNING;
-    for (auto &p : *this) {
-        p.update();
-        if (p.is_exist()) continue; // Process running
-        // Process died
-        if (state.state == task_status::STARTING) { // go FATAL or restart
-            if (state.starttries < config.startretries) {
-                task::kill(SIGKILL); // Kill other processes
-                task::exec(); // Restart processes
-            } else {
-                state.state = task_status::FATAL; // State FATAL
+    auto &table = rt.procs;
+    r.procs.resize(size());
+    for (size_t i = 0; i < size(); ++i) {
+        auto &p = r.procs[i];
+        auto row_index = row(i);
+        p.running = table.is_exist(row_index);
+        if (p.running) {
+            p.pid = table.get_pid(row_index);
+            cpu_set_t cpus;
+            if (!placements.empty() &&
+                !sched_getaffinity(p.pid, sizeof(cpus), &cpus)) {
+                p.cpus = proc::format_cpu_list(cpus);
+                p.node = placements[i].node;
             }
-        } else { // go EXITED or restart
-            if ((config.autorestart == task_config::TRUE) ||
-                (config.autorestart == task_config::UNEXPECTED &&
-                       !is_exited_normally(p))) {
-                p.start();
-            } else {
-                state.state = task_status::EXITED;
+            rt.sampler.get(p.pid, p.use);
+        } else {
+            p.exited = table.is_exited(row_index);
+            p.exitcode = table.get_exitcode(row_index);
+            auto &next = restarts[i];
+            if (rt.timers.is_pending(next.timer)) {
+                p.restart_in = seconds_until(next.restart_at);
+                p.backoff = next.failures;
             }
         }
     }
 }
 
+// Is called by the runtime when the process at index changed state
+void task::on_exit(size_t index, int status)
+{
+    auto r = row(index);
+    rt.procs.set_status(r, status);
+    if (rt.procs.is_exist(r)) return; // Process stopped by a signal
+    publish_proc(WIFSIGNALED(status) ? task_event::PROC_SIGNAL : task_event::PROC_EXIT,
+                 index, status);
+    bool watchdog_restart = false;
+    if (!watches.empty()) {
+        auto &w = watches[index];
+        rt.timers.cancel(w.kill_timer);
+        watchdog_restart = w.restarting;
+        w.restarting = false;
+        w.cpu_over = 0;
+    }
+    bool probe_restart = false;
+    if (!probes.empty()) {
+        auto &p = probes[index];
+        stop_probes(index);
+        rt.timers.cancel(p.kill_timer);
+        probe_restart = p.restarting;
+        p.restarting = false;
+    }
+    if (state.state != task_status::STARTING &&
+        state.state != task_status::RUNNING)
+        return;
+    // Process died
+    if (state.state == task_status::STARTING) { // go FATAL or restart
+        start_failed();
+    } else { // go EXITED or restart
+        // A replica restarted by the watchdog or liveness counts as a
+        // crash, it restarts with the backoff delay
+        if (watchdog_restart || probe_restart ||
+            (config.autorestart == task_config::TRUE) ||
+            (config.autorestart == task_config::UNEXPECTED &&
+                   !is_exited_normally(r))) {
+            // Leftovers of the replica must not share its new group
+            if (config.cgroup_mode == task_config::CGROUP_REPLICA &&
+                leaves[index])
+                leaves[index]->kill();
+            schedule_restart(index);
+        } else {
+            set_state(task_status::EXITED);
+        }
+    }
+}
+
+void task::start_failed()
+{
+    if (rt.timers.is_pending(retry_timer)) return;
+    if (state.starttries < config.startretries) {
+        task::kill(SIGKILL); // Kill other processes
+        auto delay = backoff_delay(state.starttries - 1);
+        retry_at = timer_wheel::clock::now() + delay;
+        retry_timer = rt.timers.add(delay, [this]() {retry();});
+    } else {
+        set_state(task_status::FATAL); // State FATAL
+        release_slots();
+    }
+}
+
+// A replica that ran for startsecs starts over from backoff_initial
+void task::schedule_restart(size_t index)
+{
+    auto now = timer_wheel::clock::now();
+    auto &r = restarts[index];
+    if (now - r.started >= chrono::seconds(config.startsecs)) r.failures = 0;
+    if (config.crashloop_exits) {
+        exits.push_back(now);
+        while (now - exits.front() > chrono::seconds(config.crashloop_window))
+            exits.pop_front();
+        if (exits.size() >= config.crashloop_exits) {
+            crash_loop();
+            return;
+        }
+    }
+    auto delay = backoff_delay(r.failures++);
+    r.restart_at = now + delay;
+    r.timer = rt.timers.add(delay, [this, index]() {spawn(index, false);});
+}
+
+chrono::milliseconds task::backoff_delay(unsigned failures) const
+{
+    return with_jitter(min(config.backoff_max, config.backoff_initial *
+                           pow(config.backoff_multiplier, failures)));
+}
+
+chrono::milliseconds task::with_jitter(double seconds) const
+{
+    if (config.backoff_jitter > 0) {
+        uniform_real_distribution<double> jitter(-config.backoff_jitter,
+                                                 config.backoff_jitter);
+        seconds *= 1 + jitter(_jitter_rng);
+    }
+    return chrono::milliseconds(llround(seconds * 1000));
+}
+
+void task::crash_loop()
+{
+    state.crash_loops++;
+    clog << config.name << ": crash loop: " << exits.size() << " exits in " <<
+            config.crashloop_window << "s" << endl;
+    exits.clear();
+    if (config.crashloop_action == task_config::CRASHLOOP_FATAL) {
+        kill(config.stopsignal);
+        set_state(task_status::FATAL);
+        return;
+    }
+    // Running replicas are kept, the exited ones wait for resume()
+    for (auto &r : restarts) rt.timers.cancel(r.timer);
+    set_state(task_status::BACKOFF);
+    auto delay = with_jitter(config.backoff_max);
+    retry_at = timer_wheel::clock::now() + delay;
+    resume_timer = rt.timers.add(delay, [this]() {resume();});
+}
+
+void task::resume()
+{
+    if (state.state != task_status::BACKOFF) return;
+    set_state(task_status::RUNNING);
+    for (size_t i = 0; i < size(); ++i)
+        if (!rt.procs.is_exist(row(i))) spawn(i, false);
+}
+
+string task::tail(vector<uint64_t> &cursors, size_t backlog) const
+{
+    if (!capture || capture->rings.empty())
+        throw runtime_error("output is not captured, "
+                            "set 'capture' and 'tailbytes'");
+    auto &rings = capture->rings;
+    if (cursors.size() != rings.size()) {
+        cursors.resize(rings.size());
+        for (size_t i = 0; i < rings.size(); ++i) {
+            uint64_t end = rings[i]->end();
+            cursors[i] = end - min<uint64_t>({end, backlog, config.tailbytes});
+        }
+    }
+    // A reply is bounded, the client asks again for the rest
+    string out;
+    for (size_t i = 0; i < rings.size() && out.size() < TTAIL_CHUNK_SIZE; ++i) {
+        string chunk;
+        uint64_t lost = rings[i]->read(cursors[i], TTAIL_CHUNK_SIZE - out.size(),
+                                       chunk);
+        if (lost)
+            out += "[" + config.name + ":" + to_string(i) + ": " +
+                   to_string(lost) + " bytes dropped]\n";
+        out += chunk;
+    }
+    return out;
+}
+
+bool task::has_watchdog() const
+{
+    return config.max_rss || config.max_cpu > 0 || config.max_fds;
+}
+
+void task::arm_watchdog()
+{
+    auto interval = rt.sampler.get_interval();
+    if (interval.count() <= 0) interval = chrono::milliseconds(
+        static_cast<long long>(TSAMPLE_INTERVAL * 1000));
+    watchdog_timer = rt.timers.add(interval, [this]() {
+        watchdog();
+        arm_watchdog();
+    });
+}
+
+void task::watchdog()
+{
+    for (size_t i = 0; i < size(); ++i) {
+        auto r = row(i);
+        auto &w = watches[i];
+        proc_sampler::sample use;
+        // The sampler and the watchdog are not in step, a sample that was
+        // already checked is skipped
+        if (!rt.procs.is_exist(r) || w.restarting ||
+            !rt.sampler.get(rt.procs.get_pid(r), use) || !use.valid ||
+            use.time == w.checked)
+            continue;
+        w.checked = use.time;
+        ostringstream reason;
+        if (config.max_rss && use.rss > config.max_rss) {
+            reason << "rss " << use.rss << " > " << config.max_rss << " bytes";
+        } else if (config.max_fds && use.fds > config.max_fds) {
+            reason << use.fds << " fds > " << config.max_fds;
+        } else if (config.max_cpu > 0 && use.cpu > config.max_cpu) {
+            // A single spike is tolerated for max_cpu_secs
+            w.cpu_over += use.seconds;
+            if (w.cpu_over < config.max_cpu_secs) continue;
+            reason << "cpu " << use.cpu << "% > " << config.max_cpu <<
+                      "% for " << w.cpu_over << "s";
+        } else {
+            w.cpu_over = 0;
+            continue;
+        }
+        w.cpu_over = 0;
+        state.watchdog_actions++;
+        state.watchdog_reason = "replica " + to_string(i) + ": " + reason.str();
+        clog << config.name << ": watchdog: " << state.watchdog_reason << endl;
+        switch (config.watchdog_action) {
+        case task_config::WATCHDOG_SIGNAL:
+            rt.procs.signal(r, config.watchdog_signal);
+            break;
+        case task_config::WATCHDOG_STOP:
+            stop();
+            return;
+        case task_config::WATCHDOG_RESTART:
+            // The exit goes through on_exit() like any other exit
+            w.restarting = true;
+            rt.procs.signal(r, config.stopsignal);
+            w.kill_timer = rt.timers.add(config.stopsecs,
+                                         [pid = rt.procs.get_pid(r)]() {::kill(pid, SIGKILL);});
+            break;
+        }
+    }
+}
+
+bool task::has_probes() const
+{
+    return config.readiness.kind != probe_config::PROBE_NONE ||
+           config.liveness.kind != probe_config::PROBE_NONE;
+}
+
+void task::schedule_probe(size_t index, bool readiness, double seconds)
+{
+    auto &p = probes[index];
+    rt.timers.cancel(p.timer);
+    p.timer = rt.timers.add(chrono::milliseconds(llround(seconds * 1000)),
+                            [this, index, readiness]() {probe(index, readiness);});
+}
+
+void task::probe(size_t index, bool readiness)
+{
+    auto r = row(index);
+    if (!rt.procs.is_exist(r)) return;
+    // An exec probe is told which replica it checks
+    vector<string> env = {
+        "TASKMASTER_NAME=" + config.name,
+        "TASKMASTER_REPLICA=" + to_string(index),
+        "TASKMASTER_PID=" + to_string(rt.procs.get_pid(r))
+    };
+    probes[index].running = rt.probes.run(readiness ? config.readiness : config.liveness,
+        move(env), [this, index, readiness](bool ok, const string &why) {
+            probes[index].running = 0;
+            on_probe(index, readiness, ok, why);
+        });
+}
+
+void task::on_probe(size_t index, bool readiness, bool ok, const string &why)
+{
+    auto &p = probes[index];
+    auto &conf = readiness ? config.readiness : config.liveness;
+    if (!ok)
+        state.probe_error = string(readiness ? "readiness" : "liveness") +
+                            " of replica " + to_string(index) + ": " + why;
+    if (readiness) {
+        if (state.state != task_status::STARTING) return;
+        // Not ready yet, the start timer decides when it is too late
+        if (!ok) return schedule_probe(index, true, conf.interval);
+        p.ready = true;
+        rt.spawns.release(rt.timers.cancel(slot_timers[index]));
+        if (spawning || !all_of(probes.begin(), probes.end(),
+                                [](const replica_probe &x) {return x.ready;}))
+            return;
+        became_running();
+        return;
+    }
+    p.failures = ok ? 0 : p.failures + 1;
+    if (p.failures < max(conf.failures, 1u))
+        return schedule_probe(index, false, conf.interval);
+    // The exit goes through on_exit() like any other exit
+    auto r = row(index);
+    p.failures = 0;
+    p.restarting = true;
+    state.liveness_restarts++;
+    clog << config.name << ": restarting: " << state.probe_error << endl;
+    rt.procs.signal(r, config.stopsignal);
+    p.kill_timer = rt.timers.add(config.stopsecs,
+                                 [pid = rt.procs.get_pid(r)]() {::kill(pid, SIGKILL);});
+}
+
+void task::stop_probes(size_t index)
+{
+    auto &p = probes[index];
+    rt.timers.cancel(p.timer);
+    rt.probes.cancel(p.running);
+    p.running = 0;
+    p.failures = 0;
+    p.ready = false;
+}
+
+// Bytes owned by the task including its replicas and its share of the spec
+size_t task::memory_usage() const
+{
+    auto str_bytes = [](const string &str) {return str.capacity() + 1;};
+    size_t bytes = sizeof(*this) + size() * process_table::row_size();
+    bytes += spec->memory_usage();
+    if (capture) bytes += capture->rings.size() * config.tailbytes;
+    bytes += str_bytes(config.name) + str_bytes(config.bin) +
+             str_bytes(config.workdir) + str_bytes(config.stdin_file) +
+             str_bytes(config.stdout_file) + str_bytes(config.stderr_file);
+    for (auto &arg : config.args) bytes += sizeof(string) + str_bytes(arg);
+    for (auto &env : config.envs) bytes += sizeof(string) + str_bytes(env);
+    bytes += config.exitcodes.capacity() * sizeof(int);
+    return bytes;
+}
+
 // Returns true if the process completed successfully or was stopped by the user
-bool task::is_exited_normally(proc::process &p)
+bool task::is_exited_normally(uint32_t row) const
 {
-    if (!p.is_exited()) return false;
+    if (!rt.procs.is_exited(row)) return false;
     return std::find(config.exitcodes.begin(), config.exitcodes.end(),
-                     p.get_exitcode()) != config.exitcodes.cend();
+                     rt.procs.get_exitcode(row)) != config.exitcodes.cend();
 }
 
 /*
@@ -191,9 +921,71 @@ static unordered_map<string, void (*)(const YAML::Node &, task_config &)> _read_
     {"stdout",       _config_read_stdout},
     {"stderr",       _config_read_stderr},
     {"env",          _config_read_env},
+    {"zygote",       _config_read_zygote},
+    {"capture",      _config_read_capture},
+    {"maxbytes",     _config_read_maxbytes},
+    {"backups",      _config_read_backups},
+    {"prefix",       _config_read_prefix},
+    {"tailbytes",    _config_read_tailbytes},
+    {"cgroup",       _config_read_cgroup},
+    {"cpu_weight",   _config_read_cpu_weight},
+    {"cpu_max",      _config_read_cpu_max},
+    {"memory_max",   _config_read_memory_max},
+    {"memory_high",  _config_read_memory_high},
+    {"pids_max",     _config_read_pids_max},
+    {"io_weight",    _config_read_io_weight},
+    {"max_rss",      _config_read_max_rss},
+    {"max_cpu",      _config_read_max_cpu},
+    {"max_cpu_secs", _config_read_max_cpu_secs},
+    {"max_fds",      _config_read_max_fds},
+    {"watchdog",     _config_read_watchdog},
+    {"cpu_affinity", _config_read_cpu_affinity},
+    {"nice",         _config_read_nice},
+    {"ioprio",       _config_read_ioprio},
+    {"sched_policy", _config_read_sched_policy},
+    {"rlimits",      _config_read_rlimits},
+    {"backoff_initial",    _config_read_backoff_initial},
+    {"backoff_multiplier", _config_read_backoff_multiplier},
+    {"backoff_max",        _config_read_backoff_max},
+    {"backoff_jitter",     _config_read_backoff_jitter},
+    {"crashloop_exits",    _config_read_crashloop_exits},
+    {"crashloop_window",   _config_read_crashloop_window},
+    {"crashloop_action",   _config_read_crashloop_action},
+    {"groups",             _config_read_groups},
+    {"depends_on",         _config_read_depends_on},
+    {"readiness",          _config_read_readiness},
+    {"liveness",           _config_read_liveness},
 };
 
 
+static const unordered_map<string, void (*)(const YAML::Node &, master_config &)>
+_master_read_funcs_map = {
+    {"spawn_workers", [](const YAML::Node &param, master_config &mconf) {
+        mconf.spawn_workers = param.as<size_t>();
+    }},
+    {"spawn_rate",    [](const YAML::Node &param, master_config &mconf) {
+        mconf.spawn_rate = param.as<double>();
+    }},
+    {"max_starting",  [](const YAML::Node &param, master_config &mconf) {
+        mconf.max_starting = param.as<size_t>();
+    }},
+    {"sample_interval", [](const YAML::Node &param, master_config &mconf) {
+        mconf.sample_interval = param.as<double>();
+    }},
+    {"include",       [](const YAML::Node &param, master_config &mconf) {
+        mconf.include = param.as<string>();
+    }},
+    {"watch",         [](const YAML::Node &param, master_config &mconf) {
+        mconf.watch = param.as<bool>();
+    }},
+    {"watch_delay",   [](const YAML::Node &param, master_config &mconf) {
+        mconf.watch_delay = _config_read_seconds(param, "watch_delay");
+    }},
+    {"max_probes",    [](const YAML::Node &param, master_config &mconf) {
+        mconf.max_probes = param.as<size_t>();
+    }},
+};
+
 static const unordered_map<string, int> _signal_names_map = {
     {"SIGHUP",    SIGHUP   }, {"HUP",    SIGHUP   },
     {"SIGINT",    SIGINT   }, {"INT",    SIGINT   },
@@ -225,6 +1017,12 @@ static const unordered_map<string, int> _signal_names_map = {
     {"SIGXFSZ",   SIGXFSZ  }, {"XFSZ",   SIGXFSZ  }
 };
 
+static const unordered_map<string, decltype(task_config::CGROUP_NONE)> _cgroup_names_map = {
+    {"none",    task_config::CGROUP_NONE},
+    {"task",    task_config::CGROUP_TASK},
+    {"replica", task_config::CGROUP_REPLICA}
+};
+
 static const unordered_map<string, decltype(task_config::TRUE)> _autorestart_names_map = {
     {"false",      task_config::FALSE},
     {"unexpected", task_config::UNEXPECTED},
@@ -306,40 +1104,609 @@ static void _config_read_env(const YAML::Node &param, task_config &tconf)
     for (auto &env : param) tconf.envs.push_back(env.first.as<string>() + "=" +
                                                  env.second.as<string>());
 }
+static void _config_read_zygote(const YAML::Node &param, task_config &tconf)
+{
+    tconf.zygote = param.as<bool>();
+}
+static void _config_read_capture(const YAML::Node &param, task_config &tconf)
+{
+    tconf.capture = param.as<bool>();
+}
+static void _config_read_maxbytes(const YAML::Node &param, task_config &tconf)
+{
+    tconf.maxbytes = param.as<size_t>();
+}
+static void _config_read_backups(const YAML::Node &param, task_config &tconf)
+{
+    tconf.backups = param.as<size_t>();
+}
+static void _config_read_prefix(const YAML::Node &param, task_config &tconf)
+{
+    tconf.prefix = param.as<bool>();
+}
+static void _config_read_tailbytes(const YAML::Node &param, task_config &tconf)
+{
+    tconf.tailbytes = param.as<size_t>();
+}
+static void _config_read_cgroup(const YAML::Node &param, task_config &tconf)
+{
+    auto it = _cgroup_names_map.find(param.as<string>());
+    if (it != _cgroup_names_map.end())
+        tconf.cgroup_mode = it->second;
+    else
+        throw runtime_error("unexpected value: cgroup: " + param.as<string>());
+}
+// A limit puts the task in a cgroup unless 'cgroup' says otherwise
+static void _config_add_limit(task_config &tconf, const string &file,
+                              const string &value)
+{
+    if (tconf.cgroup_mode == task_config::CGROUP_NONE)
+        tconf.cgroup_mode = task_config::CGROUP_TASK;
+    tconf.cgroup_limits.emplace_back(file, value);
+}
+static void _config_read_cpu_weight(const YAML::Node &param, task_config &tconf)
+{
+    _config_add_limit(tconf, "cpu.weight", to_string(param.as<unsigned>()));
+}
+static void _config_read_cpu_max(const YAML::Node &param, task_config &tconf)
+{
+    _config_add_limit(tconf, "cpu.max", param.as<string>()); // "QUOTA PERIOD"
+}
+static void _config_read_memory_max(const YAML::Node &param, task_config &tconf)
+{
+    _config_add_limit(tconf, "memory.max", param.as<string>()); // 512M, max
+}
+static void _config_read_memory_high(const YAML::Node &param, task_config &tconf)
+{
+    _config_add_limit(tconf, "memory.high", param.as<string>());
+}
+static void _config_read_pids_max(const YAML::Node &param, task_config &tconf)
+{
+    _config_add_limit(tconf, "pids.max", param.as<string>());
+}
+static void _config_read_io_weight(const YAML::Node &param, task_config &tconf)
+{
+    _config_add_limit(tconf, "io.weight",
+                      "default " + to_string(param.as<unsigned>()));
+}
+// Accepts a byte count with an optional K, M, G or T suffix
+static uint64_t _parse_bytes(const string &value)
+{
+    size_t end;
+    uint64_t bytes = stoull(value, &end);
+    string suffix = value.substr(end);
+    static const string units = "KMGT";
+    if (suffix.empty()) return bytes;
+    auto unit = units.find(toupper(suffix[0]));
+    if (unit == string::npos || suffix.size() > 1)
+        throw runtime_error("unexpected size: " + value);
+    return bytes << (10 * (unit + 1));
+}
+static void _config_read_max_rss(const YAML::Node &param, task_config &tconf)
+{
+    tconf.max_rss = _parse_bytes(param.as<string>());
+}
+static void _config_read_max_cpu(const YAML::Node &param, task_config &tconf)
+{
+    tconf.max_cpu = param.as<double>();
+}
+static void _config_read_max_cpu_secs(const YAML::Node &param, task_config &tconf)
+{
+    tconf.max_cpu_secs = param.as<time_t>();
+}
+static void _config_read_max_fds(const YAML::Node &param, task_config &tconf)
+{
+    tconf.max_fds = param.as<unsigned>();
+}
+// restart, stop or the name or number of a signal to send
+static void _config_read_watchdog(const YAML::Node &param, task_config &tconf)
+{
+    string action = param.as<string>();
+    if (action == "restart") {
+        tconf.watchdog_action = task_config::WATCHDOG_RESTART;
+    } else if (action == "stop") {
+        tconf.watchdog_action = task_config::WATCHDOG_STOP;
+    } else {
+        task_config signal_conf;
+        _config_read_stopsignal(param, signal_conf);
+        tconf.watchdog_action = task_config::WATCHDOG_SIGNAL;
+        tconf.watchdog_signal = signal_conf.stopsignal;
+    }
+}
+// spread, per-numa-node, a CPU list or a list of them, one per replica
+static void _config_read_cpu_affinity(const YAML::Node &param, task_config &tconf)
+{
+    tconf.cpu_lists.clear();
+    if (param.IsSequence()) {
+        for (auto &list : param) tconf.cpu_lists.push_back(list.as<string>());
+        if (tconf.cpu_lists.empty())
+            throw runtime_error("cpu_affinity: empty list");
+    } else {
+        string value = param.as<string>();
+        if (value == "spread") {
+            tconf.affinity = proc::affinity_mode::SPREAD;
+            return;
+        } else if (value == "per-numa-node") {
+            tconf.affinity = proc::affinity_mode::PER_NUMA_NODE;
+            return;
+        }
+        tconf.cpu_lists.push_back(value);
+    }
+    cpu_set_t cpus;
+    for (auto &list : tconf.cpu_lists) proc::parse_cpu_list(list, cpus);
+    tconf.affinity = proc::affinity_mode::LIST;
+}
+static void _config_read_nice(const YAML::Node &param, task_config &tconf)
+{
+    tconf.sched.nice = param.as<int>();
+    if (tconf.sched.nice < -20 || tconf.sched.nice > 19)
+        throw runtime_error("nice: out of range: " + param.as<string>());
+    tconf.sched.set_nice = true;
+}
+static const unordered_map<string, int> _ioprio_class_map = {
+    {"rt",   IOPRIO_CLASS_RT},
+    {"be",   IOPRIO_CLASS_BE},
+    {"idle", IOPRIO_CLASS_IDLE}
+};
+// CLASS/LEVEL like be/4 or rt/0, idle has no level
+static void _config_read_ioprio(const YAML::Node &param, task_config &tconf)
+{
+    string value = param.as<string>();
+    auto slash = value.find('/');
+    auto it = _ioprio_class_map.find(value.substr(0, slash));
+    int level = 0;
+    if (it != _ioprio_class_map.end() && slash != string::npos)
+        level = stoi(value.substr(slash + 1));
+    if (it == _ioprio_class_map.end() || level < 0 || level > 7)
+        throw runtime_error("unexpected value: ioprio: " + value);
+    tconf.sched.ioprio = IOPRIO_PRIO_VALUE(it->second, level);
+}
+static const unordered_map<string, int> _sched_policy_map = {
+    {"other", SCHED_OTHER},
+    {"batch", SCHED_BATCH},
+    {"idle",  SCHED_IDLE},
+    {"fifo",  SCHED_FIFO},
+    {"rr",    SCHED_RR}
+};
+// other, batch, idle or fifo:PRIORITY, rr:PRIORITY
+static void _config_read_sched_policy(const YAML::Node &param, task_config &tconf)
+{
+    string value = param.as<string>();
+    auto colon = value.find(':');
+    auto it = _sched_policy_map.find(value.substr(0, colon));
+    if (it == _sched_policy_map.end())
+        throw runtime_error("unexpected value: sched_policy: " + value);
+    bool realtime = it->second == SCHED_FIFO || it->second == SCHED_RR;
+    int priority = colon == string::npos ? 0 : stoi(value.substr(colon + 1));
+    if (realtime != (colon != string::npos) ||
+        priority < sched_get_priority_min(it->second) ||
+        priority > sched_get_priority_max(it->second))
+        throw runtime_error("unexpected priority: sched_policy: " + value);
+    tconf.sched.policy = it->second;
+    tconf.sched.priority = priority;
+}
+static const unordered_map<string, int> _rlimit_names_map = {
+    {"as",         RLIMIT_AS},
+    {"core",       RLIMIT_CORE},
+    {"cpu",        RLIMIT_CPU},
+    {"data",       RLIMIT_DATA},
+    {"fsize",      RLIMIT_FSIZE},
+    {"locks",      RLIMIT_LOCKS},
+    {"memlock",    RLIMIT_MEMLOCK},
+    {"msgqueue",   RLIMIT_MSGQUEUE},
+    {"nice",       RLIMIT_NICE},
+    {"nofile",     RLIMIT_NOFILE},
+    {"nproc",      RLIMIT_NPROC},
+    {"rss",        RLIMIT_RSS},
+    {"rtprio",     RLIMIT_RTPRIO},
+    {"rttime",     RLIMIT_RTTIME},
+    {"sigpending", RLIMIT_SIGPENDING},
+    {"stack",      RLIMIT_STACK}
+};
+static rlim_t _parse_rlim(const string &value)
+{
+    if (value == "unlimited" || value == "infinity") return RLIM_INFINITY;
+    return _parse_bytes(value);
+}
+// NAME: LIMIT or NAME: SOFT:HARD, a limit is a number or unlimited
+static void _config_read_rlimits(const YAML::Node &param, task_config &tconf)
+{
+    for (auto &limit : param) {
+        string name = limit.first.as<string>();
+        auto it = _rlimit_names_map.find(name);
+        if (it == _rlimit_names_map.end())
+            throw runtime_error("unknown rlimit: " + name);
+        string value = limit.second.as<string>();
+        auto colon = value.find(':');
+        rlimit rl;
+        rl.rlim_cur = _parse_rlim(value.substr(0, colon));
+        rl.rlim_max = colon == string::npos ? rl.rlim_cur :
+                      _parse_rlim(value.substr(colon + 1));
+        if (rl.rlim_cur > rl.rlim_max)
+            throw runtime_error("rlimits: " + name + ": soft limit above hard");
+        tconf.sched.rlimits.emplace_back(it->second, rl);
+    }
+}
+static double _config_read_seconds(const YAML::Node &param, const string &key)
+{
+    double seconds = param.as<double>();
+    if (seconds < 0) throw runtime_error(key + ": negative value");
+    return seconds;
+}
+static void _config_read_backoff_initial(const YAML::Node &param, task_config &tconf)
+{
+    tconf.backoff_initial = _config_read_seconds(param, "backoff_initial");
+}
+static void _config_read_backoff_multiplier(const YAML::Node &param, task_config &tconf)
+{
+    tconf.backoff_multiplier = param.as<double>();
+    if (tconf.backoff_multiplier < 1)
+        throw runtime_error("backoff_multiplier: must be at least 1");
+}
+static void _config_read_backoff_max(const YAML::Node &param, task_config &tconf)
+{
+    tconf.backoff_max = _config_read_seconds(param, "backoff_max");
+}
+static void _config_read_backoff_jitter(const YAML::Node &param, task_config &tconf)
+{
+    tconf.backoff_jitter = param.as<double>();
+    if (tconf.backoff_jitter < 0 || tconf.backoff_jitter > 1)
+        throw runtime_error("backoff_jitter: must be between 0 and 1");
+}
+static void _config_read_crashloop_exits(const YAML::Node &param, task_config &tconf)
+{
+    tconf.crashloop_exits = param.as<size_t>();
+}
+static void _config_read_crashloop_window(const YAML::Node &param, task_config &tconf)
+{
+    tconf.crashloop_window = param.as<time_t>();
+}
+static void _config_read_crashloop_action(const YAML::Node &param, task_config &tconf)
+{
+    string action = param.as<string>();
+    if (action == "backoff")
+        tconf.crashloop_action = task_config::CRASHLOOP_BACKOFF;
+    else if (action == "fatal")
+        tconf.crashloop_action = task_config::CRASHLOOP_FATAL;
+    else
+        throw runtime_error("unexpected value: crashloop_action: " + action);
+}
+static void _config_read_groups(const YAML::Node &param, task_config &tconf)
+{
+    // A single group may be given without a list
+    if (param.IsScalar()) tconf.groups.push_back(param.as<string>());
+    else for (auto &group : param) tconf.groups.push_back(group.as<string>());
+}
+static void _config_read_depends_on(const YAML::Node &param, task_config &tconf)
+{
+    if (param.IsScalar()) tconf.depends_on.push_back(param.as<string>());
+    else for (auto &dep : param) tconf.depends_on.push_back(dep.as<string>());
+}
+static const unordered_map<string, decltype(probe_config::PROBE_NONE)> _probe_kinds_map = {
+    {"tcp",  probe_config::PROBE_TCP},
+    {"unix", probe_config::PROBE_UNIX},
+    {"exec", probe_config::PROBE_EXEC},
+    {"file", probe_config::PROBE_FILE}
+};
+// One of tcp: [HOST:]PORT, unix: PATH, exec: COMMAND or file: PATH, and
+// delay, interval, timeout and failures
+static probe_config _config_read_probe(const YAML::Node &param, const string &key)
+{
+    probe_config probe;
+    for (auto &field : param) {
+        string name = field.first.as<string>();
+        auto kind = _probe_kinds_map.find(name);
+        if (kind != _probe_kinds_map.end()) {
+            if (probe.kind != probe_config::PROBE_NONE)
+                throw runtime_error(key + ": more than one check");
+            probe.kind = kind->second;
+            probe.target = field.second.as<string>();
+        } else if (name == "delay") {
+            probe.delay = _config_read_seconds(field.second, key + ": delay");
+        } else if (name == "interval") {
+            probe.interval = _config_read_seconds(field.second, key + ": interval");
+        } else if (name == "timeout") {
+            probe.timeout = _config_read_seconds(field.second, key + ": timeout");
+        } else if (name == "failures") {
+            probe.failures = field.second.as<unsigned>();
+        } else {
+            throw runtime_error(key + ": unknown field: " + name);
+        }
+    }
+    if (probe.kind == probe_config::PROBE_NONE)
+        throw runtime_error(key + ": one of tcp, unix, exec or file is needed");
+    sockaddr_storage addr;
+    socklen_t len;
+    if (probe.kind == probe_config::PROBE_TCP &&
+        !prober::parse_address(probe.target, addr, len))
+        throw runtime_error(key + ": tcp: not a [HOST:]PORT with a numeric host: " +
+                            probe.target);
+    if (probe.interval <= 0 || probe.timeout <= 0)
+        throw runtime_error(key + ": interval and timeout must be positive");
+    return probe;
+}
+static void _config_read_readiness(const YAML::Node &param, task_config &tconf)
+{
+    tconf.readiness = _config_read_probe(param, "readiness");
+}
+static void _config_read_liveness(const YAML::Node &param, task_config &tconf)
+{
+    tconf.liveness = _config_read_probe(param, "liveness");
+}
+
+static void _config_read_master(const YAML::Node &params, master_config &mconf,
+                                ostream &warn)
+{
+    for (auto param = params.begin(); param != params.end(); ++param) {
+        const string &param_name(param->first.as<string>());
+        auto func = _master_read_funcs_map.find(param_name);
+        if (func != _master_read_funcs_map.end()) {
+            func->second(param->second, mconf);
+        } else {
+            warn << "Warning: Ignore unknown config parameter: " <<
+                    MASTER_SECTION << ": " << param_name << endl;
+        }
+    }
+}
+
+// Reads the programs of one file. Warnings go to warn so that the files
+// parsed together do not interleave them
+static vector<task_config> _tconfs_from_node(const YAML::Node &config,
+                                             master_config *mconf, ostream &warn)
+{
+    vector<task_config> task_cfgs;
+    task_cfgs.reserve(config.size());
+    for (auto prog = config.begin(); prog != config.end(); ++prog) {
+        task_config tconf;
+
+        tconf.name = prog->first.as<std::string>();
+        if (tconf.name == MASTER_SECTION) {
+            if (mconf) _config_read_master(prog->second, *mconf, warn);
+            else warn << "Warning: Ignore " << MASTER_SECTION <<
+                         " section outside of the main config file" << endl;
+            continue;
+        }
+        const YAML::Node &params = prog->second;
+        for (auto param = params.begin(); param != params.end(); ++param) {
+            const string &param_name(param->first.as<string>());
+            auto func = _read_funcs_map.find(param_name);
+            if (func != _read_funcs_map.end()) {
+                func->second(param->second, tconf);
+            } else {
+                warn << "Warning: Ignore unknown config parameter: " <<
+                        tconf.name << ": " << param_name << endl;
+            }
+        }
+        task_cfgs.push_back(move(tconf));
+    }
+    return task_cfgs;
+}
+
+static runtime_error _parse_error(const string &file, const string &what)
+{
+    return runtime_error("Error while parsing configuration file: " + file +
+                         ": " + what + "\n" +
+                         "The tasks are left as they were, run reload config to retry.");
+}
+
+static YAML::Node _load_config_file(const string &file)
+{
+    YAML::Node config = YAML::LoadFile(file);
+    if (config.IsNull()) throw YAML::Exception(YAML::Mark(), "file is empty");
+    return config;
+}
+
+bool is_config_name(const string &name)
+{
+    auto ends_with = [&name](const string &ext) {
+        return name.size() > ext.size() &&
+               !name.compare(name.size() - ext.size(), ext.size(), ext);
+    };
+    return name[0] != '.' && (ends_with(".yaml") || ends_with(".yml"));
+}
+
+vector<string> list_config_dir(const string &dir)
+{
+    DIR *d = opendir(dir.c_str());
+    if (!d) throw runtime_error(dir + ": " + strerror(errno));
+    vector<string> files;
+    while (dirent *entry = readdir(d))
+        if (is_config_name(entry->d_name)) files.push_back(dir + "/" + entry->d_name);
+    closedir(d);
+    sort(files.begin(), files.end());
+    return files;
+}
+
+// A relative include directory is found next to the main file
+static string _include_path(const string &file, const string &dir)
+{
+    auto slash = file.rfind('/');
+    if (dir[0] == '/' || slash == string::npos) return dir;
+    return file.substr(0, slash + 1) + dir;
+}
+
+// Throws if a task depends on a missing task or, through others, on itself
+static void _check_dependencies(const vector<task_config> &task_cfgs)
+{
+    unordered_map<string, size_t> index;
+    index.reserve(task_cfgs.size());
+    for (size_t i = 0; i < task_cfgs.size(); i++) index.emplace(task_cfgs[i].name, i);
+    vector<size_t> pending(task_cfgs.size());
+    vector<vector<size_t>> dependents(task_cfgs.size());
+    for (size_t i = 0; i < task_cfgs.size(); i++) {
+        for (auto &dep : task_cfgs[i].depends_on) {
+            auto it = index.find(dep);
+            if (it == index.end())
+                throw runtime_error("depends_on: " + task_cfgs[i].name +
+                                    ": no such task: " + dep);
+            dependents[it->second].push_back(i);
+            ++pending[i];
+        }
+    }
+    // Tasks are removed once their dependencies are, the rest are on a
+    // cycle or depend on one
+    vector<size_t> ready;
+    for (size_t i = 0; i < task_cfgs.size(); i++)
+        if (!pending[i]) ready.push_back(i);
+    size_t removed = 0;
+    while (!ready.empty()) {
+        size_t i = ready.back();
+        ready.pop_back();
+        ++removed;
+        for (auto next : dependents[i])
+            if (!--pending[next]) ready.push_back(next);
+    }
+    if (removed == task_cfgs.size()) return;
+    // A task left always has a dependency left, follow them until one repeats
+    size_t i = find_if(pending.begin(), pending.end(),
+                       [](size_t n) {return n;}) - pending.begin();
+    vector<size_t> path;
+    vector<size_t> seen_at(task_cfgs.size(), SIZE_MAX);
+    while (seen_at[i] == SIZE_MAX) {
+        seen_at[i] = path.size();
+        path.push_back(i);
+        for (auto &dep : task_cfgs[i].depends_on) {
+            size_t j = index[dep];
+            if (pending[j]) {
+                i = j;
+                break;
+            }
+        }
+    }
+    string cycle;
+    for (size_t k = seen_at[i]; k < path.size(); k++)
+        cycle += task_cfgs[path[k]].name + " -> ";
+    throw runtime_error("depends_on: cycle: " + cycle + task_cfgs[i].name);
+}
 
-vector<task_config> tconfs_from_yaml(const std::string &file)
+vector<task_config> tconfs_from_yaml(const std::string &file, master_config *mconf)
 {
+    master_config local;
+    if (!mconf) mconf = &local;
+    vector<task_config> task_cfgs;
+    vector<string> files;
     try {
-        YAML::Node config = YAML::LoadFile(file);
-
-        if (config.IsNull()) throw YAML::Exception(YAML::Mark(), "file is empty");
-
-        vector<task_config> task_cfgs;
-        for (auto prog = config.begin(); prog != config.end(); ++prog) {
-            task_config tconf;
-
-            tconf.name = prog->first.as<std::string>();
-            if (any_of(task_cfgs.begin(), task_cfgs.end(),
-                [&tconf](const task_config &c){return tconf.name == c.name;}))
-                throw runtime_error("duplicate name: " + tconf.name);
-            YAML::Node &params = prog->second;
-            for (auto param = params.begin(); param != params.end(); ++param) {
-                const string &param_name(param->first.as<string>());
-                if (_read_funcs_map.find(param_name) != _read_funcs_map.end()) {
-                    _read_funcs_map[param_name](param->second, tconf);
-                } else {
-                    clog << "Warning: Ignore unknown config parameter: " <<
-                            tconf.name << ": " << param_name << endl;
-                }
+        task_cfgs = _tconfs_from_node(_load_config_file(file), mconf, clog);
+        if (!mconf->include.empty()) {
+            mconf->include = _include_path(file, mconf->include);
+            files = mconf->include_files = list_config_dir(mconf->include);
+        }
+    } catch (const exception &e) {
+        throw _parse_error(file, e.what());
+    }
+
+    // The included files are parsed concurrently, one at a time per thread
+    vector<vector<task_config>> parsed(files.size());
+    vector<string> warnings(files.size());
+    vector<string> errors(files.size());
+    atomic<size_t> next{0};
+    auto parse = [&]() {
+        for (size_t i; (i = next++) < files.size();) {
+            ostringstream warn;
+            try {
+                parsed[i] = _tconfs_from_node(_load_config_file(files[i]), nullptr, warn);
+            } catch (const exception &e) {
+                errors[i] = e.what();
             }
-            task_cfgs.push_back(tconf);
+            warnings[i] = warn.str();
         }
-        return task_cfgs;
+    };
+    size_t workers = min<size_t>(files.size(), max(1u, thread::hardware_concurrency()));
+    vector<thread> threads;
+    for (size_t i = 1; i < workers; i++) threads.emplace_back(parse);
+    parse();
+    for (auto &t : threads) t.join();
+
+    for (size_t i = 0; i < files.size(); i++) {
+        clog << warnings[i];
+        if (!errors[i].empty()) throw _parse_error(files[i], errors[i]);
+    }
+    // Names are unique across the files
+    unordered_map<string, const string *> origin;
+    size_t count = task_cfgs.size();
+    for (auto &p : parsed) count += p.size();
+    origin.reserve(count);
+    task_cfgs.reserve(count);
+    for (auto &tconf : task_cfgs)
+        if (!origin.emplace(tconf.name, &file).second)
+            throw _parse_error(file, "duplicate name: " + tconf.name);
+    for (size_t i = 0; i < files.size(); i++) {
+        for (auto &tconf : parsed[i]) {
+            auto seen = origin.emplace(tconf.name, &files[i]);
+            if (!seen.second)
+                throw _parse_error(files[i], "duplicate name: " + tconf.name +
+                                   ", also in " + *seen.first->second);
+            task_cfgs.push_back(move(tconf));
+        }
+    }
+    try {
+        _check_dependencies(task_cfgs);
     } catch (const exception &e) {
-        throw runtime_error("Error while parsing configuration file: " + file +
-                            ": " + e.what() + "\n" +
-                            "Configuration aborted, run reload config to retry.");
+        throw _parse_error(file, e.what());
     }
+    return task_cfgs;
+}
+
+// Every field but the ones the task reads when it needs them
+static bool _same_setup(const task_config &a, const task_config &b)
+{
+    auto same_rlimits = [](const proc::sched_params &x, const proc::sched_params &y) {
+        return equal(x.rlimits.begin(), x.rlimits.end(),
+                     y.rlimits.begin(), y.rlimits.end(),
+                     [](const pair<int, rlimit> &l, const pair<int, rlimit> &r) {
+            return l.first == r.first && l.second.rlim_cur == r.second.rlim_cur &&
+                   l.second.rlim_max == r.second.rlim_max;
+        });
+    };
+    return a.bin == b.bin && a.args == b.args && a.envs == b.envs &&
+           a.mask == b.mask && a.workdir == b.workdir &&
+           a.stdin_file == b.stdin_file && a.stdout_file == b.stdout_file &&
+           a.stderr_file == b.stderr_file && a.zygote == b.zygote &&
+           a.capture == b.capture && a.maxbytes == b.maxbytes &&
+           a.backups == b.backups && a.prefix == b.prefix &&
+           a.tailbytes == b.tailbytes && a.cgroup_mode == b.cgroup_mode &&
+           a.cgroup_limits == b.cgroup_limits &&
+           a.affinity == b.affinity && a.cpu_lists == b.cpu_lists &&
+           a.sched.set_nice == b.sched.set_nice && a.sched.nice == b.sched.nice &&
+           a.sched.ioprio == b.sched.ioprio && a.sched.policy == b.sched.policy &&
+           a.sched.priority == b.sched.priority && same_rlimits(a.sched, b.sched);
+}
+
+static bool _same_live(const task_config &a, const task_config &b)
+{
+    return a.numprocs == b.numprocs && a.autostart == b.autostart &&
+           a.autorestart == b.autorestart && a.exitcodes == b.exitcodes &&
+           a.startretries == b.startretries && a.startsecs == b.startsecs &&
+           a.stopsignal == b.stopsignal && a.stopsecs == b.stopsecs &&
+           a.max_rss == b.max_rss && a.max_cpu == b.max_cpu &&
+           a.max_cpu_secs == b.max_cpu_secs && a.max_fds == b.max_fds &&
+           a.watchdog_action == b.watchdog_action &&
+           a.watchdog_signal == b.watchdog_signal &&
+           a.backoff_initial == b.backoff_initial &&
+           a.backoff_multiplier == b.backoff_multiplier &&
+           a.backoff_max == b.backoff_max && a.backoff_jitter == b.backoff_jitter &&
+           a.crashloop_exits == b.crashloop_exits &&
+           a.crashloop_window == b.crashloop_window &&
+           a.crashloop_action == b.crashloop_action && a.groups == b.groups &&
+           a.depends_on == b.depends_on && a.readiness == b.readiness &&
+           a.liveness == b.liveness;
+}
+
+config_change compare_configs(const task_config &old, const task_config &next)
+{
+    if (!_same_setup(old, next)) return config_change::RESTART;
+    if (_same_live(old, next)) return config_change::NONE;
+    // The watchdog timer and the per replica groups and placements are
+    // set up with the task
+    auto watched = [](const task_config &c) {
+        return c.max_rss || c.max_cpu > 0 || c.max_fds;
+    };
+    if (watched(old) != watched(next)) return config_change::RESTART;
+    if (old.numprocs != next.numprocs &&
+        (next.cgroup_mode != task_config::CGROUP_NONE ||
+         next.affinity != proc::affinity_mode::NONE))
+        return config_change::RESTART;
+    return config_change::LIVE;
 }
 
 void print_config(const task_config &tconf, ostream &stream)
@@ -374,7 +1741,98 @@ void print_config(const task_config &tconf, ostream &stream)
     stream << "    Startseconds: " << tconf.startsecs << endl;
     stream << "    Stopsignal: " << tconf.stopsignal << endl;
     stream << "    Stopseconds: " << tconf.stopsecs << endl;
+    stream << "    Backoff: " << tconf.backoff_initial << "s x" <<
+              tconf.backoff_multiplier << " up to " << tconf.backoff_max <<
+              "s, jitter " << tconf.backoff_jitter << endl;
+    if (!tconf.groups.empty()) {
+        stream << "    Groups:";
+        for (auto &group : tconf.groups) stream << " " << group;
+        stream << endl;
+    }
+    if (!tconf.depends_on.empty()) {
+        stream << "    Depends on:";
+        for (auto &dep : tconf.depends_on) stream << " " << dep;
+        stream << endl;
+    }
+    auto print_probe = [&stream](const char *title, const probe_config &probe,
+                                 bool restarts) {
+        static const char *kinds[] = {"none", "tcp", "unix", "exec", "file"};
+        if (probe.kind == probe_config::PROBE_NONE) return;
+        stream << "    " << title << ": " << kinds[probe.kind] << " " <<
+                  probe.target << ", delay " << probe.delay << "s, every " <<
+                  probe.interval << "s, timeout " << probe.timeout << "s";
+        if (restarts) stream << ", restart after " << probe.failures << " failures";
+        stream << endl;
+    };
+    print_probe("Readiness", tconf.readiness, false);
+    print_probe("Liveness", tconf.liveness, true);
+    if (tconf.crashloop_exits)
+        stream << "    Crash loop: " << tconf.crashloop_exits << " exits in " <<
+                  tconf.crashloop_window << "s, " <<
+                  (tconf.crashloop_action == task_config::CRASHLOOP_FATAL ?
+                   "fatal" : "backoff") << endl;
     stream << "    Stdin file: " << tconf.stdin_file << endl;
     stream << "    Stdout file: " << tconf.stdout_file << endl;
     stream << "    Stderr file: " << tconf.stderr_file << endl;
+    stream << "    Zygote: " << (tconf.zygote ? "true" : "false") << endl;
+    stream << "    Capture: " << (tconf.capture ? "true" : "false") << endl;
+    if (tconf.capture) {
+        stream << "    Maxbytes: " << tconf.maxbytes << endl;
+        stream << "    Backups: " << tconf.backups << endl;
+        stream << "    Prefix: " << (tconf.prefix ? "true" : "false") << endl;
+        stream << "    Tailbytes: " << tconf.tailbytes << endl;
+    }
+    if (tconf.max_rss || tconf.max_cpu > 0 || tconf.max_fds) {
+        stream << "    Watchdog: ";
+        if (tconf.watchdog_action == task_config::WATCHDOG_RESTART)
+            stream << "restart" << endl;
+        else if (tconf.watchdog_action == task_config::WATCHDOG_STOP)
+            stream << "stop" << endl;
+        else
+            stream << "signal " << tconf.watchdog_signal << endl;
+        stream << "        max_rss: " << tconf.max_rss << endl;
+        stream << "        max_cpu: " << tconf.max_cpu << "% for " <<
+                  tconf.max_cpu_secs << "s" << endl;
+        stream << "        max_fds: " << tconf.max_fds << endl;
+    }
+    if (tconf.cgroup_mode != task_config::CGROUP_NONE) {
+        stream << "    Cgroup: " <<
+                  (tconf.cgroup_mode == task_config::CGROUP_TASK ? "task" : "replica") <<
+                  endl;
+        for (auto &limit : tconf.cgroup_limits)
+            stream << "        " << limit.first << ": " << limit.second << endl;
+    }
+    switch (tconf.affinity) {
+    case proc::affinity_mode::SPREAD:
+        stream << "    CPU affinity: spread" << endl;
+        break;
+    case proc::affinity_mode::PER_NUMA_NODE:
+        stream << "    CPU affinity: per-numa-node" << endl;
+        break;
+    case proc::affinity_mode::LIST:
+        stream << "    CPU affinity:";
+        for (auto &list : tconf.cpu_lists) stream << " " << list;
+        stream << endl;
+        break;
+    default:;
+    }
+    if (tconf.sched.set_nice)
+        stream << "    Nice: " << tconf.sched.nice << endl;
+    auto name_of = [](const unordered_map<string, int> &names, int value) {
+        for (auto &name : names)
+            if (name.second == value) return name.first;
+        return to_string(value);
+    };
+    if (tconf.sched.ioprio != -1)
+        stream << "    Ioprio: " <<
+                  name_of(_ioprio_class_map, IOPRIO_PRIO_CLASS(tconf.sched.ioprio)) <<
+                  "/" << IOPRIO_PRIO_DATA(tconf.sched.ioprio) << endl;
+    if (tconf.sched.policy != -1)
+        stream << "    Sched policy: " <<
+                  name_of(_sched_policy_map, tconf.sched.policy) << ":" <<
+                  tconf.sched.priority << endl;
+    for (auto &limit : tconf.sched.rlimits)
+        stream << "    Rlimit " << name_of(_rlimit_names_map, limit.first) <<
+                  ": " << limit.second.rlim_cur << ":" <<
+                  limit.second.rlim_max << endl;
 }
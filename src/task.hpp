@@ -6,13 +6,53 @@
 
 #include <vector>
 #include <string>
+#include <deque>
+#include <chrono>
 
 #include "process.hpp"
+#include "runtime.hpp"
+#include "zygote.hpp"
+#include "defaults.hpp"
+#include "status_report.hpp"
+#include "prober.hpp"
 
 struct task_config;
+struct master_config;
 
 void print_config(const task_config &tconf, std::ostream &stream);
-std::vector<task_config> tconfs_from_yaml(const std::string &file);
+// The reserved 'taskmaster' section is read into mconf if it is given.
+// The files of its include directory are parsed on several threads
+std::vector<task_config> tconfs_from_yaml(const std::string &file,
+                                          master_config *mconf = nullptr);
+// True for the *.yaml and *.yml files read from an include directory
+bool is_config_name(const std::string &name);
+// The config files of an include directory in name order, throws if it
+// cannot be read
+std::vector<std::string> list_config_dir(const std::string &dir);
+
+// What a reload does to a task whose config is in both files
+enum class config_change {
+    NONE,
+    LIVE,                                    // See task::reconfigure()
+    RESTART                                  // The task is replaced
+};
+config_change compare_configs(const task_config &old, const task_config &next);
+
+// Daemon-wide settings, 0 disables a limit
+struct master_config
+{
+    master_config() = default;
+    std::size_t spawn_workers = 4;           // Threads that fork processes
+    double spawn_rate = 0;                   // Spawns per second
+    std::size_t max_starting = 0;            // Processes in STARTING
+    double sample_interval = TSAMPLE_INTERVAL; // Seconds between /proc sweeps
+    std::string include;                     // Directory of more program files,
+                                             // next to the file if relative
+    std::vector<std::string> include_files;  // Read from include
+    bool watch = false;                      // Reload when the files change
+    double watch_delay = TWATCH_DELAY;       // Seconds without change first
+    std::size_t max_probes = TPROBE_MAX_RUNNING; // Health probes in flight
+};
 
 struct task_config
 {
@@ -38,6 +78,52 @@ struct task_config
     std::string stdin_file = "/dev/null";
     std::string stdout_file = "/dev/null";
     std::string stderr_file = "/dev/null";
+    bool zygote = false;                     // Fork replicas from a template
+    bool capture = false;                    // Write the output through pipes
+    size_t maxbytes = 0;                     // Rotate captured logs, 0 never
+    size_t backups = 10;
+    bool prefix = false;                     // Prefix captured lines
+    size_t tailbytes = 64 * 1024;            // Output kept per replica for tail
+    enum {
+        CGROUP_NONE,
+        CGROUP_TASK,                         // One group for all replicas
+        CGROUP_REPLICA                       // Limits apply to each replica
+    } cgroup_mode = CGROUP_NONE;
+    // Interface files written to the limited group, e.g. {"pids.max", "10"}
+    std::vector<std::pair<std::string, std::string>> cgroup_limits;
+    // Watchdog of each replica, 0 disables a limit
+    std::uint64_t max_rss = 0;               // Bytes
+    double max_cpu = 0;                      // % of one core...
+    time_t max_cpu_secs = 0;                 // ...sustained for this long
+    unsigned max_fds = 0;
+    enum {
+        WATCHDOG_RESTART,                    // Restart the replica
+        WATCHDOG_STOP,                       // Stop the task
+        WATCHDOG_SIGNAL                      // Send watchdog_signal
+    } watchdog_action = WATCHDOG_RESTART;
+    int watchdog_signal = SIGTERM;
+    // Placement of each replica, lists are cycled over the replicas
+    proc::affinity_mode affinity = proc::affinity_mode::NONE;
+    std::vector<std::string> cpu_lists;
+    proc::sched_params sched;                // nice, ioprio, policy, rlimits
+    // Delay of the nth restart in a row is initial * multiplier^n, capped
+    double backoff_initial = TBACKOFF_INITIAL; // Seconds
+    double backoff_multiplier = TBACKOFF_MULTIPLIER;
+    double backoff_max = TBACKOFF_MAX;
+    double backoff_jitter = TBACKOFF_JITTER; // Share of a delay added or removed
+    // A crash loop is crashloop_exits restarts within crashloop_window
+    std::size_t crashloop_exits = 0;         // 0 disables the detection
+    time_t crashloop_window = 60;
+    enum {
+        CRASHLOOP_BACKOFF,                   // Pause restarts for backoff_max
+        CRASHLOOP_FATAL                      // Stop the task
+    } crashloop_action = CRASHLOOP_BACKOFF;
+    std::vector<std::string> groups;         // Select the task in commands
+    std::vector<std::string> depends_on;     // Tasks RUNNING before it starts
+    // RUNNING once every replica passed readiness, startsecs is the deadline
+    probe_config readiness;
+    // A replica failing liveness failures times in a row is restarted
+    probe_config liveness;
 };
 
 struct task_status
@@ -49,28 +135,132 @@ struct task_status
         RUNNING,
         EXITED,
         FATAL,
+        BACKOFF,                             // Restarts paused by a crash loop
         ERROR,
         UNKNOWN
     } state = STOPPED;
     size_t starttries = 0;
     time_t starttime = 0;
+    std::string error;                       // Why the last start failed
+    size_t watchdog_actions = 0;
+    std::string watchdog_reason;             // Of the last action
+    std::size_t crash_loops = 0;
+    std::size_t liveness_restarts = 0;
+    std::string probe_error;                 // Of the last failed probe
 };
 
-class task : private std::vector<proc::process>
+class task
 {
 public:
-    task(const task_config &tconf);
+    task(const task_config &tconf, runtime &rt);
+    ~task();
+    // Timers refer to the task, it must not be copied or moved
+    task(const task &) = delete;
+    task& operator=(const task &) = delete;
     void start();
     void stop();
-    void restart();
-    std::string status();
-    void update();
+    // Applies a config that compare_configs() found LIVE. Returns false if
+    // it cannot be applied now, the task has to be replaced then
+    bool reconfigure(const task_config &next);
+    void report(task_report &r) const;
+    std::size_t memory_usage() const;
+    // See master::tail()
+    std::string tail(std::vector<std::uint64_t> &cursors, std::size_t backlog) const;
+    const task_config &get_config() const {return config;}
+    bool is_starting() const {return state.state == task_status::STARTING;}
+    // A stopped replica is stopping until it is reaped
+    bool is_stopping() const;
+    int get_state() const {return state.state;}
+    const std::string &get_error() const {return state.error;}
 private:
+    // Publishes the transitions on rt.events
+    void set_state(int new_state);
+    void publish_proc(int kind, std::size_t index, int status);
     void exec();
+    void retry();
+    void spawn(std::size_t index, bool hold);
+    void on_spawned(std::size_t index, bool hold, pid_t pid, int err);
+    void on_exit(std::size_t index, int status);
     void kill(int signal = SIGKILL);
-    bool is_exited_normally(proc::process &p);
+    void stop_replica(std::size_t index, int signal);
+    void watch(std::size_t index, pid_t pid);
+    // Adds or stops replicas past count
+    void scale(std::size_t count);
+    void release_slots();
+    // STARTING -> RUNNING
+    void became_running();
+    // Retries the start or goes FATAL
+    void start_failed();
+    // Creates the cgroups of a new run, the old ones go when they are empty
+    void new_leaves();
+    // Checks the replicas against the limits on every sampler interval
+    void watchdog();
+    void arm_watchdog();
+    bool has_watchdog() const;
+    // Restarts an exited replica after its backoff delay
+    void schedule_restart(std::size_t index);
+    std::chrono::milliseconds backoff_delay(unsigned failures) const;
+    std::chrono::milliseconds with_jitter(double seconds) const;
+    void crash_loop();
+    void resume();
+    bool is_exited_normally(std::uint32_t row) const;
+    bool has_probes() const;
+    void schedule_probe(std::size_t index, bool readiness, double seconds);
+    void probe(std::size_t index, bool readiness);
+    void on_probe(std::size_t index, bool readiness, bool ok, const std::string &why);
+    // Drops the probes of a replica but not a restart in progress
+    void stop_probes(std::size_t index);
+    // Row of a replica in rt.procs
+    std::uint32_t row(std::size_t index) const {return procs.first + index;}
+    std::size_t size() const {return procs.count;}
     struct task_config config;
     struct task_status state;
+    std::shared_ptr<const proc::launch_spec> spec;
+    process_table::slice procs;              // Rows of the replicas
+    std::shared_ptr<class zygote> zygote;    // Set in zygote mode
+    std::shared_ptr<const log_writer::capture> capture; // Set in capture mode
+    std::shared_ptr<cgroup> cg;              // Group of the task, null if none
+    std::vector<std::shared_ptr<cgroup>> leaves; // Group of each replica
+    std::vector<proc::placement> placements; // Empty if the task has none
+    std::vector<timer_wheel::timer_id> leaf_timers; // Kill stopped leaves after stopsecs
+    struct replica_watch
+    {
+        double cpu_over = 0;                 // Seconds above max_cpu
+        std::chrono::steady_clock::time_point checked; // Last sample checked
+        bool restarting = false;             // Restarted by the watchdog
+        timer_wheel::timer_id kill_timer;    // SIGKILL after stopsecs
+    };
+    std::vector<replica_watch> watches;
+    timer_wheel::timer_id watchdog_timer;
+    struct replica_restart
+    {
+        unsigned failures = 0;               // Restarts since it last ran startsecs
+        timer_wheel::clock::time_point started;
+        timer_wheel::clock::time_point restart_at;
+        timer_wheel::timer_id timer;
+    };
+    std::vector<replica_restart> restarts;
+    struct replica_probe
+    {
+        timer_wheel::timer_id timer;         // Next probe
+        std::uint64_t running = 0;           // Probe in rt.probes, 0 if none
+        unsigned failures = 0;               // Liveness failures in a row
+        bool ready = false;                  // Passed readiness
+        bool restarting = false;             // Restarted by liveness
+        timer_wheel::timer_id kill_timer;    // SIGKILL after stopsecs
+    };
+    std::vector<replica_probe> probes;       // Empty if the task has none
+    std::deque<timer_wheel::clock::time_point> exits; // Restarts in crashloop_window
+    timer_wheel::clock::time_point retry_at; // Deadline of retry_timer or resume_timer
+    timer_wheel::timer_id resume_timer;      // BACKOFF -> RUNNING
+    runtime &rt;
+    timer_wheel::timer_id start_timer;       // STARTING -> RUNNING after startsecs
+    timer_wheel::timer_id retry_timer;       // Restart after a failed start
+    std::vector<pid_t> stopped;              // Sent stopsignal, maybe not reaped
+    std::vector<std::uint64_t> spawn_jobs;   // Queued spawn per replica, 0 if none
+    std::size_t spawning = 0;                // Replicas of exec() not started yet
+    // A replica holds a STARTING slot of rt.spawns until its timer fires
+    std::vector<timer_wheel::timer_id> slot_timers;
 };
 
 #endif // TASK_HPP
@@ -3,86 +3,400 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <sstream>
 #include <exception>
+#include <algorithm>
+#include <deque>
 
+#include <cerrno>
+#include <cstring>
 #include <csignal>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/inotify.h>
+#include <fnmatch.h>
 
 #include "taskmaster.hpp"
+#include "defaults.hpp"
 
 using namespace std;
 
 taskmaster *taskmaster::master_p = nullptr;
 
-taskmaster::taskmaster(const std::string &file) : config_file(file)
+// Rearms timer_fd after a command added or cancelled timers
+class taskmaster::timer_guard
+{
+public:
+    timer_guard(taskmaster &master) : master(master) {}
+    ~timer_guard() {master.arm_timer();}
+private:
+    taskmaster &master;
+};
+
+taskmaster::taskmaster(const std::string &file, const std::string &cache_file) :
+    config_file(file), cache(cache_file)
 {
     if (master_p) throw runtime_error("You cannot create more "
                                       "than one taskmaster object!");
     master_p = this;
-    signal(SIGCHLD, update);
+    // The signals are only delivered through signal_fd
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGHUP);
+    sigprocmask(SIG_BLOCK, &set, nullptr);
+    // Replicas forked by a zygote template are reparented to the daemon
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    signal_fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (signal_fd == -1 || timer_fd == -1)
+        throw runtime_error(string("failed to create event descriptors: ") +
+                            strerror(errno));
+    // Dependents of a task are checked again once its state changes
+    events_id = rt.events.subscribe([this](const task_event &event) {
+        if (event.kind == task_event::TASK_STATE || shutting_down)
+            changed.push_back(event.task);
+    });
     try {
         load_yaml_config(config_file);
     } catch (const exception &e) {
         clog << e.what() << endl;
     }
+    arm_timer();
     clog << "Taskmaster started" << endl;
 }
 
-bool taskmaster::load_yaml_config(const string &file)
+taskmaster::~taskmaster()
 {
-    config_file = file;
+    rt.events.unsubscribe(events_id);
+    // Tasks hold timers of the runtime
+    clear();
+    if (loop) {
+        loop->remove(signal_fd);
+        loop->remove(timer_fd);
+        loop->remove(rt.spawns.event_fd());
+        loop->remove(rt.probes.event_fd());
+        if (inotify_fd != -1) loop->remove(inotify_fd);
+    }
+    if (inotify_fd != -1) close(inotify_fd);
+    if (signal_fd != -1) close(signal_fd);
+    if (timer_fd != -1) close(timer_fd);
+    if (master_p == this) master_p = nullptr;
+}
+
+void taskmaster::attach(reactor &event_loop)
+{
+    loop = &event_loop;
+    loop->add(signal_fd, EPOLLIN, [this](uint32_t) {update();});
+    loop->add(timer_fd, EPOLLIN, [this](uint32_t) {update();});
+    loop->add(rt.spawns.event_fd(), EPOLLIN, [this](uint32_t) {update();});
+    loop->add(rt.probes.event_fd(), EPOLLIN, [this](uint32_t) {update();});
+    if (inotify_fd != -1)
+        loop->add(inotify_fd, EPOLLIN, [this](uint32_t) {on_config_event();});
+}
 
+// Watches the directories of the config file and of its include
+// directory, or stops watching if the config does not ask for it
+void taskmaster::watch_config(const master_config &mconf)
+{
+    if (!mconf.watch) {
+        if (inotify_fd == -1) return;
+        if (loop) loop->remove(inotify_fd);
+        close(inotify_fd);
+        inotify_fd = config_wd = include_wd = -1;
+        rt.timers.cancel(reload_timer);
+        return;
+    }
+    watch_delay = chrono::milliseconds(static_cast<long long>(mconf.watch_delay * 1000));
+    if (inotify_fd == -1) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd == -1) {
+            clog << "Warning: Cannot watch the config: " << strerror(errno) << endl;
+            return;
+        }
+        if (loop) loop->add(inotify_fd, EPOLLIN, [this](uint32_t) {on_config_event();});
+    }
+    if (config_wd != -1) inotify_rm_watch(inotify_fd, config_wd);
+    if (include_wd != -1 && include_wd != config_wd) inotify_rm_watch(inotify_fd, include_wd);
+    config_wd = include_wd = -1;
+    // Editors often replace a file rather than write it
+    auto slash = config_file.rfind('/');
+    string dir = slash == string::npos ? "." : config_file.substr(0, slash + 1);
+    config_wd = inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (!mconf.include.empty())
+        include_wd = inotify_add_watch(inotify_fd, mconf.include.c_str(),
+                                       IN_CLOSE_WRITE | IN_MOVED_TO |
+                                       IN_MOVED_FROM | IN_DELETE);
+    if (config_wd == -1 || (!mconf.include.empty() && include_wd == -1))
+        clog << "Warning: Cannot watch the config: " << strerror(errno) << endl;
+}
+
+// Reloads the config once the files have not changed for watch_delay
+void taskmaster::on_config_event()
+{
+    timer_guard guard(*this);
+    string base = config_file.substr(config_file.rfind('/') + 1);
+    bool changed = false;
+    alignas(inotify_event) char buf[4096];
+    for (ssize_t n; (n = read(inotify_fd, buf, sizeof(buf))) > 0;) {
+        for (char *p = buf; p < buf + n;) {
+            auto event = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+            string name = event->len ? event->name : "";
+            if (event->mask & IN_Q_OVERFLOW ||
+                (event->wd == config_wd && name == base) ||
+                (event->wd == include_wd && is_config_name(name)))
+                changed = true;
+        }
+    }
+    if (!changed || shutting_down) return;
+    rt.timers.cancel(reload_timer);
+    reload_timer = rt.timers.add(watch_delay, [this]() {
+        reload_timer = {};
+        if (shutting_down) return;
+        clog << "Config files changed, reloading" << endl;
+        on_job_done(submit(job_kind::RELOAD_CONFIG, {}), [](const job_info &info) {
+            clog << info.result << endl;
+        });
+    });
+}
+
+bool taskmaster::load_yaml_config(const string &file)
+{
     clog << "Config file: " << file << endl;
-    clear();
-    auto tconfigs = tconfs_from_yaml(file);
-    for (auto &i : tconfigs) print_config(i, clog);
-    for (auto &t : tconfigs) emplace(t.name, t);
+    master_config mconf;
+    vector<task_config> tconfigs;
+    bool cached = false;
+    try {
+        cached = cache.enabled() && cache.load(file, tconfigs, mconf);
+    } catch (const exception &e) {
+        clog << "Warning: Ignore config cache: " << e.what() << endl;
+    }
+    if (cached) {
+        clog << "Config read from cache: " << cache.get_path() << endl;
+    } else {
+        auto begin = chrono::system_clock::now();
+        // A file that does not parse leaves the tasks alone
+        tconfigs = tconfs_from_yaml(file, &mconf);
+        try {
+            if (cache.enabled()) cache.save(file, tconfigs, mconf, begin);
+        } catch (const exception &e) {
+            clog << "Warning: Cannot write config cache: " << e.what() << endl;
+        }
+    }
+    config_file = file;
+    auto plan = plan_reload(tconfigs);
+    rt.spawns.configure(mconf.spawn_workers, mconf.spawn_rate,
+                        mconf.max_starting);
+    rt.sampler.configure(chrono::milliseconds(
+        static_cast<long long>(mconf.sample_interval * 1000)));
+    rt.probes.configure(mconf.max_probes);
+    watch_config(mconf);
+    // A removed task is erased once its replicas are reaped, like the old
+    // task of a restart
+    for (auto &name : plan.removed) {
+        waiting.erase(name);
+        replacing.erase(name);
+        auto &t = at(name);
+        t.stop();
+        if (t.is_stopping()) removing.insert(name);
+        else erase(name);
+    }
+    for (auto c : plan.updated) {
+        if (at(c->name).reconfigure(*c)) print_config(*c, clog);
+        else plan.restarted.push_back(c);
+    }
+    // Autostart tasks are spawned concurrently by rt.spawns
+    vector<string> starting;
+    // The replacement waits for the old replicas like a restart job does,
+    // they must not run side by side
+    for (auto c : plan.restarted) {
+        auto &old = at(c->name);
+        int state = old.get_state();
+        auto pending = replacing.find(c->name);
+        bool was_waiting = waiting.erase(c->name) > 0;
+        bool running = state == task_status::STARTING || was_waiting ||
+                       state == task_status::RUNNING || state == task_status::BACKOFF ||
+                       (pending != replacing.end() && pending->second.start);
+        old.stop();
+        removing.erase(c->name);
+        if (old.is_stopping()) {
+            replacing[c->name] = {*c, c->autostart || running};
+            continue;
+        }
+        replacing.erase(c->name);
+        replace(*c);
+        if (c->autostart || running) starting.push_back(c->name);
+    }
+    for (auto c : plan.added) {
+        emplace(piecewise_construct, forward_as_tuple(c->name), forward_as_tuple(*c, rt));
+        print_config(*c, clog);
+        if (c->autostart) starting.push_back(c->name);
+    }
+    clog << render_plan(plan);
+    dependents.clear();
+    for (auto &t : *this) {
+        if (removing.count(t.first)) continue;
+        auto pending = replacing.find(t.first);
+        auto &tconf = pending == replacing.end() ? t.second.get_config() :
+                                                   pending->second.config;
+        for (auto &dep : tconf.depends_on) dependents[dep].push_back(t.first);
+    }
+    startup_begin = chrono::steady_clock::now();
+    startup_pending = true;
+    for (auto &name : starting) {
+        try {
+            // Waits for the dependencies, which are started too
+            if (!waiting.count(name) && !at(name).is_starting()) start_task(name);
+        } catch (const exception &e) {
+            clog << name << ": " << e.what() << endl;
+        }
+    }
+    check_startup();
     return (configured = true);
 }
 
-string taskmaster::start(const std::string &name)
+taskmaster::reload_plan taskmaster::plan_reload(const vector<task_config> &configs) const
 {
-    auto t = find(name);
-    if (t == end()) throw runtime_error("no such task");
-    t->second.start();
-    return name + ": started";
+    reload_plan plan;
+    unordered_set<string> names;
+    for (auto &c : configs) {
+        names.insert(c.name);
+        auto t = find(c.name);
+        if (t == end()) {
+            plan.added.push_back(&c);
+            continue;
+        }
+        // A task waiting for its replacement compares with the new config,
+        // which cannot be applied to the old task. A task being removed
+        // comes back as a new one once it is reaped
+        if (removing.count(c.name)) {
+            plan.restarted.push_back(&c);
+            continue;
+        }
+        auto pending = replacing.find(c.name);
+        bool replaced = pending != replacing.end();
+        switch (compare_configs(replaced ? pending->second.config : t->second.get_config(), c)) {
+        case config_change::NONE:
+            ++plan.unchanged;
+            break;
+        case config_change::LIVE:
+            if (replaced) plan.restarted.push_back(&c);
+            else plan.updated.push_back(&c);
+            break;
+        case config_change::RESTART:
+            plan.restarted.push_back(&c);
+            break;
+        }
+    }
+    for (auto &t : *this)
+        if (!names.count(t.first) && !removing.count(t.first))
+            plan.removed.push_back(t.first);
+    sort(plan.removed.begin(), plan.removed.end());
+    return plan;
 }
 
-string taskmaster::stop(const std::string &name)
+string taskmaster::render_plan(const reload_plan &plan)
 {
-    auto t = find(name);
-    if (t == end()) throw runtime_error("no such task");
-    t->second.stop();
-    return name + ": stopped";
+    ostringstream s;
+    auto list = [&s](const char *what, const vector<const task_config *> &configs) {
+        if (configs.empty()) return;
+        s << "  " << what << ":";
+        for (auto c : configs) s << " " << c->name;
+        s << "\n";
+    };
+    s << "reload: " << plan.added.size() << " added, " << plan.removed.size() <<
+         " removed, " << plan.restarted.size() << " restarted, " <<
+         plan.updated.size() << " updated in place, " << plan.unchanged <<
+         " unchanged\n";
+    list("add", plan.added);
+    if (!plan.removed.empty()) {
+        s << "  remove:";
+        for (auto &name : plan.removed) s << " " << name;
+        s << "\n";
+    }
+    list("restart", plan.restarted);
+    list("update", plan.updated);
+    return s.str();
 }
 
-string taskmaster::restart(const std::string &name)
+string taskmaster::plan_reload(const string &file)
 {
-    auto t = find(name);
-    if (t == end()) throw runtime_error("no such task");
-    t->second.restart();
-    return name + ": restarted";
+    auto tconfigs = tconfs_from_yaml(file.empty() ? config_file : file);
+    return render_plan(plan_reload(tconfigs));
+}
+
+void taskmaster::status(const status_query &query, const status_sink &out)
+{
+    status_renderer renderer(query.json);
+    bool reading = true;
+    report(query, TSTATUS_CHUNK, [&](const status_report &part) {
+        return (reading = out(renderer.render(part)));
+    });
+    if (reading) out(renderer.finish());
 }
 
-// An empty name returns the status of all programs
-string taskmaster::status(const std::string &name)
+void taskmaster::report(const status_query &query, size_t chunk,
+                        const function<bool(const status_report &)> &sink) const
 {
-    taskmaster::update();
-    if (name.empty()) {
-        string s("status:\n");
-        if (empty()) return "no tasks\n";
-        for (auto &p : *this) {
-            s += p.second.status();
+    vector<const value_type *> matched;
+    for (auto &t : *this) {
+        int state = t.second.get_state();
+        if ((!query.pattern.empty() &&
+             fnmatch(query.pattern.c_str(), t.first.c_str(), 0)) ||
+            (query.states && !(query.states & 1u << state)) ||
+            (query.failed && !is_failed_state(state)))
+            continue;
+        matched.push_back(&t);
+    }
+    if (matched.empty() && !query.pattern.empty() &&
+        query.pattern.find_first_of("*?[") == string::npos && find(query.pattern) == end())
+        throw runtime_error("no such task");
+    sort(matched.begin(), matched.end(),
+         [](const value_type *a, const value_type *b) {return a->first < b->first;});
+
+    status_report part;
+    part.all = query.pattern.empty() && !query.states && !query.failed;
+    part.startup_pending = startup_pending;
+    part.spawns_queued = rt.spawns.queued();
+    part.procs_starting = rt.spawns.starting();
+    part.startup_ms = startup_time.count();
+    part.now = time(nullptr);
+    part.total = matched.size();
+    part.offset = min<size_t>(query.offset, matched.size());
+    part.count = matched.size() - part.offset;
+    if (query.limit) part.count = min<uint64_t>(part.count, query.limit);
+    if (!sink(part)) return;
+    // Only one part is reported at a time
+    size_t last = part.offset + part.count;
+    for (size_t i = part.offset; i < last; i += chunk) {
+        part.tasks.clear();
+        part.tasks.resize(min(chunk, last - i));
+        for (size_t j = 0; j < part.tasks.size(); ++j) {
+            auto &t = *matched[i + j];
+            t.second.report(part.tasks[j]);
+            auto w = waiting.find(t.first);
+            if (w != waiting.end()) part.tasks[j].waiting_for = w->second;
         }
-        return s;
+        if (!sink(part)) return;
     }
+}
+
+string taskmaster::tail(const string &name, vector<uint64_t> &cursors,
+                        size_t backlog)
+{
     auto t = find(name);
     if (t == end()) throw runtime_error("no such task");
-    return "status:\n" + t->second.status();
-
+    return t->second.tail(cursors, backlog);
 }
 
 string taskmaster::reload_config(const string &file)
 {
+    timer_guard guard(*this);
     try {
         load_yaml_config(file.empty() ? config_file : file);
     } catch (const exception &e) {
@@ -91,13 +405,400 @@ string taskmaster::reload_config(const string &file)
     return "config " + (file.empty() ? config_file : file) + " loaded";
 }
 
+vector<string> taskmaster::select(const vector<string> &targets) const
+{
+    set<string> names;
+    for (auto &target : targets) {
+        bool found = target == "all";
+        for (auto &t : *this) {
+            if (removing.count(t.first)) continue;
+            auto &groups = t.second.get_config().groups;
+            if (target == "all" || target == t.first ||
+                std::find(groups.begin(), groups.end(), target) != groups.end() ||
+                !fnmatch(target.c_str(), t.first.c_str(), 0)) {
+                names.insert(t.first);
+                found = true;
+            }
+        }
+        if (!found) throw runtime_error(target + ": no such task or group");
+    }
+    return vector<string>(names.begin(), names.end());
+}
+
+uint64_t taskmaster::submit(job_kind kind, const vector<string> &targets)
+{
+    timer_guard guard(*this);
+    job_entry j;
+    j.kind = kind;
+    if (kind == job_kind::RELOAD_CONFIG) {
+        j.file = targets.empty() || targets[0].empty() ? config_file : targets[0];
+        try {
+            load_yaml_config(j.file);
+        } catch (const exception &e) {
+            finish(j, job_info::FAILED, e.what());
+        }
+    } else {
+        // Every task is signalled before the job waits for any of them
+        for (auto &name : select(targets)) {
+            j.targets.emplace_back();
+            auto &target = j.targets.back();
+            target.name = name;
+            auto &t = at(name);
+            try {
+                // A restart starts the task once the old replicas are reaped
+                if (kind == job_kind::START) {
+                    start_task(name);
+                } else {
+                    waiting.erase(name);
+                    auto pending = replacing.find(name);
+                    if (pending != replacing.end()) pending->second.start = false;
+                    t.stop();
+                }
+            } catch (const exception &e) {
+                target.end(false, e.what());
+            }
+        }
+    }
+    uint64_t id = j.info.id = ++last_job;
+    auto &entry = jobs.emplace(id, move(j)).first->second;
+    if (!advance(entry)) running_jobs.insert(id);
+    // Finished jobs are forgotten oldest first
+    size_t finished = jobs.size() - running_jobs.size();
+    for (auto it = jobs.begin(); finished > TJOB_HISTORY && it != jobs.end();) {
+        if (running_jobs.count(it->first)) {
+            ++it;
+            continue;
+        }
+        it = jobs.erase(it);
+        --finished;
+    }
+    return id;
+}
+
+job_info taskmaster::job(uint64_t id, bool wait)
+{
+    auto j = jobs.find(id);
+    if (j == jobs.end()) throw runtime_error("no such job");
+    while (wait && loop && j->second.info.state == job_info::RUNNING) {
+        loop->run_once();
+        // Handlers of the loop may submit jobs and forget this one
+        if ((j = jobs.find(id)) == jobs.end()) throw runtime_error("no such job");
+    }
+    return j->second.info;
+}
+
+bool taskmaster::on_job_done(uint64_t id, function<void(const job_info &)> done)
+{
+    auto j = jobs.find(id);
+    if (j == jobs.end()) return false;
+    if (j->second.info.state == job_info::RUNNING)
+        j->second.waiters.push_back(move(done));
+    else
+        done(j->second.info);
+    return true;
+}
+
+bool taskmaster::advance(job_entry &j)
+{
+    if (j.info.state != job_info::RUNNING) return true;
+    if (j.kind == job_kind::RELOAD_CONFIG) {
+        // The job ends with the startup of the autostart tasks
+        if (startup_pending) return false;
+        return finish(j, job_info::DONE, "config " + j.file + " loaded, tasks "
+                      "started in " + to_string(startup_time.count()) + " ms");
+    }
+    bool over = true;
+    for (auto &target : j.targets)
+        if (!target.done) over &= advance(j.kind, target);
+    if (!over) return false;
+    // One line per task
+    string result;
+    bool failed = false;
+    for (auto &target : j.targets) {
+        if (!result.empty()) result += '\n';
+        result += target.result;
+        failed |= target.failed;
+    }
+    return finish(j, failed ? job_info::FAILED : job_info::DONE, result);
+}
+
+bool taskmaster::advance(job_kind kind, job_target &target)
+{
+    auto t = find(target.name);
+    if (t == end()) return target.end(false, "no such task");
+    auto &tk = t->second;
+    if (replacing.count(target.name)) return false;
+    if (kind != job_kind::START && !target.stopped) {
+        if (tk.is_stopping()) return false;
+        target.stopped = true;
+        if (kind == job_kind::STOP) return target.end(true, "stopped");
+        try {
+            start_task(target.name);
+        } catch (const exception &e) {
+            return target.end(false, e.what());
+        }
+    }
+    if (tk.is_starting() || waiting.count(target.name)) return false;
+    auto failed = start_errors.find(target.name);
+    if (failed != start_errors.end()) return target.end(false, failed->second);
+    if (tk.get_state() == task_status::RUNNING)
+        return target.end(true, kind == job_kind::START ? "started" : "restarted");
+    auto &error = tk.get_error();
+    return target.end(false, error.empty() ? "start failed" : error);
+}
+
+bool taskmaster::job_target::end(bool ok, const string &what)
+{
+    done = true;
+    failed = !ok;
+    result = name + (ok ? ": " : ": error: ") + what;
+    return true;
+}
+
+bool taskmaster::finish(job_entry &j, int state, const string &result)
+{
+    j.info.state = static_cast<decltype(j.info.state)>(state);
+    j.info.result = result;
+    auto waiters = move(j.waiters);
+    j.waiters.clear();
+    for (auto &done : waiters) done(j.info);
+    return true;
+}
+
+void taskmaster::advance_jobs()
+{
+    for (auto it = running_jobs.begin(); it != running_jobs.end();) {
+        auto j = jobs.find(*it);
+        if (j == jobs.end() || advance(j->second)) it = running_jobs.erase(it);
+        else ++it;
+    }
+}
+
+void taskmaster::events(const string &name, const event_sink &out)
+{
+    deque<task_event> queued;
+    auto id = rt.events.subscribe([&name, &queued](const task_event &event) {
+        if (name.empty() || event.task == name) queued.push_back(event);
+    });
+    try {
+        for (bool reading = loop != nullptr; reading;) {
+            loop->run_once(TEVENTS_POLL_MS);
+            for (; reading && !queued.empty(); queued.pop_front())
+                reading = out(&queued.front());
+            if (reading) reading = out(nullptr);
+        }
+    } catch (...) {
+        rt.events.unsubscribe(id);
+        throw;
+    }
+    rt.events.unsubscribe(id);
+}
+
 string taskmaster::exit()
 {
     std::exit(EXIT_SUCCESS);
 }
 
-void taskmaster::update(int /*signal*/)
+// Handles pending signals and expired timers
+void taskmaster::update()
+{
+    uint64_t expirations;
+    while (read(timer_fd, &expirations, sizeof(expirations)) > 0);
+    signalfd_siginfo info;
+    bool reload = false;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGTERM) shutdown();
+        else if (info.ssi_signo == SIGHUP) reload = true;
+    }
+    rt.spawns.complete();
+    rt.reap();
+    rt.probes.complete();
+    rt.timers.advance();
+    advance_replacements();
+    advance_dependencies();
+    check_startup();
+    if (reload && !shutting_down) clog << reload_config("") << endl;
+    advance_jobs();
+    if (shutting_down && stop_pending.empty() && !rt.stopping_count()) {
+        clog << "Taskmaster stopped" << endl;
+        if (loop) loop->stop();
+    }
+    arm_timer();
+}
+
+void taskmaster::check_startup()
+{
+    if (!startup_pending || !waiting.empty() || !replacing.empty() ||
+        !removing.empty())
+        return;
+    for (auto &t : *this)
+        if (t.second.is_starting()) return;
+    startup_pending = false;
+    startup_time = chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now() - startup_begin);
+    clog << "All tasks started in " << startup_time.count() << " ms" << endl;
+}
+
+// Stops all tasks, the event loop ends once they are reaped
+void taskmaster::shutdown()
+{
+    if (shutting_down) return;
+    clog << "Stopping all tasks" << endl;
+    shutting_down = true;
+    waiting.clear();
+    replacing.clear();
+    // Dependents are stopped first, tasks without any at once
+    for (auto &t : *this) stop_pending.insert(t.first);
+    for (auto &t : *this) stop_task(t.first);
+}
+
+// Starts name once its dependencies are RUNNING and starts the ones that
+// are down. Throws if it cannot start
+void taskmaster::start_task(const string &name)
+{
+    auto &t = at(name);
+    start_errors.erase(name);
+    if (waiting.count(name)) return;
+    auto pending = replacing.find(name);
+    if (pending != replacing.end()) {
+        pending->second.start = true;
+        return;
+    }
+    int state = t.get_state();
+    if (state == task_status::STARTING || state == task_status::RUNNING ||
+        state == task_status::BACKOFF)
+        throw runtime_error("process already started");
+    for (auto &dep : t.get_config().depends_on) {
+        if (is_coming_up(dep)) continue;
+        try {
+            start_task(dep);
+        } catch (const exception &e) {
+            throw runtime_error("dependency " + dep + ": " + e.what());
+        }
+    }
+    string blocker = blocked_on(name);
+    if (blocker.empty()) t.start();
+    else waiting[name] = blocker;
+}
+
+bool taskmaster::is_coming_up(const string &name) const
 {
-    if (!master_p) return;
-    for (auto &t : *master_p) t.second.update();
+    auto &t = at(name);
+    int state = t.get_state();
+    auto pending = replacing.find(name);
+    return state == task_status::RUNNING || state == task_status::BACKOFF ||
+           t.is_starting() || waiting.count(name) ||
+           (pending != replacing.end() && pending->second.start);
+}
+
+// First dependency of name that is not RUNNING yet, empty if none. Throws
+// if one of them is down for good
+string taskmaster::blocked_on(const string &name) const
+{
+    for (auto &dep : at(name).get_config().depends_on) {
+        auto &d = at(dep);
+        if (d.get_state() == task_status::RUNNING) continue;
+        if (is_coming_up(dep)) return dep;
+        throw runtime_error("dependency " + dep + " did not start");
+    }
+    return "";
+}
+
+// Stops name during a shutdown once its dependents are down
+void taskmaster::stop_task(const string &name)
+{
+    if (!stop_pending.count(name)) return;
+    auto it = dependents.find(name);
+    if (it != dependents.end())
+        for (auto &next : it->second)
+            if (stop_pending.count(next) || at(next).is_stopping()) return;
+    stop_pending.erase(name);
+    auto &t = at(name);
+    t.stop();
+    // Nothing to wait for, the dependencies may go now
+    if (!t.is_stopping())
+        for (auto &dep : t.get_config().depends_on) stop_task(dep);
+}
+
+void taskmaster::advance_replacements()
+{
+    for (auto it = replacing.begin(); it != replacing.end();) {
+        if (at(it->first).is_stopping()) {
+            ++it;
+            continue;
+        }
+        auto r = move(it->second);
+        it = replacing.erase(it);
+        replace(r.config);
+        if (!r.start) continue;
+        try {
+            start_task(r.config.name);
+        } catch (const exception &e) {
+            clog << r.config.name << ": " << e.what() << endl;
+        }
+    }
+    for (auto it = removing.begin(); it != removing.end();) {
+        if (at(*it).is_stopping()) {
+            ++it;
+            continue;
+        }
+        erase(*it);
+        it = removing.erase(it);
+    }
+}
+
+void taskmaster::replace(const task_config &tconf)
+{
+    erase(tconf.name);
+    emplace(piecewise_construct, forward_as_tuple(tconf.name), forward_as_tuple(tconf, rt));
+    print_config(tconf, clog);
+}
+
+// Moves the tasks that depend on the changed ones on
+void taskmaster::advance_dependencies()
+{
+    while (!changed.empty()) {
+        auto names = move(changed);
+        changed.clear();
+        for (auto &name : names) {
+            if (shutting_down) {
+                auto t = find(name);
+                if (t == end() || t->second.is_stopping()) continue;
+                for (auto &dep : t->second.get_config().depends_on) stop_task(dep);
+                continue;
+            }
+            auto it = dependents.find(name);
+            if (it == dependents.end()) continue;
+            for (auto &next : it->second) {
+                auto w = waiting.find(next);
+                if (w == waiting.end()) continue;
+                try {
+                    w->second = blocked_on(next);
+                    if (!w->second.empty()) continue;
+                    waiting.erase(w);
+                    at(next).start();
+                } catch (const exception &e) {
+                    waiting.erase(next);
+                    start_errors[next] = e.what();
+                    clog << next << ": " << e.what() << endl;
+                    // Its own dependents give up too
+                    changed.push_back(next);
+                }
+            }
+        }
+    }
+}
+
+// Arms timer_fd for the next timer of the runtime
+void taskmaster::arm_timer()
+{
+    itimerspec it = {};
+    auto timeout = rt.timers.next_timeout();
+    if (timeout.count() >= 0) {
+        // A zero value would disarm the timer
+        auto nsec = max<long long>(timeout.count() * 1000000LL, 1);
+        it.it_value.tv_sec = nsec / 1000000000LL;
+        it.it_value.tv_nsec = nsec % 1000000000LL;
+    }
+    timerfd_settime(timer_fd, 0, &it, nullptr);
 }
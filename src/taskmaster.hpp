@@ -3,31 +3,145 @@
 
 #include <string>
 #include <vector>
+#include <chrono>
+#include <map>
+#include <set>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "master.hpp"
 #include "task.hpp"
+#include "runtime.hpp"
+#include "reactor.hpp"
+#include "config_cache.hpp"
 
 class taskmaster : public master, private std::unordered_map<std::string, task>
 {
 public:
     taskmaster() = default;
-    ~taskmaster() {master_p = nullptr;}
-    taskmaster(const std::string &file);
+    ~taskmaster();
+    // A cache, if given, replaces the YAML files while they do not change
+    taskmaster(const std::string &file, const std::string &cache_file = "");
     bool load_yaml_config(const std::string &file);
-    virtual std::string start(const std::string &name);
-    virtual std::string stop(const std::string &name);
-    virtual std::string restart(const std::string &name);
-    // An empty name returns the status of all programs
-    virtual std::string status(const std::string &name);
+    // Dispatches child events, signals and timers from the event loop
+    void attach(reactor &event_loop);
+    virtual void status(const status_query &query, const status_sink &out);
+    // Reports the tasks matching query in name order, chunk tasks per part.
+    // The first part holds the summary and no task, sink returns false to
+    // stop early. Throws if a name without wildcards does not exist. It has
+    // no side effect, the event loop keeps the tasks up to date
+    void report(const status_query &query, std::size_t chunk,
+                const std::function<bool(const status_report &part)> &sink) const;
     // An empty name uses old config
     virtual std::string reload_config(const std::string &file);
+    virtual std::string plan_reload(const std::string &file);
     virtual std::string exit();
+    virtual std::string tail(const std::string &name,
+                             std::vector<std::uint64_t> &cursors,
+                             std::size_t backlog);
+    virtual std::uint64_t submit(job_kind kind,
+                                 const std::vector<std::string> &targets);
+    // In local mode wait runs the event loop until the job is over
+    virtual job_info job(std::uint64_t id, bool wait);
+    // Calls done once the job is over, at once if it already is.
+    // Returns false if there is no such job
+    bool on_job_done(std::uint64_t id,
+                     std::function<void(const job_info &info)> done);
+    // In local mode the event loop runs while the events are streamed
+    virtual void events(const std::string &name, const event_sink &out);
+    event_stream &get_events() {return rt.events;}
 private:
-    static void update(int signal = SIGCHLD);
+    class timer_guard;
+    struct job_target
+    {
+        std::string name;
+        bool stopped = false;                // The replicas were reaped
+        bool done = false;
+        bool failed = false;
+        std::string result;                  // "name: what"
+        // Returns true
+        bool end(bool ok, const std::string &what);
+    };
+    struct job_entry
+    {
+        job_info info;
+        job_kind kind;
+        std::vector<job_target> targets;     // Sorted by name
+        std::string file;                    // Of RELOAD_CONFIG
+        std::vector<std::function<void(const job_info &)>> waiters;
+    };
+    // Tasks a reload adds, removes, restarts or updates in place. The
+    // configs belong to the parsed file
+    struct reload_plan
+    {
+        std::vector<const task_config *> added;
+        std::vector<std::string> removed;
+        std::vector<const task_config *> restarted;
+        std::vector<const task_config *> updated;
+        std::size_t unchanged = 0;
+    };
+    reload_plan plan_reload(const std::vector<task_config> &configs) const;
+    static std::string render_plan(const reload_plan &plan);
+    // Names of the tasks matched by names, groups, globs or "all", sorted.
+    // Throws if a target matches nothing
+    std::vector<std::string> select(const std::vector<std::string> &targets) const;
+    // Moves a running job on, returns true once it is over
+    bool advance(job_entry &j);
+    bool advance(job_kind kind, job_target &target);
+    bool finish(job_entry &j, int state, const std::string &result);
+    void advance_jobs();
+    void start_task(const std::string &name);
+    bool is_coming_up(const std::string &name) const;
+    std::string blocked_on(const std::string &name) const;
+    void stop_task(const std::string &name);
+    // Replaces or erases the tasks of a reload once their old replicas
+    // are reaped
+    void advance_replacements();
+    void replace(const task_config &tconf);
+    void advance_dependencies();
+    void watch_config(const master_config &mconf);
+    void on_config_event();
+    void update();
+    void arm_timer();
+    void shutdown();
+    void check_startup();
     static taskmaster *master_p;
+    runtime rt;
+    reactor *loop = nullptr;
+    int signal_fd = -1;                      // SIGCHLD, SIGTERM, SIGHUP
+    int timer_fd = -1;                       // Next deadline of rt.timers
+    int inotify_fd = -1;                     // Config files, if watched
+    int config_wd = -1;                      // Directory of config_file
+    int include_wd = -1;
+    timer_wheel::timer_id reload_timer;      // Pending reload of the watcher
+    std::chrono::milliseconds watch_delay{0};
+    bool shutting_down = false;
+    // Time from loading the config until no autostart task is STARTING
+    std::chrono::steady_clock::time_point startup_begin;
+    bool startup_pending = false;
+    std::chrono::milliseconds startup_time{0};
     bool configured = false;
     std::string config_file;
+    config_cache cache;
+    std::map<std::uint64_t, job_entry> jobs; // Running and TJOB_HISTORY last
+    std::set<std::uint64_t> running_jobs;
+    std::uint64_t last_job = 0;
+    // Tasks that name a task in depends_on, by that task
+    std::unordered_map<std::string, std::vector<std::string>> dependents;
+    std::map<std::string, std::string> waiting; // Task -> dependency it waits for
+    std::unordered_map<std::string, std::string> start_errors; // Gave up waiting
+    std::unordered_set<std::string> stop_pending; // Shutdown waits for dependents
+    struct replacement
+    {
+        task_config config;
+        bool start = false;                  // Once it replaces the old task
+    };
+    // Tasks restarted by a reload whose old replicas are stopping
+    std::map<std::string, replacement> replacing;
+    // Tasks removed by a reload whose replicas are stopping
+    std::set<std::string> removing;
+    std::vector<std::string> changed;        // Since advance_dependencies()
+    std::uint64_t events_id = 0;
 };
 
 #endif // CONFIGURATION_HPP
@@ -0,0 +1,122 @@
+/*
+ * Zygote mode of taskmaster, include this header in the supervised program.
+ *
+ * A task with 'zygote: true' starts the program once as a template. The
+ * program initializes itself and calls taskmaster_zygote_serve(), which
+ * never returns in the template: it forks a new replica for every request
+ * of the daemon. taskmaster_zygote_serve() returns 0 in each replica with
+ * stdin, stdout and stderr redirected and TASKMASTER_REPLICA set, and -1
+ * if the program was not started as a template.
+ *
+ * The template already runs in the working directory, with the umask and
+ * the environment of the task. Replicas are forked twice so that they are
+ * reparented to the daemon, which is a child subreaper.
+ */
+#ifndef TASKMASTER_ZYGOTE_H
+#define TASKMASTER_ZYGOTE_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define TASKMASTER_ZYGOTE_ENV   "TASKMASTER_ZYGOTE_FD"
+#define TASKMASTER_ZYGOTE_FD    3
+#define TASKMASTER_ZYGOTE_MAGIC 0x5a594731u   /* "ZYG1" */
+
+/* Daemon -> template, carries the stdin, stdout and stderr of the replica */
+struct taskmaster_zygote_request {
+    uint32_t magic;
+    uint32_t replica;
+};
+
+/* Template or replica -> daemon, pid 0 is the template readiness message */
+struct taskmaster_zygote_reply {
+    uint32_t magic;
+    int32_t pid;
+    int32_t err;
+};
+
+static inline void taskmaster_zygote_reply_(int sock, pid_t pid, int err)
+{
+    struct taskmaster_zygote_reply rep = {TASKMASTER_ZYGOTE_MAGIC, pid, err};
+    while (send(sock, &rep, sizeof(rep), MSG_NOSIGNAL) == -1 && errno == EINTR);
+}
+
+static inline int taskmaster_zygote_recv_(int sock,
+                                          struct taskmaster_zygote_request *req,
+                                          int fds[3])
+{
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov = {req, sizeof(*req)};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    while ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR);
+    if (n != (ssize_t)sizeof(*req) || req->magic != TASKMASTER_ZYGOTE_MAGIC)
+        return -1;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+        return -1;
+    memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+    return 0;
+}
+
+static inline int taskmaster_zygote_serve(void)
+{
+    const char *env = getenv(TASKMASTER_ZYGOTE_ENV);
+    struct taskmaster_zygote_request req;
+    int sock, fds[3], i;
+    pid_t first, parent;
+    char replica[16];
+
+    if (!env) return -1;
+    sock = atoi(env);
+    unsetenv(TASKMASTER_ZYGOTE_ENV);
+    taskmaster_zygote_reply_(sock, 0, 0);
+    for (;;) {
+        if (taskmaster_zygote_recv_(sock, &req, fds)) _exit(0); /* Daemon is gone */
+        if ((first = fork()) == -1) {
+            taskmaster_zygote_reply_(sock, -1, errno);
+        } else if (first == 0) {
+            parent = getpid();
+            switch (fork()) {
+            case -1:
+                taskmaster_zygote_reply_(sock, -1, errno);
+                _exit(1);
+            case 0:
+                break;
+            default:
+                _exit(0);
+            }
+            /* Replica: wait until it belongs to the daemon, then report */
+            while (getppid() == parent) usleep(100);
+            setpgid(0, 0);
+            for (i = 0; i < 3; ++i) {
+                dup2(fds[i], i);
+                if (fds[i] > 2) close(fds[i]);
+            }
+            snprintf(replica, sizeof(replica), "%u", req.replica);
+            setenv("TASKMASTER_REPLICA", replica, 1);
+            taskmaster_zygote_reply_(sock, getpid(), 0);
+            close(sock);
+            return 0;
+        }
+        for (i = 0; i < 3; ++i) close(fds[i]);
+        if (first > 0) while (waitpid(first, NULL, 0) == -1 && errno == EINTR);
+    }
+}
+
+#endif /* TASKMASTER_ZYGOTE_H */
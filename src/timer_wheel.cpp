@@ -0,0 +1,152 @@
+#include <algorithm>
+
+#include "timer_wheel.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+timer_wheel::timer_wheel(milliseconds resolution) :
+    origin(clock::now()), resolution(resolution)
+{
+    for (auto &level : slots) fill(begin(level), end(level), NIL);
+}
+
+timer_wheel::timer_id timer_wheel::add(milliseconds delay, callback func)
+{
+    uint32_t index;
+    if (free_nodes.empty()) {
+        index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    } else {
+        index = free_nodes.back();
+        free_nodes.pop_back();
+    }
+    node &n = nodes[index];
+    // Rounded up, a timer never fires early
+    auto deadline = clock::now() + max(delay, milliseconds(0)) + resolution -
+                    clock::duration(1);
+    n.expires = max(current, tick_of(deadline));
+    n.func = move(func);
+    if (!++n.generation) ++n.generation;
+    link(index);
+    ++count;
+    return {index, n.generation};
+}
+
+bool timer_wheel::cancel(timer_id &id)
+{
+    bool pending = is_pending(id);
+    if (pending) {
+        unlink(id.index);
+        release(id.index);
+    }
+    id = timer_id();
+    return pending;
+}
+
+bool timer_wheel::is_pending(timer_id id) const
+{
+    return id && id.index < nodes.size() && nodes[id.index].head &&
+           nodes[id.index].generation == id.generation;
+}
+
+size_t timer_wheel::advance(clock::time_point now)
+{
+    size_t fired = 0;
+    for (uint64_t target = tick_of(now); current <= target && count;) {
+        unsigned index = current & (SLOTS - 1);
+        for (unsigned level = 1; !index && level < LEVELS; ++level) {
+            index = (current >> (level * SLOT_BITS)) & (SLOTS - 1);
+            cascade(level, index);
+        }
+        uint32_t &slot = slots[0][current & (SLOTS - 1)];
+        ++current;
+        // Timers added by callbacks must not land in the list being processed
+        while (slot != NIL) {
+            uint32_t i = slot;
+            unlink(i);
+            link_to(i, expiring);
+        }
+        while (expiring != NIL) {
+            uint32_t i = expiring;
+            unlink(i);
+            callback func = move(nodes[i].func);
+            release(i);
+            ++fired;
+            func();
+        }
+    }
+    current = max(current, tick_of(now) + 1);
+    return fired;
+}
+
+milliseconds timer_wheel::next_timeout(clock::time_point now) const
+{
+    if (!count) return milliseconds(-1);
+    uint64_t tick = current;
+    // The first non-empty slot of the lowest level or the next cascade
+    for (; tick & (SLOTS - 1); ++tick)
+        if (slots[0][tick & (SLOTS - 1)] != NIL) break;
+    auto deadline = origin + resolution * static_cast<clock::rep>(tick);
+    return max(milliseconds(0), ceil<milliseconds>(deadline - now));
+}
+
+/*
+ * Private
+ */
+
+uint64_t timer_wheel::tick_of(clock::time_point tp) const
+{
+    return tp <= origin ? 0 : static_cast<uint64_t>((tp - origin) / resolution);
+}
+
+void timer_wheel::link(uint32_t index)
+{
+    uint64_t expires = nodes[index].expires;
+    uint64_t delta = expires - current;
+    unsigned level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << ((level + 1) * SLOT_BITS)))
+        ++level;
+    if (level == LEVELS - 1 && delta >= (uint64_t(1) << (LEVELS * SLOT_BITS))) {
+        expires = current + (uint64_t(1) << (LEVELS * SLOT_BITS)) - 1;
+        nodes[index].expires = expires;
+    }
+    link_to(index, slots[level][(expires >> (level * SLOT_BITS)) & (SLOTS - 1)]);
+}
+
+void timer_wheel::link_to(uint32_t index, uint32_t &head)
+{
+    node &n = nodes[index];
+    n.head = &head;
+    n.prev = NIL;
+    n.next = head;
+    if (head != NIL) nodes[head].prev = index;
+    head = index;
+}
+
+void timer_wheel::unlink(uint32_t index)
+{
+    node &n = nodes[index];
+    if (n.prev != NIL) nodes[n.prev].next = n.next;
+    else *n.head = n.next;
+    if (n.next != NIL) nodes[n.next].prev = n.prev;
+    n.prev = n.next = NIL;
+    n.head = nullptr;
+}
+
+void timer_wheel::release(uint32_t index)
+{
+    nodes[index].func = nullptr;
+    free_nodes.push_back(index);
+    --count;
+}
+
+void timer_wheel::cascade(unsigned level, unsigned slot)
+{
+    uint32_t &head = slots[level][slot];
+    while (head != NIL) {
+        uint32_t i = head;
+        unlink(i);
+        link(i);
+    }
+}
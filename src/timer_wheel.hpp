@@ -0,0 +1,74 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+/*
+ * Hierarchical timing wheel with 4 levels of 256 slots.
+ * Adding and cancelling a timer is O(1), timers are stored in a slab and
+ * identified by an index and a generation, so a stale id never cancels
+ * a reused slot.
+ */
+class timer_wheel
+{
+public:
+    using clock = std::chrono::steady_clock;
+    using callback = std::function<void()>;
+    struct timer_id {
+        std::uint32_t index = 0;
+        std::uint32_t generation = 0;     // 0 is never used by a live timer
+        explicit operator bool() const {return generation;}
+    };
+
+    timer_wheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(10));
+    timer_wheel(const timer_wheel &) = delete;
+    timer_wheel& operator=(const timer_wheel &) = delete;
+
+    timer_id add(std::chrono::milliseconds delay, callback func);
+    timer_id add(time_t seconds, callback func)
+    {return add(std::chrono::seconds(seconds), std::move(func));}
+    // Returns false if the timer has already fired or been cancelled
+    bool cancel(timer_id &id);
+    bool is_pending(timer_id id) const;
+    // Runs all timers expired by 'now', returns the number of fired timers
+    std::size_t advance(clock::time_point now = clock::now());
+    // Time until the next wheel step that may fire or cascade a timer,
+    // a negative value if there are no timers
+    std::chrono::milliseconds next_timeout(clock::time_point now = clock::now()) const;
+    std::size_t size() const {return count;}
+private:
+    static constexpr unsigned LEVELS = 4;
+    static constexpr unsigned SLOT_BITS = 8;
+    static constexpr unsigned SLOTS = 1 << SLOT_BITS;
+    static constexpr std::uint32_t NIL = UINT32_MAX;
+
+    struct node {
+        std::uint64_t expires = 0;        // Tick
+        std::uint32_t prev = NIL;
+        std::uint32_t next = NIL;
+        std::uint32_t *head = nullptr;    // List the node is linked in, null if free
+        std::uint32_t generation = 0;
+        callback func;
+    };
+
+    std::uint64_t tick_of(clock::time_point tp) const;
+    void link(std::uint32_t index);
+    void link_to(std::uint32_t index, std::uint32_t &head);
+    void unlink(std::uint32_t index);
+    void release(std::uint32_t index);
+    void cascade(unsigned level, unsigned slot);
+
+    clock::time_point origin;
+    clock::duration resolution;
+    std::uint64_t current = 0;            // Next tick to process
+    std::size_t count = 0;
+    std::uint32_t expiring = NIL;         // Timers of the tick being processed
+    std::uint32_t slots[LEVELS][SLOTS];
+    std::vector<node> nodes;
+    std::vector<std::uint32_t> free_nodes;
+};
+
+#endif // TIMER_WHEEL_HPP
@@ -0,0 +1,119 @@
+#include <poll.h>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "zygote.hpp"
+#include "defaults.hpp"
+#include "taskmaster_zygote.h"
+
+using namespace std;
+
+zygote::zygote(shared_ptr<const proc::launch_spec> template_spec) :
+    spec(move(template_spec))
+{
+}
+
+zygote::~zygote()
+{
+    // The template is reaped by the runtime as an unknown child
+    reset();
+}
+
+pid_t zygote::fork_replica(const proc::launch_spec &replica_spec, size_t replica,
+                           int &err, const proc::output_fds &output)
+{
+    lock_guard<std::mutex> lock(mutex);
+    // A template that died since the last request is restarted once
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (sock == -1 && !start(err)) return -1;
+        taskmaster_zygote_reply rep;
+        if (!ready) {
+            if (!receive(&rep, TZYGOTE_READY_TIMEOUT_MS, err)) {
+                reset();
+                return -1;
+            }
+            ready = true;
+        }
+
+        int fds[3];
+        proc::process::open_redir(replica_spec, fds, output);
+        taskmaster_zygote_request req = {TASKMASTER_ZYGOTE_MAGIC,
+                                         static_cast<uint32_t>(replica)};
+        char control[CMSG_SPACE(sizeof(fds))] = {};
+        iovec iov = {&req, sizeof(req)};
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+        ssize_t sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (sent == -1) err = errno;
+        for (int fd : fds) close(fd);
+        if (sent == -1 || !receive(&rep, TZYGOTE_REPLY_TIMEOUT_MS, err)) {
+            reset();
+            continue;
+        }
+        if (rep.pid > 0) return rep.pid;
+        err = rep.err;
+        return -1;
+    }
+    return -1;
+}
+
+/*
+ * Private
+ */
+
+bool zygote::start(int &err)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv)) {
+        err = errno;
+        return false;
+    }
+    pid_t pid = proc::process::launch(*spec, err, sv[1]);
+    close(sv[1]);
+    if (pid == -1) {
+        close(sv[0]);
+        return false;
+    }
+    sock = sv[0];
+    ready = false;
+    template_pid = pid;
+    return true;
+}
+
+void zygote::reset()
+{
+    if (template_pid) kill(template_pid, SIGKILL);
+    if (sock != -1) close(sock);
+    sock = -1;
+    ready = false;
+    template_pid = 0;
+}
+
+bool zygote::receive(void *reply, int timeout, int &err)
+{
+    pollfd pfd = {sock, POLLIN, 0};
+    int n;
+    while ((n = poll(&pfd, 1, timeout)) == -1 && errno == EINTR);
+    if (n == 0) {
+        err = ETIMEDOUT;
+        return false;
+    }
+    auto rep = static_cast<taskmaster_zygote_reply *>(reply);
+    ssize_t len = recv(sock, rep, sizeof(*rep), 0);
+    if (len != sizeof(*rep) || rep->magic != TASKMASTER_ZYGOTE_MAGIC) {
+        err = len == -1 ? errno : ECHILD;   // The template is gone
+        return false;
+    }
+    return true;
+}
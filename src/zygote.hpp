@@ -0,0 +1,44 @@
+#ifndef ZYGOTE_HPP
+#define ZYGOTE_HPP
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "process.hpp"
+
+/*
+ * Daemon side of the zygote mode, the protocol is in taskmaster_zygote.h.
+ * Every call is made from spawner workers: the template is started on the
+ * first request and restarted when it is gone, and requests wait for it
+ * to initialize without blocking the event loop.
+ */
+class zygote
+{
+public:
+    // template_spec must pass TASKMASTER_ZYGOTE_FD to the program
+    zygote(std::shared_ptr<const proc::launch_spec> template_spec);
+    ~zygote();
+    zygote(const zygote &) = delete;
+    zygote& operator=(const zygote &) = delete;
+
+    // Returns the pid of the replica or -1 and sets err, thread-safe
+    pid_t fork_replica(const proc::launch_spec &spec, std::size_t replica, int &err,
+                       const proc::output_fds &output = {});
+    pid_t get_pid() const {return template_pid;}
+private:
+    bool start(int &err);
+    void reset();
+    // Receives a reply within timeout milliseconds
+    bool receive(void *reply, int timeout, int &err);
+
+    std::shared_ptr<const proc::launch_spec> spec;
+    std::mutex mutex;
+    int sock = -1;
+    bool ready = false;
+    std::atomic<pid_t> template_pid{0};
+};
+
+#endif // ZYGOTE_HPP
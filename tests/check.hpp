@@ -0,0 +1,54 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <stdlib.h>
+
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+/*
+ * Helpers of the tests. A test is an executable run by ctest, it returns 1
+ * if a CHECK failed.
+ */
+namespace check {
+
+inline int failures = 0;
+
+// A directory under /tmp, removed with its files
+class temp_dir
+{
+public:
+    temp_dir()
+    {
+        char name[] = "/tmp/taskmaster_test.XXXXXX";
+        if (!mkdtemp(name)) throw std::runtime_error("mkdtemp failed");
+        path = name;
+    }
+    ~temp_dir() {std::filesystem::remove_all(path);}
+    temp_dir(const temp_dir &) = delete;
+    temp_dir& operator=(const temp_dir &) = delete;
+    const std::string &get_path() const {return path;}
+private:
+    std::string path;
+};
+
+inline int result()
+{
+    if (failures) std::cerr << failures << " checks failed" << std::endl;
+    return failures ? 1 : 0;
+}
+
+} // namespace check
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": failed: " #cond   \
+                      << std::endl;                                          \
+            ++check::failures;                                               \
+        }                                                                    \
+    } while (0)
+
+#endif // CHECK_HPP
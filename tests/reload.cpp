@@ -0,0 +1,108 @@
+#include <csignal>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include "check.hpp"
+#include "reactor.hpp"
+#include "taskmaster.hpp"
+
+using namespace std;
+
+static constexpr int TASKS = 5000;
+static constexpr int CHANGED = 4242;         // Running, its args change
+static constexpr int KEPT = 1;               // Running, left alone
+
+static string _name(int i)
+{
+    return "task-" + to_string(i);
+}
+
+static void _write_config(const string &file, const string &changed_args,
+                          int removed = -1)
+{
+    ofstream out(file);
+    for (int i = 0; i < TASKS; ++i) {
+        if (i == removed) continue;
+        bool running = i == CHANGED || i == KEPT;
+        out << _name(i) << ":\n"
+               "    prog: /bin/sleep\n"
+               "    args: [\"" << (i == CHANGED ? changed_args : "1000") << "\"]\n"
+               "    autostart: " << (running ? "true" : "false") << "\n"
+               "    starttime: 0\n"
+               "    stoptime: 1\n";
+    }
+}
+
+// Pid of the first replica of each running task
+static map<string, pid_t> _running(taskmaster &master)
+{
+    map<string, pid_t> pids;
+    status_query query;
+    query.states = 1 << task_status::RUNNING;
+    master.report(query, TASKS, [&pids](const status_report &part) {
+        for (auto &t : part.tasks)
+            if (!t.procs.empty()) pids[t.name] = t.procs[0].pid;
+        return true;
+    });
+    return pids;
+}
+
+// A one line change in a config of TASKS tasks restarts that task only
+int main()
+{
+    clog.rdbuf(nullptr);
+    check::temp_dir dir;
+    string file = dir.get_path() + "/taskmaster.yaml";
+    _write_config(file, "1000");
+    {
+        reactor loop;
+        taskmaster master(file, "");
+        master.attach(loop);
+        master.job(master.submit(job_kind::RELOAD_CONFIG, {}), true);
+        auto before = _running(master);
+        CHECK(before.size() == 2);
+
+        _write_config(file, "2000");
+        string plan = master.plan_reload(file);
+        CHECK(plan.find("reload: 0 added, 0 removed, 1 restarted, 0 updated in place, " +
+                        to_string(TASKS - 1) + " unchanged") == 0);
+        CHECK(plan.find("restart: " + _name(CHANGED) + "\n") != string::npos);
+
+        auto info = master.job(master.submit(job_kind::RELOAD_CONFIG, {}), true);
+        CHECK(info.state == job_info::DONE);
+        auto after = _running(master);
+        CHECK(after.size() == 2);
+        CHECK(after[_name(KEPT)] == before[_name(KEPT)]);
+        CHECK(after[_name(CHANGED)] && after[_name(CHANGED)] != before[_name(CHANGED)]);
+        CHECK(master.plan_reload(file).find(" 0 restarted, ") != string::npos);
+
+        // A removed task stays until its replicas are reaped
+        _write_config(file, "2000", KEPT);
+        auto id = master.submit(job_kind::RELOAD_CONFIG, {});
+        status_query query;
+        query.pattern = _name(KEPT);
+        size_t reported = 0;
+        master.report(query, 1, [&reported](const status_report &part) {
+            reported += part.tasks.size();
+            return true;
+        });
+        CHECK(reported == 1);
+        CHECK(master.plan_reload(file).find(" 0 removed, ") != string::npos);
+        CHECK(master.job(id, true).state == job_info::DONE);
+        CHECK(_running(master).size() == 1);
+        CHECK(kill(before[_name(KEPT)], 0) == -1);
+        bool gone = false;
+        try {
+            master.report(query, 1, [](const status_report &) {return true;});
+        } catch (const exception &) {
+            gone = true;
+        }
+        CHECK(gone);
+        master.job(master.submit(job_kind::STOP, {"all"}), true);
+    }
+    return check::result();
+}
@@ -0,0 +1,58 @@
+#include <csignal>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "check.hpp"
+#include "reactor.hpp"
+#include "taskmaster.hpp"
+
+using namespace std;
+
+static constexpr auto TIMEOUT = chrono::seconds(10);
+
+// The spawn of one replica fails and the other one keeps running: the
+// failure is a start failure of that replica, not an error of the task
+int main()
+{
+    clog.rdbuf(nullptr);
+    check::temp_dir dir;
+    string file = dir.get_path() + "/taskmaster.yaml";
+    // Replica 1 is pinned to a CPU that does not exist, its child fails
+    // before execve()
+    ofstream(file) << "pinned:\n"
+                      "    prog: /bin/sleep\n"
+                      "    args: [\"1000\"]\n"
+                      "    numprocs: 2\n"
+                      "    cpu_affinity: [\"0\", \"1023\"]\n"
+                      "    autostart: true\n"
+                      "    starttime: 1\n"
+                      "    startretries: 0\n";
+    {
+        reactor loop;
+        taskmaster master(file, "");
+        master.attach(loop);
+        auto deadline = chrono::steady_clock::now() + TIMEOUT;
+        task_report r;
+        pid_t running = 0;
+        do {
+            loop.run_once(100);
+            status_query query;
+            master.report(query, 1, [&r](const status_report &part) {
+                if (!part.tasks.empty()) r = part.tasks[0];
+                return true;
+            });
+            if (r.procs.size() == 2 && r.procs[0].running) running = r.procs[0].pid;
+        } while (r.state == task_status::STARTING && chrono::steady_clock::now() < deadline);
+        CHECK(r.state == task_status::FATAL);
+        CHECK(!r.error.empty());
+        CHECK(running);
+        // A replica that was stopped would be reaped by now
+        for (int i = 0; i < 5; ++i) loop.run_once(100);
+        CHECK(running && !kill(running, 0));
+        master.job(master.submit(job_kind::STOP, {"all"}), true);
+    }
+    return check::result();
+}
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "check.hpp"
+#include "reactor.hpp"
+#include "taskmaster.hpp"
+
+using namespace std;
+
+static constexpr auto TIMEOUT = chrono::seconds(10);
+
+// Any replica is over max_rss, the watchdog restarts it on every sample
+static string _leaking(const string &name, const string &crashloop_action)
+{
+    return name + ":\n"
+           "    prog: /bin/sleep\n"
+           "    args: [\"1000\"]\n"
+           "    autostart: true\n"
+           "    autorestart: false\n"
+           "    starttime: 0\n"
+           "    stoptime: 1\n"
+           "    max_rss: 1\n"
+           "    watchdog: restart\n"
+           "    backoff_initial: 0.1\n"
+           "    backoff_max: 60\n"
+           "    backoff_jitter: 0\n"
+           "    crashloop_exits: 3\n"
+           "    crashloop_window: 60\n"
+           "    crashloop_action: " + crashloop_action + "\n";
+}
+
+static task_report _report(taskmaster &master, const string &name)
+{
+    task_report r;
+    status_query query;
+    query.pattern = name;
+    master.report(query, 1, [&r](const status_report &part) {
+        if (!part.tasks.empty()) r = part.tasks[0];
+        return true;
+    });
+    return r;
+}
+
+// Replicas restarted by the watchdog count as crashes: they back off and
+// a crash loop pauses or stops the task
+int main()
+{
+    clog.rdbuf(nullptr);
+    check::temp_dir dir;
+    string file = dir.get_path() + "/taskmaster.yaml";
+    ofstream(file) << "taskmaster:\n"
+                      "    sample_interval: 0.1\n" <<
+                      _leaking("leak-backoff", "backoff") <<
+                      _leaking("leak-fatal", "fatal");
+    {
+        reactor loop;
+        taskmaster master(file, "");
+        master.attach(loop);
+        auto deadline = chrono::steady_clock::now() + TIMEOUT;
+        task_report backoff, fatal;
+        do {
+            loop.run_once(100);
+            backoff = _report(master, "leak-backoff");
+            fatal = _report(master, "leak-fatal");
+        } while ((backoff.state != task_status::BACKOFF ||
+                  fatal.state != task_status::FATAL) &&
+                 chrono::steady_clock::now() < deadline);
+        CHECK(backoff.state == task_status::BACKOFF);
+        CHECK(backoff.crash_loops == 1);
+        CHECK(backoff.watchdog_actions >= 3);
+        CHECK(fatal.state == task_status::FATAL);
+        CHECK(fatal.crash_loops == 1);
+        CHECK(fatal.watchdog_actions >= 3);
+        master.job(master.submit(job_kind::STOP, {"all"}), true);
+    }
+    return check::result();
+}